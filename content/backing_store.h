@@ -121,6 +121,16 @@ struct gui_llcache_table {
 	 */
 	nserror (*invalidate)(struct nsurl *url);
 
+	/**
+	 * Get statistics of the backing store.
+	 *
+	 * This operation is optional.
+	 *
+	 * @param[out] stats The statistics to fill in.
+	 * @return NSERROR_OK on success or error code on failure.
+	 */
+	nserror (*stats)(struct llcache_store_stats *stats);
+
 };
 
 extern struct gui_llcache_table* null_llcache_table;
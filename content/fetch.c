@@ -28,7 +28,13 @@
  * Active fetches are held in the circular linked list ::fetch_ring. There may
  * be at most nsoption max_fetchers_per_host active requests per Host: header.
  * There may be at most nsoption max_fetchers active requests overall. Inactive
- * fetches are stored in the ::queue_ring waiting for use.
+ * fetches are queued on their host, in a ring per priority class, waiting for
+ * use.
+ *
+ * Hosts which have queued fetches of a priority class and are below
+ * their active limit are held on the ::fetch_ready ring for that class.
+ * Dispatch takes the first host from the highest priority non-empty
+ * ready ring and rotates the ring so hosts are served in turn.
  */
 
 #include <stdlib.h>
@@ -47,6 +53,7 @@
 #include "utils/messages.h"
 #include "utils/nsurl.h"
 #include "utils/ring.h"
+#include "utils/trace.h"
 #include "netsurf/misc.h"
 #include "desktop/gui_internal.h"
 
@@ -70,9 +77,12 @@
  */
 #define SCHEDULE_TIME 10
 
-/** The fdset timeout in ms */
+/** The longest time in ms fetchers waiting on an fdset go unpolled */
 #define FDSET_TIMEOUT 1000
 
+/** Number of buckets in the fetch host table */
+#define FETCH_HOST_HASH_SIZE 64
+
 /**
  * Information about a fetcher for a given scheme.
  */
@@ -98,12 +108,39 @@ struct fetch {
 	int fetcherd;           /**< Fetcher descriptor for this fetch */
 	void *fetcher_handle;	/**< The handle for the fetcher. */
 	bool fetch_is_active;	/**< This fetch is active. */
-	struct fetch *r_prev;	/**< Previous active fetch in ::fetch_ring. */
-	struct fetch *r_next;	/**< Next active fetch in ::fetch_ring. */
+	enum fetch_priority priority; /**< Dispatch priority class. */
+	struct fetch_host *queue_host; /**< Queue state for the host. */
+	struct fetch *r_prev;	/**< Previous fetch in ring. */
+	struct fetch *r_next;	/**< Next fetch in ring. */
+};
+
+/** Fetch queue state for a single host. */
+struct fetch_host {
+	lwc_string *host;	/**< Host name, interned, or NULL. */
+	struct fetch_host *hash_next; /**< Next host in hash bucket. */
+	int active;		/**< Number of active fetches for host. */
+	int queued;		/**< Number of queued fetches for host. */
+	/** Rings of queued fetches for each priority class. */
+	struct fetch *queue[FETCH_PRIORITY_COUNT];
+	/** Previous host in ready ring or NULL if not on ring. */
+	struct fetch_host *ready_prev[FETCH_PRIORITY_COUNT];
+	/** Next host in ready ring or NULL if not on ring. */
+	struct fetch_host *ready_next[FETCH_PRIORITY_COUNT];
 };
 
 static struct fetch *fetch_ring = NULL;	/**< Ring of active fetches. */
-static struct fetch *queue_ring = NULL;	/**< Ring of queued fetches */
+
+/** Hash table of hosts with active or queued fetches. */
+static struct fetch_host *fetch_hosts[FETCH_HOST_HASH_SIZE];
+
+/** Rings of hosts able to dispatch a fetch of each priority class. */
+static struct fetch_host *fetch_ready[FETCH_PRIORITY_COUNT];
+
+static int fetch_active_count = 0; /**< Number of active fetches. */
+static int fetch_queued_count = 0; /**< Number of queued fetches. */
+
+/** The frontend is waiting on the fetch fdset obtained by fetch_fdset() */
+static bool fetch_fdset_waiting = false;
 
 /******************************************************************************
  * fetch internals							      *
@@ -142,23 +179,170 @@ static int get_fetcher_for_scheme(lwc_string *scheme)
 	return -1;
 }
 
+/**
+ * Find the queue state for a host, creating it if necessary.
+ *
+ * \param host The interned host name or NULL.
+ * \return The host queue state or NULL on memory exhaustion.
+ */
+static struct fetch_host *fetch_host_get(lwc_string *host)
+{
+	struct fetch_host *fh;
+	unsigned int bucket = 0;
+
+	if (host != NULL) {
+		bucket = lwc_string_hash_value(host) & (FETCH_HOST_HASH_SIZE - 1);
+	}
+
+	/* interned strings are equal only if they are the same string */
+	for (fh = fetch_hosts[bucket]; fh != NULL; fh = fh->hash_next) {
+		if (fh->host == host) {
+			return fh;
+		}
+	}
+
+	fh = calloc(1, sizeof(struct fetch_host));
+	if (fh == NULL) {
+		return NULL;
+	}
+	if (host != NULL) {
+		fh->host = lwc_string_ref(host);
+	}
+	fh->hash_next = fetch_hosts[bucket];
+	fetch_hosts[bucket] = fh;
+
+	return fh;
+}
+
+/**
+ * Free the queue state for a host if it has no fetches.
+ *
+ * \param fh The host queue state.
+ */
+static void fetch_host_put(struct fetch_host *fh)
+{
+	struct fetch_host **link;
+	unsigned int bucket = 0;
+
+	if ((fh->active != 0) || (fh->queued != 0)) {
+		return;
+	}
+
+	if (fh->host != NULL) {
+		bucket = lwc_string_hash_value(fh->host) &
+			(FETCH_HOST_HASH_SIZE - 1);
+	}
+
+	for (link = &fetch_hosts[bucket]; *link != NULL;
+	     link = &(*link)->hash_next) {
+		if (*link == fh) {
+			*link = fh->hash_next;
+			break;
+		}
+	}
+
+	if (fh->host != NULL) {
+		lwc_string_unref(fh->host);
+	}
+	free(fh);
+}
+
+/**
+ * Update a hosts membership of the ready rings.
+ *
+ * A host is on the ready ring for a priority class when it has queued
+ * fetches of that class and is below its active fetch limit.
+ *
+ * \param fh The host queue state.
+ */
+static void fetch_host_update_ready(struct fetch_host *fh)
+{
+	bool below_limit;
+	int pri;
+
+	below_limit = (fh->active < nsoption_int(max_fetchers_per_host));
+
+	for (pri = 0; pri < FETCH_PRIORITY_COUNT; pri++) {
+		if (below_limit && (fh->queue[pri] != NULL)) {
+			if (fh->ready_next[pri] != NULL) {
+				continue;
+			}
+			/* add to end of ready ring */
+			if (fetch_ready[pri] == NULL) {
+				fh->ready_next[pri] = fh;
+				fh->ready_prev[pri] = fh;
+				fetch_ready[pri] = fh;
+			} else {
+				fh->ready_next[pri] = fetch_ready[pri];
+				fh->ready_prev[pri] = fetch_ready[pri]->ready_prev[pri];
+				fh->ready_prev[pri]->ready_next[pri] = fh;
+				fetch_ready[pri]->ready_prev[pri] = fh;
+			}
+		} else if (fh->ready_next[pri] != NULL) {
+			/* remove from ready ring */
+			if (fh->ready_next[pri] == fh) {
+				fetch_ready[pri] = NULL;
+			} else {
+				fh->ready_next[pri]->ready_prev[pri] = fh->ready_prev[pri];
+				fh->ready_prev[pri]->ready_next[pri] = fh->ready_next[pri];
+				if (fetch_ready[pri] == fh) {
+					fetch_ready[pri] = fh->ready_next[pri];
+				}
+			}
+			fh->ready_next[pri] = NULL;
+			fh->ready_prev[pri] = NULL;
+		}
+	}
+}
+
+/**
+ * Add a fetch to the end of its hosts queue.
+ */
+static void fetch_queue_insert(struct fetch *fetch)
+{
+	struct fetch_host *fh = fetch->queue_host;
+
+	RING_INSERT(fh->queue[fetch->priority], fetch);
+	fh->queued++;
+	fetch_queued_count++;
+
+	fetch_host_update_ready(fh);
+}
+
+/**
+ * Remove a fetch from its hosts queue.
+ */
+static void fetch_queue_remove(struct fetch *fetch)
+{
+	struct fetch_host *fh = fetch->queue_host;
+
+	RING_REMOVE(fh->queue[fetch->priority], fetch);
+	fh->queued--;
+	fetch_queued_count--;
+
+	fetch_host_update_ready(fh);
+}
+
 /**
  * Dispatch a single job
  */
 static bool fetch_dispatch_job(struct fetch *fetch)
 {
-	RING_REMOVE(queue_ring, fetch);
+	fetch_queue_remove(fetch);
 	NSLOG(fetch, DEBUG,
 	      "Attempting to start fetch %p, fetcher %p, url %s", fetch,
 	      fetch->fetcher_handle,
 	      nsurl_access(fetch->url));
 
 	if (!fetchers[fetch->fetcherd].ops.start(fetch->fetcher_handle)) {
-		RING_INSERT(queue_ring, fetch); /* Put it back on the end of the queue */
+		fetch_queue_insert(fetch); /* Put it back on the end of the queue */
 		return false;
 	} else {
 		RING_INSERT(fetch_ring, fetch);
 		fetch->fetch_is_active = true;
+		fetch->queue_host->active++;
+		fetch_active_count++;
+		fetch_host_update_ready(fetch->queue_host);
 		return true;
 	}
 }
@@ -172,46 +356,43 @@ static bool fetch_dispatch_job(struct fetch *fetch)
  */
 static bool fetch_choose_and_dispatch(void)
 {
-	bool same_host;
-	struct fetch *queueitem;
-	queueitem = queue_ring;
-	do {
-		/* We can dispatch the selected item if there is room in the
-		 * fetch ring
-		 */
-		int countbyhost;
-		RING_COUNTBYLWCHOST(struct fetch, fetch_ring, countbyhost,
-				    queueitem->host);
-		if (countbyhost < nsoption_int(max_fetchers_per_host)) {
-			/* We can dispatch this item in theory */
-			return fetch_dispatch_job(queueitem);
-		}
-		/* skip over other items with the same host */
-		same_host = true;
-		while (same_host == true && queueitem->r_next != queue_ring) {
-			if (lwc_string_isequal(queueitem->host,
-					       queueitem->r_next->host, &same_host) ==
-			    lwc_error_ok && same_host == true) {
-				queueitem = queueitem->r_next;
-			}
+	struct fetch_host *fh;
+	int pri;
+
+	for (pri = 0; pri < FETCH_PRIORITY_COUNT; pri++) {
+		fh = fetch_ready[pri];
+		if (fh != NULL) {
+			/* next dispatch of this class is from the next host */
+			fetch_ready[pri] = fh->ready_next[pri];
+
+			return fetch_dispatch_job(fh->queue[pri]);
 		}
-		queueitem = queueitem->r_next;
-	} while (queueitem != queue_ring);
+	}
 	return false;
 }
 
 static void dump_rings(void)
 {
+	struct fetch_host *fh;
 	struct fetch *q;
 	struct fetch *f;
-
-	q = queue_ring;
-	if (q) {
-		do {
-			NSLOG(fetch, DEBUG, "queue_ring: %s",
-			      nsurl_access(q->url));
-			q = q->r_next;
-		} while (q != queue_ring);
+	int bucket;
+	int pri;
+
+	for (bucket = 0; bucket < FETCH_HOST_HASH_SIZE; bucket++) {
+		for (fh = fetch_hosts[bucket]; fh != NULL; fh = fh->hash_next) {
+			for (pri = 0; pri < FETCH_PRIORITY_COUNT; pri++) {
+				q = fh->queue[pri];
+				if (q == NULL) {
+					continue;
+				}
+				do {
+					NSLOG(fetch, DEBUG, "queue %d: %s",
+					      pri, nsurl_access(q->url));
+					q = q->r_next;
+				} while (q != fh->queue[pri]);
+			}
+		}
 	}
 	f = fetch_ring;
 	if (f) {
@@ -230,14 +411,11 @@ static void dump_rings(void)
  */
 static bool fetch_dispatch_jobs(void)
 {
-	int all_active;
-	int all_queued;
-
-	RING_GETSIZE(struct fetch, queue_ring, all_queued);
-	RING_GETSIZE(struct fetch, fetch_ring, all_active);
+	int all_active = fetch_active_count;
+	int all_queued = fetch_queued_count;
 
 	NSLOG(fetch, DEBUG,
-	      "queue_ring %i, fetch_ring %i",
+	      "queued %i, fetch_ring %i",
 	      all_queued,
 	      all_active);
 	dump_rings();
@@ -259,9 +437,62 @@ static bool fetch_dispatch_jobs(void)
 	return (all_active > 0);
 }
 
+/**
+ * Find how long the fetchers can be left before they must be polled.
+ *
+ * Fetcher timers are only honoured when the frontend is waiting on
+ * the fetch fdset. Otherwise active fetchers are polled frequently as
+ * nothing else notices their sockets becoming ready.
+ *
+ * \param fd_wait true if the frontend is waiting on the fetch fdset
+ *                and will call fetch_fdset() when a descriptor is ready.
+ * \return The time in ms until the fetchers need polling.
+ */
+static int fetch_poll_timeout(bool fd_wait)
+{
+	int timeout = FDSET_TIMEOUT;
+	int fetcherd;
+
+	for (fetcherd = 0; fetcherd < MAX_FETCHERS; fetcherd++) {
+		int fetcher_timeout;
+
+		if (fetchers[fetcherd].refcount <= 1) {
+			/* fetcher absent or without active fetches */
+			continue;
+		}
+
+		if ((fd_wait == false) ||
+		    (fetchers[fetcherd].ops.timeout == NULL)) {
+			/* socket readiness is only noticed by polling
+			 * unless the frontend waits on the fetch fdset
+			 */
+			return SCHEDULE_TIME;
+		}
+
+		fetcher_timeout = fetchers[fetcherd].ops.timeout(
+			fetchers[fetcherd].scheme);
+		if (fetcher_timeout < 0) {
+			/* no timer, the fdset wakes the frontend */
+			continue;
+		}
+
+		if (fetcher_timeout < timeout) {
+			timeout = fetcher_timeout;
+		}
+	}
+
+	return timeout;
+}
+
 static void fetcher_poll(void *unused)
 {
 	int fetcherd;
+	bool fd_wait = fetch_fdset_waiting;
+
+	/* if the frontend does not obtain the fdset again before the
+	 * next poll fall back to polling the fetchers frequently
+	 */
+	fetch_fdset_waiting = false;
 
 	if (fetch_dispatch_jobs()) {
 		NSLOG(fetch, DEBUG, "Polling fetchers");
@@ -272,8 +503,9 @@ static void fetcher_poll(void *unused)
 			}
 		}
 
-		/* schedule active fetchers to run again in 10ms */
-		guit->misc->schedule(SCHEDULE_TIME, fetcher_poll, NULL);
+		/* schedule active fetchers to run again when needed */
+		guit->misc->schedule(fetch_poll_timeout(fd_wait),
+				     fetcher_poll, NULL);
 	}
 }
 
@@ -423,20 +655,20 @@ fetch_fdset(fd_set *read_fd_set,
 	}
 
 	if (maxfd >= 0) {
-		/* change the scheduled poll to happen is a 1000ms as
-		 * we assume fetching an fdset means the fetchers will
-		 * be run by the client waking up on data available on
-		 * the fd and re-calling fetcher_fdset() if this does
-		 * not happen the fetch polling will continue as
-		 * usual.
-		 */
-		/** @note adjusting the schedule time is only done for
-		 * curl currently. This is because as it is assumed to
-		 * be the only fetcher that can possibly have fd to
-		 * select on. All the other fetchers continue to need
-		 * polling frequently.
+		/* the client is expected to wake up on data available
+		 * on the fds and re-call fetch_fdset() so the poll
+		 * only needs to happen when a fetcher timer expires
+		 * (curl asks for this with its timer callback). If
+		 * this does not happen the fetch polling will fall
+		 * back to running as usual.
+		 *
+		 * Fetchers without a timeout operation cannot have
+		 * an fd to select on and continue to need polling
+		 * frequently.
 		 */
-		guit->misc->schedule(FDSET_TIMEOUT, fetcher_poll, NULL);
+		fetch_fdset_waiting = true;
+		guit->misc->schedule(fetch_poll_timeout(true),
+				     fetcher_poll, NULL);
 	}
 
 	*maxfd_out = maxfd;
@@ -444,6 +676,34 @@ fetch_fdset(fd_set *read_fd_set,
 	return NSERROR_OK;
 }
 
+/* exported interface documented in content/fetch.h */
+nserror
+fetch_get_host_stats(unsigned int idx,
+		     const char **host_out,
+		     int *active_out,
+		     int *queued_out)
+{
+	struct fetch_host *fh;
+	unsigned int bucket;
+
+	for (bucket = 0; bucket < FETCH_HOST_HASH_SIZE; bucket++) {
+		for (fh = fetch_hosts[bucket]; fh != NULL; fh = fh->hash_next) {
+			if (idx-- != 0) {
+				continue;
+			}
+
+			*host_out = (fh->host != NULL) ?
+				lwc_string_data(fh->host) : NULL;
+			*active_out = fh->active;
+			*queued_out = fh->queued;
+
+			return NSERROR_OK;
+		}
+	}
+
+	return NSERROR_NOT_FOUND;
+}
+
 /* exported interface documented in content/fetch.h */
 nserror
 fetch_start(nsurl *url,
@@ -456,6 +716,7 @@ fetch_start(nsurl *url,
 	    bool verifiable,
 	    bool downgrade_tls,
 	    const char *headers[],
+	    enum fetch_priority priority,
 	    struct fetch **fetch_out)
 {
 	struct fetch *fetch;
@@ -495,6 +756,21 @@ fetch_start(nsurl *url,
 	fetch->fetch_is_active = false;
 	fetch->host = nsurl_get_component(url, NSURL_HOST);
 
+	if (priority >= FETCH_PRIORITY_COUNT) {
+		priority = FETCH_PRIORITY_DOCUMENT;
+	}
+	fetch->priority = priority;
+
+	fetch->queue_host = fetch_host_get(fetch->host);
+	if (fetch->queue_host == NULL) {
+		if (fetch->host != NULL)
+			lwc_string_unref(fetch->host);
+		nsurl_unref(fetch->url);
+		lwc_string_unref(scheme);
+		free(fetch);
+		return NSERROR_NOMEM;
+	}
+
 	if (referer != NULL) {
 		lwc_string *ref_scheme;
 		fetch->referer = nsurl_ref(referer);
@@ -545,6 +821,8 @@ fetch_start(nsurl *url,
 						headers);
 	if (fetch->fetcher_handle == NULL) {
 
+		fetch_host_put(fetch->queue_host);
+
 		if (fetch->host != NULL)
 			lwc_string_unref(fetch->host);
 
@@ -566,8 +844,10 @@ fetch_start(nsurl *url,
 	/* Rah, got it, so ref the fetcher. */
 	fetch_ref_fetcher(fetch->fetcherd);
 
+	NSTRACE_ASYNC_BEGIN("fetch", fetch);
+
 	/* Dump new fetch in the queue. */
-	RING_INSERT(queue_ring, fetch);
+	fetch_queue_insert(fetch);
 
 	/* Ask the queue to run. */
 	if (fetch_dispatch_jobs()) {
@@ -598,6 +878,8 @@ void fetch_free(struct fetch *f)
 	      f,
 	      f->fetcher_handle);
 
+	NSTRACE_ASYNC_END("fetch", f);
+
 	fetchers[f->fetcherd].ops.free(f->fetcher_handle);
 
 	fetch_unref_fetcher(f->fetcherd);
@@ -741,9 +1023,6 @@ fetch_send_callback(const fetch_msg *msg, struct fetch *fetch)
 /* exported interface documented in content/fetch.h */
 void fetch_remove_from_queues(struct fetch *fetch)
 {
-	int all_active;
-	int all_queued;
-
 	NSLOG(fetch, DEBUG,
 	      "Fetch %p, fetcher %p can be freed",
 	      fetch,
@@ -752,16 +1031,19 @@ void fetch_remove_from_queues(struct fetch *fetch)
 	/* Go ahead and free the fetch properly now */
 	if (fetch->fetch_is_active) {
 		RING_REMOVE(fetch_ring, fetch);
+		fetch->fetch_is_active = false;
+		fetch->queue_host->active--;
+		fetch_active_count--;
+		fetch_host_update_ready(fetch->queue_host);
 	} else {
-		RING_REMOVE(queue_ring, fetch);
+		fetch_queue_remove(fetch);
 	}
 
+	fetch_host_put(fetch->queue_host);
+	fetch->queue_host = NULL;
 
-	RING_GETSIZE(struct fetch, fetch_ring, all_active);
-	RING_GETSIZE(struct fetch, queue_ring, all_queued);
-
-	NSLOG(fetch, DEBUG, "Fetch ring is now %d elements.", all_active);
-	NSLOG(fetch, DEBUG, "Queue ring is now %d elements.", all_queued);
+	NSLOG(fetch, DEBUG, "Fetch ring is now %d elements.", fetch_active_count);
+	NSLOG(fetch, DEBUG, "Queue is now %d elements.", fetch_queued_count);
 }
 
 
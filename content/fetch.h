@@ -37,6 +37,7 @@ typedef enum {
 	FETCH_PROGRESS,
 	FETCH_HEADER,
 	FETCH_DATA,
+	FETCH_DATA_ADOPT,
 	FETCH_FINISHED,
 	FETCH_TIMEDOUT,
 	FETCH_ERROR,
@@ -47,6 +48,15 @@ typedef enum {
 	FETCH_SSL_ERR
 } fetch_msg_type;
 
+/**
+ * Release function for data passed with a FETCH_DATA_ADOPT message.
+ *
+ * \param buf The data buffer being released.
+ * \param len The length of the data buffer.
+ * \param pw The context passed with the message.
+ */
+typedef void (*fetch_data_release_fn)(uint8_t *buf, size_t len, void *pw);
+
 typedef struct fetch_msg {
 	fetch_msg_type type;
 
@@ -58,6 +68,19 @@ typedef struct fetch_msg {
 			size_t len;
 		} header_or_data;
 
+		/**
+		 * Data whose ownership passes to the receiver.
+		 *
+		 * The receiver uses the buffer in place and calls
+		 * release, if set, once it is no longer required.
+		 */
+		struct {
+			uint8_t *buf;
+			size_t len;
+			fetch_data_release_fn release;
+			void *pw;
+		} adopt;
+
 		const char *error;
 
 		/** \todo Use nsurl */
@@ -95,6 +118,20 @@ struct ssl_cert_info {
 	int cert_type;		/**< Certificate type */
 };
 
+/**
+ * Fetch dispatch priority classes.
+ *
+ * Queued fetches are dispatched in priority order, highest first, with
+ * hosts served in turn within each class.
+ */
+enum fetch_priority {
+	FETCH_PRIORITY_DOCUMENT = 0, /**< Documents and anything unclassified */
+	FETCH_PRIORITY_STYLE, /**< Style sheets and scripts */
+	FETCH_PRIORITY_IMAGE, /**< Images */
+	FETCH_PRIORITY_PREFETCH, /**< Speculative fetches, such as link prefetch */
+	FETCH_PRIORITY_COUNT /**< Number of priority classes */
+};
+
 typedef void (*fetch_callback)(const fetch_msg *msg, void *p);
 
 /**
@@ -125,6 +162,7 @@ typedef void (*fetch_callback)(const fetch_msg *msg, void *p);
  * \param verifiable
  * \param downgrade_tls
  * \param headers
+ * \param priority The dispatch priority class of the fetch.
  * \param fetch_out ponter to recive new fetch object.
  * \return NSERROR_OK and fetch_out updated else appropriate error code
  */
@@ -132,7 +170,8 @@ nserror fetch_start(nsurl *url, nsurl *referer, fetch_callback callback,
 		    void *p, bool only_2xx, const char *post_urlenc,
 		    const struct fetch_multipart_data *post_multipart,
 		    bool verifiable, bool downgrade_tls,
-		    const char *headers[], struct fetch **fetch_out);
+		    const char *headers[], enum fetch_priority priority,
+		    struct fetch **fetch_out);
 
 /**
  * Abort a fetch.
@@ -216,6 +255,9 @@ void fetch_set_cookie(struct fetch *fetch, const char *data);
  * expected to wait on them (with select etc.) and continue to obtain
  * the fdset with this call. This will switch the fetchers from polled
  * mode to waiting for network activity which is much more efficient.
+ * While waiting the fetchers are only polled from the scheduler when
+ * a fetcher timeout (such as a cURL connection timer) expires, so the
+ * caller should also honour the scheduler timeout.
  *
  * \note If the caller does not subsequently obtain the fdset again
  * the fetchers will fall back to the less efficient polled
@@ -230,4 +272,19 @@ void fetch_set_cookie(struct fetch *fetch, const char *data);
  */
 nserror fetch_fdset(fd_set *read_fd_set, fd_set *write_fd_set, fd_set *except_fd_set, int *maxfd);
 
+/**
+ * Get the fetch queue state of a host.
+ *
+ * The hosts with active or queued fetches are enumerated by index.
+ *
+ * \param[in] idx The index of the host.
+ * \param[out] host_out The host name, or NULL for fetches without a
+ *                      host, valid until the fetch queues next change.
+ * \param[out] active_out The number of active fetches for the host.
+ * \param[out] queued_out The number of queued fetches for the host.
+ * \return NSERROR_OK on success or NSERROR_NOT_FOUND if there is no
+ *         host with the index.
+ */
+nserror fetch_get_host_stats(unsigned int idx, const char **host_out, int *active_out, int *queued_out);
+
 #endif
@@ -96,6 +96,17 @@ struct fetcher_operation_table {
 	int (*fdset)(lwc_string *scheme, fd_set *read_set, fd_set *write_set,
 		     fd_set *error_set);
 
+	/**
+	 * time until the fetcher next needs to be polled.
+	 *
+	 * Optional; fetchers without this entry are polled frequently
+	 * while they have active fetches.
+	 *
+	 * \return The time in ms or -1 if the fetcher only needs
+	 *         polling when one of its fdset descriptors is ready.
+	 */
+	int (*timeout)(lwc_string *scheme);
+
 	/**
 	 * Finalise the fetcher.
 	 */
@@ -30,16 +30,22 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <time.h>
 
 #include "testament.h"
 #include "utils/corestrings.h"
 #include "utils/nsoption.h"
 #include "utils/utils.h"
 #include "utils/ring.h"
+#include "utils/trace.h"
+#include "netsurf/inttypes.h"
+#include "desktop/scheduler.h"
 
 #include "content/fetch.h"
 #include "content/fetchers.h"
 #include "content/fetchers/about.h"
+#include "content/llcache.h"
+#include "content/hlcache.h"
 #include "image/image_cache.h"
 
 
@@ -221,6 +227,8 @@ static bool fetch_about_imagecache_handler(struct fetch_about_context *ctx)
 				"(from %v images converted more than once)"
 				"</p>\n"
 		"<p>Bitmap of size %w had most (%x) conversions</p>\n"
+		"<p>Total conversion time %zms in %y conversions "
+				"(longest %Zms)</p>\n"
 		"<h2>Current image cache contents</h2>\n");
 	if (slen >= (int) (sizeof(buffer)))
 		goto fetch_about_imagecache_handler_aborted; /* overflow */
@@ -288,6 +296,265 @@ fetch_about_imagecache_handler_aborted:
 	return false;
 }
 
+/**
+ * Compute a percentage of a total.
+ *
+ * \param part The part of the total.
+ * \param total The total.
+ * \return The percentage, or 0 if the total is 0.
+ */
+static unsigned int fetch_about_percent(uint64_t part, uint64_t total)
+{
+	if (total == 0) {
+		return 0;
+	}
+	return (unsigned int)((part * 100) / total);
+}
+
+/** Handler to generate about:perf page */
+static bool fetch_about_perf_handler(struct fetch_about_context *ctx)
+{
+	fetch_msg msg;
+	char buffer[2048]; /* output buffer */
+	int code = 200;
+	int slen;
+	int res = 0;
+	struct llcache_stats llstats;
+	struct llcache_store_stats storestats;
+	struct hlcache_stats hlstats;
+	unsigned int retrievals;
+	unsigned int idx;
+	const char *host;
+	int active;
+	int queued;
+	int total_active = 0;
+	int total_queued = 0;
+	time_t now;
+
+	/* content is going to return ok */
+	fetch_set_http_code(ctx->fetchh, code);
+
+	/* content type */
+	if (fetch_about_send_header(ctx, "Content-Type: text/html"))
+		goto fetch_about_perf_handler_aborted;
+
+	msg.type = FETCH_DATA;
+	msg.data.header_or_data.buf = (const uint8_t *) buffer;
+
+	/* page head */
+	slen = snprintf(buffer, sizeof buffer,
+			"<html>\n<head>\n"
+			"<title>NetSurf Browser Performance Statistics</title>\n"
+			"<link rel=\"stylesheet\" type=\"text/css\" "
+			"href=\"resource:internal.css\">\n"
+			"</head>\n"
+			"<body id =\"perf\">\n"
+			"<p class=\"banner\">"
+			"<a href=\"http://www.netsurf-browser.org/\">"
+			"<img src=\"resource:netsurf.png\" alt=\"NetSurf\"></a>"
+			"</p>\n"
+			"<h1>NetSurf Browser Performance Statistics</h1>\n");
+	msg.data.header_or_data.len = slen;
+	if (fetch_about_send_callback(&msg, ctx))
+		goto fetch_about_perf_handler_aborted;
+
+	/* low level cache */
+	if (llcache_get_stats(&llstats) != NSERROR_OK)
+		goto fetch_about_perf_handler_aborted;
+
+	retrievals = llstats.hit_count + llstats.revalidate_count +
+		llstats.miss_count + llstats.uncachable_count;
+
+	slen = snprintf(buffer, sizeof buffer,
+		"<h2>Low level cache</h2>\n"
+		"<p>Objects cached %u (source in RAM %u, on disc %u), "
+				"uncached %u</p>\n"
+		"<p>RAM in use %"PRIsizet" of limit %"PRIsizet" bytes "
+				"(%u%%)</p>\n"
+		"<p>Retrievals fresh/revalidate/miss/uncachable "
+				"%u/%u/%u/%u (%u%%/%u%%/%u%%/%u%%)</p>\n"
+		"<p>Objects found in backing store %u</p>\n"
+		"<p>Revalidations found not modified %u</p>\n"
+		"<p>Backing store writes %"PRIu64" bytes in %"PRIu64"ms "
+				"(%"PRIu64" bytes/s, limits %"PRIsizet
+				" to %"PRIsizet" bytes/s)</p>\n",
+		llstats.cached_count, llstats.ram_count, llstats.disc_count,
+		llstats.uncached_count,
+		llstats.size, llstats.limit,
+		fetch_about_percent(llstats.size, llstats.limit),
+		llstats.hit_count, llstats.revalidate_count,
+		llstats.miss_count, llstats.uncachable_count,
+		fetch_about_percent(llstats.hit_count, retrievals),
+		fetch_about_percent(llstats.revalidate_count, retrievals),
+		fetch_about_percent(llstats.miss_count, retrievals),
+		fetch_about_percent(llstats.uncachable_count, retrievals),
+		llstats.store_count,
+		llstats.notmodified_count,
+		llstats.total_written, llstats.total_elapsed,
+		(llstats.total_elapsed == 0) ? 0 :
+			(llstats.total_written * 1000) / llstats.total_elapsed,
+		llstats.minimum_bandwidth, llstats.maximum_bandwidth);
+	if (slen >= (int) (sizeof(buffer)))
+		goto fetch_about_perf_handler_aborted; /* overflow */
+
+	msg.data.header_or_data.len = slen;
+	if (fetch_about_send_callback(&msg, ctx))
+		goto fetch_about_perf_handler_aborted;
+
+	/* high level cache */
+	if (hlcache_get_stats(&hlstats) != NSERROR_OK)
+		goto fetch_about_perf_handler_aborted;
+
+	retrievals = hlstats.hit_count + hlstats.miss_count;
+
+	slen = snprintf(buffer, sizeof buffer,
+		"<h2>High level cache</h2>\n"
+		"<p>Contents %u (shared %u, unused %u) with %u users</p>\n"
+		"<p>Retrievals shared/created %u/%u (%u%%/%u%%)</p>\n",
+		hlstats.content_count, hlstats.shared_count,
+		hlstats.unused_count, hlstats.user_count,
+		hlstats.hit_count, hlstats.miss_count,
+		fetch_about_percent(hlstats.hit_count, retrievals),
+		fetch_about_percent(hlstats.miss_count, retrievals));
+	if (slen >= (int) (sizeof(buffer)))
+		goto fetch_about_perf_handler_aborted; /* overflow */
+
+	msg.data.header_or_data.len = slen;
+	if (fetch_about_send_callback(&msg, ctx))
+		goto fetch_about_perf_handler_aborted;
+
+	/* backing store */
+	if (llcache_get_store_stats(&storestats) != NSERROR_OK) {
+		slen = snprintf(buffer, sizeof buffer,
+			"<h2>Backing store</h2>\n"
+			"<p>No statistics available</p>\n");
+	} else {
+		slen = snprintf(buffer, sizeof buffer,
+			"<h2>Backing store</h2>\n"
+			"<p>Size %"PRIu64" of limit %"PRIsizet" bytes "
+					"(%u%%)</p>\n"
+			"<p>Entries %u of %u (%u%%)</p>\n"
+			"<p>Data blocks %u of %u, metadata blocks %u "
+					"of %u</p>\n"
+			"<p>Fetch hit/miss %"PRIsizet"/%"PRIsizet
+					" (%"PRIu64" bytes served)</p>\n"
+			"<p>Evictions %u</p>\n"
+			"<p class=\"perflist\">\n"
+			"<strong>"
+			"<span>Eviction</span>"
+			"<span>Age</span>"
+			"<span>Entries</span>"
+			"<span>Size</span>"
+			"</strong>\n",
+			storestats.size, storestats.limit,
+			fetch_about_percent(storestats.size, storestats.limit),
+			storestats.entries, storestats.entry_limit,
+			fetch_about_percent(storestats.entries,
+					    storestats.entry_limit),
+			storestats.data_blocks, storestats.block_limit,
+			storestats.meta_blocks, storestats.block_limit,
+			storestats.hit_count, storestats.miss_count,
+			storestats.hit_size,
+			storestats.evict_count);
+
+		now = time(NULL);
+		for (idx = 0;
+		     (idx < LLCACHE_STORE_EVICT_HISTORY) &&
+			     (idx < storestats.evict_count) &&
+			     (slen < (int) (sizeof(buffer)));
+		     idx++) {
+			slen += snprintf(buffer + slen, sizeof buffer - slen,
+				"<span>"
+				"<span>%u</span>"
+				"<span>%lds</span>"
+				"<span>%u</span>"
+				"<span>%"PRIsizet"</span>"
+				"</span>\n",
+				storestats.evict_count - idx,
+				(long)(now - storestats.evict[idx].time),
+				storestats.evict[idx].entries,
+				storestats.evict[idx].size);
+		}
+
+		if (slen < (int) (sizeof(buffer))) {
+			slen += snprintf(buffer + slen, sizeof buffer - slen,
+					 "</p>\n");
+		}
+	}
+	if (slen >= (int) (sizeof(buffer)))
+		goto fetch_about_perf_handler_aborted; /* overflow */
+
+	msg.data.header_or_data.len = slen;
+	if (fetch_about_send_callback(&msg, ctx))
+		goto fetch_about_perf_handler_aborted;
+
+	/* fetch queues */
+	slen = snprintf(buffer, sizeof buffer,
+			"<h2>Fetch queues</h2>\n"
+			"<p>Maximum fetchers %d, per host %d</p>\n"
+			"<p class=\"perflist\">\n"
+			"<strong>"
+			"<span>Host</span>"
+			"<span>Active</span>"
+			"<span>Queued</span>"
+			"</strong>\n",
+			nsoption_int(max_fetchers),
+			nsoption_int(max_fetchers_per_host));
+
+	idx = 0;
+	while (fetch_get_host_stats(idx, &host, &active, &queued) ==
+	       NSERROR_OK) {
+		res = snprintf(buffer + slen, sizeof buffer - slen,
+			       "<span>"
+			       "<span>%s</span>"
+			       "<span>%d</span>"
+			       "<span>%d</span>"
+			       "</span>\n",
+			       (host != NULL) ? host : "(none)",
+			       active, queued);
+
+		if (res >= (int) (sizeof buffer - slen)) {
+			/* last entry would not fit in buffer, submit buffer */
+			msg.data.header_or_data.len = slen;
+			if (fetch_about_send_callback(&msg, ctx))
+				goto fetch_about_perf_handler_aborted;
+			slen = 0;
+		} else {
+			/* normal addition */
+			slen += res;
+			total_active += active;
+			total_queued += queued;
+			idx++;
+		}
+	}
+
+	msg.data.header_or_data.len = slen;
+	if (fetch_about_send_callback(&msg, ctx))
+		goto fetch_about_perf_handler_aborted;
+
+	/* queue totals and scheduler */
+	slen = snprintf(buffer, sizeof buffer,
+			"</p>\n"
+			"<p>Total active %d, queued %d</p>\n"
+			"<h2>Scheduler</h2>\n"
+			"<p>Common scheduler callbacks %u</p>\n"
+			"</body>\n</html>\n",
+			total_active, total_queued,
+			scheduler_count());
+
+	msg.data.header_or_data.len = slen;
+	if (fetch_about_send_callback(&msg, ctx))
+		goto fetch_about_perf_handler_aborted;
+
+	msg.type = FETCH_FINISHED;
+	fetch_about_send_callback(&msg, ctx);
+
+	return true;
+
+fetch_about_perf_handler_aborted:
+	return false;
+}
+
 /** Handler to generate about:config page */
 static bool fetch_about_config_handler(struct fetch_about_context *ctx)
 {
@@ -420,6 +687,78 @@ fetch_about_choices_handler_aborted:
 	return false;
 }
 
+/** Generate the recorded performance trace as Chrome trace event JSON.
+ */
+static bool fetch_about_trace_handler(struct fetch_about_context *ctx)
+{
+	fetch_msg msg;
+	char buffer[1024];
+	int code = 200;
+	int slen;
+	unsigned int event_loop = 0;
+	int res = 0;
+
+	/* content is going to return ok */
+	fetch_set_http_code(ctx->fetchh, code);
+
+	/* content type */
+	if (fetch_about_send_header(ctx, "Content-Type: application/json"))
+		goto fetch_about_trace_handler_aborted;
+
+	msg.type = FETCH_DATA;
+	msg.data.header_or_data.buf = (const uint8_t *) buffer;
+
+	slen = snprintf(buffer, sizeof buffer, NSTRACE_JSON_HEADER);
+
+	do {
+		res = nstrace_snevent(buffer + slen,
+				      sizeof buffer - slen,
+				      event_loop);
+		if (res <= 0)
+			break; /* last event */
+
+		if (res >= (int) (sizeof buffer - slen)) {
+			if (slen == 0) {
+				/* entry can never fit in buffer, skip it */
+				event_loop++;
+				continue;
+			}
+			/* last entry would not fit in buffer, submit buffer */
+			msg.data.header_or_data.len = slen;
+			if (fetch_about_send_callback(&msg, ctx))
+				goto fetch_about_trace_handler_aborted;
+			slen = 0;
+		} else {
+			/* normal addition */
+			slen += res;
+			event_loop++;
+		}
+	} while (res > 0);
+
+	if (SLEN(NSTRACE_JSON_FOOTER) >= sizeof buffer - slen) {
+		/* footer would not fit in buffer, submit buffer */
+		msg.data.header_or_data.len = slen;
+		if (fetch_about_send_callback(&msg, ctx))
+			goto fetch_about_trace_handler_aborted;
+		slen = 0;
+	}
+
+	slen += snprintf(buffer + slen, sizeof buffer - slen,
+			 NSTRACE_JSON_FOOTER);
+
+	msg.data.header_or_data.len = slen;
+	if (fetch_about_send_callback(&msg, ctx))
+		goto fetch_about_trace_handler_aborted;
+
+	msg.type = FETCH_FINISHED;
+	fetch_about_send_callback(&msg, ctx);
+
+	return true;
+
+fetch_about_trace_handler_aborted:
+	return false;
+}
+
 /** Generate the text of an svn testament which represents the current
  * build-tree status
  */
@@ -608,6 +947,12 @@ struct about_handlers about_handler_list[] = {
 	/* details about the image cache */
 	{ "imagecache", SLEN("imagecache"), NULL,
 			fetch_about_imagecache_handler, true },
+	/* cache, fetch and scheduler statistics */
+	{ "perf", SLEN("perf"), NULL,
+			fetch_about_perf_handler, true },
+	/* recorded performance trace */
+	{ "trace", SLEN("trace"), NULL,
+			fetch_about_trace_handler, true },
 	/* The default blank page */
 	{ "blank", SLEN("blank"), NULL,
 			fetch_about_blank_handler, true }
@@ -127,6 +127,27 @@ static char fetch_error_buffer[CURL_ERROR_SIZE];
 /** Proxy authentication details. */
 static char fetch_proxy_userpwd[100];
 
+/** Sockets cURL wants to be told about when they become readable. */
+static fd_set fetch_curl_read_set;
+
+/** Sockets cURL wants to be told about when they become writable. */
+static fd_set fetch_curl_write_set;
+
+/** Highest socket in the cURL socket sets or -1 if there are none. */
+static int fetch_curl_maxfd = -1;
+
+/** Monotonic time in ms at which cURL wants its timeout action or -1. */
+static int64_t fetch_curl_deadline = -1;
+
+/** Number of cURL sockets which cannot be put in the socket sets. */
+static int fetch_curl_unwaitable;
+
+/** Marker assigned to cURL sockets which cannot be put in the socket sets. */
+static char fetch_curl_unwaitable_marker;
+
+/** Poll interval in ms while any cURL socket cannot be waited on. */
+#define FETCH_CURL_UNWAITABLE_POLL 10
+
 
 /* OpenSSL 1.0.x to 1.1.0 certificate reference counting changed
  * LibreSSL declares its OpenSSL version as 2.1 but only supports the old way
@@ -1133,14 +1154,43 @@ static void fetch_curl_done(CURL *curl_handle, CURLcode result)
 }
 
 
+/**
+ * Tell cURL about activity on one of its sockets or its timer expiring.
+ *
+ * \param fd The socket with activity or CURL_SOCKET_TIMEOUT.
+ * \param action The CURL_CSELECT_* bits describing the activity.
+ * \return CURLM_OK on success else the cURL multi error code.
+ */
+static CURLMcode fetch_curl_socket_action(curl_socket_t fd, int action)
+{
+	CURLMcode codem;
+	int running;
+
+	do {
+		codem = curl_multi_socket_action(fetch_curl_multi,
+						 fd, action, &running);
+	} while (codem == CURLM_CALL_MULTI_PERFORM);
+
+	if (codem != CURLM_OK) {
+		NSLOG(netsurf, INFO, "curl_multi_socket_action: %i %s",
+		      codem, curl_multi_strerror(codem));
+		guit->misc->warning("MiscError", curl_multi_strerror(codem));
+	}
+
+	return codem;
+}
+
+
 /**
  * Do some work on current fetches.
  *
- * Must be called regularly to make progress on fetches.
+ * Must be called regularly to make progress on fetches. Only the
+ * sockets which are ready, and the cURL timer once it has expired,
+ * are serviced so calling this when nothing has happened is cheap.
  */
 static void fetch_curl_poll(lwc_string *scheme_ignored)
 {
-	int running, queue;
+	int queue;
 	CURLMcode codem;
 	CURLMsg *curl_msg;
 
@@ -1183,16 +1233,71 @@ static void fetch_curl_poll(lwc_string *scheme_ignored)
 		}
 	}
 
-	/* do any possible work on the current fetches */
-	do {
-		codem = curl_multi_perform(fetch_curl_multi, &running);
-		if (codem != CURLM_OK && codem != CURLM_CALL_MULTI_PERFORM) {
+	/* only act on the sockets which are ready and on the timer if
+	 *  it has expired rather than making cURL walk every transfer
+	 */
+	if (fetch_curl_maxfd >= 0) {
+		fd_set read_fd_set = fetch_curl_read_set;
+		fd_set write_fd_set = fetch_curl_write_set;
+		struct timeval tv = { 0, 0 };
+		int max_fd = fetch_curl_maxfd;
+		int ready;
+		int fd;
+
+		ready = select(max_fd + 1, &read_fd_set, &write_fd_set,
+			       NULL, &tv);
+		for (fd = 0; (ready > 0) && (fd <= max_fd); fd++) {
+			int action = 0;
+
+			if (FD_ISSET(fd, &read_fd_set)) {
+				action |= CURL_CSELECT_IN;
+			}
+			if (FD_ISSET(fd, &write_fd_set)) {
+				action |= CURL_CSELECT_OUT;
+			}
+			if (action == 0) {
+				continue;
+			}
+			ready--;
+
+			codem = fetch_curl_socket_action(fd, action);
+			if (codem != CURLM_OK) {
+				return;
+			}
+		}
+	}
+
+	if (fetch_curl_deadline >= 0) {
+		uint64_t now_ms;
+
+		nsu_getmonotonic_ms(&now_ms);
+		if ((int64_t)now_ms >= fetch_curl_deadline) {
+			fetch_curl_deadline = -1;
+			codem = fetch_curl_socket_action(CURL_SOCKET_TIMEOUT, 0);
+			if (codem != CURLM_OK) {
+				return;
+			}
+		}
+	}
+
+	if (fetch_curl_unwaitable > 0) {
+		/* readiness of some sockets cannot be checked here so
+		 * let cURL service every transfer
+		 */
+		int running;
+
+		do {
+			codem = curl_multi_perform(fetch_curl_multi, &running);
+		} while (codem == CURLM_CALL_MULTI_PERFORM);
+
+		if (codem != CURLM_OK) {
 			NSLOG(netsurf, INFO, "curl_multi_perform: %i %s",
 			      codem, curl_multi_strerror(codem));
-			guit->misc->warning("MiscError", curl_multi_strerror(codem));
+			guit->misc->warning("MiscError",
+					    curl_multi_strerror(codem));
 			return;
 		}
-	} while (codem == CURLM_CALL_MULTI_PERFORM);
+	}
 
 	/* process curl results */
 	curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
@@ -1404,20 +1509,142 @@ fetch_curl_header(char *data, size_t size, size_t nmemb, void *_f)
 #undef SKIP_ST
 }
 
+/**
+ * cURL socket callback.
+ *
+ * Called by cURL whenever the set of events it wants to wait for on
+ * a socket changes. The socket sets handed out by the fdset
+ * operation are kept up to date from here.
+ */
+static int
+fetch_curl_socket_callback(CURL *easy,
+			   curl_socket_t fd,
+			   int what,
+			   void *userp,
+			   void *socketp)
+{
+	if ((fd < 0) || (fd >= FD_SETSIZE)) {
+		/* such sockets are serviced by every poll instead */
+		if ((what != CURL_POLL_REMOVE) && (socketp == NULL)) {
+			NSLOG(netsurf, INFO,
+			      "cURL socket %d cannot be waited on", fd);
+			if (curl_multi_assign(fetch_curl_multi, fd,
+					&fetch_curl_unwaitable_marker) ==
+			    CURLM_OK) {
+				fetch_curl_unwaitable++;
+			}
+		} else if ((what == CURL_POLL_REMOVE) &&
+			   (socketp == &fetch_curl_unwaitable_marker)) {
+			fetch_curl_unwaitable--;
+		}
+		return 0;
+	}
+
+	FD_CLR(fd, &fetch_curl_read_set);
+	FD_CLR(fd, &fetch_curl_write_set);
+
+	switch (what) {
+	case CURL_POLL_IN:
+		FD_SET(fd, &fetch_curl_read_set);
+		break;
+
+	case CURL_POLL_OUT:
+		FD_SET(fd, &fetch_curl_write_set);
+		break;
+
+	case CURL_POLL_INOUT:
+		FD_SET(fd, &fetch_curl_read_set);
+		FD_SET(fd, &fetch_curl_write_set);
+		break;
+
+	default:
+		/* CURL_POLL_REMOVE */
+		break;
+	}
+
+	if (what != CURL_POLL_REMOVE) {
+		if (fd > fetch_curl_maxfd) {
+			fetch_curl_maxfd = fd;
+		}
+	} else if (fd == fetch_curl_maxfd) {
+		/* find the new highest socket still in use */
+		while ((fetch_curl_maxfd >= 0) &&
+		       !FD_ISSET(fetch_curl_maxfd, &fetch_curl_read_set) &&
+		       !FD_ISSET(fetch_curl_maxfd, &fetch_curl_write_set)) {
+			fetch_curl_maxfd--;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * cURL timer callback.
+ *
+ * Called by cURL to set the time after which it wants to be called
+ * with CURL_SOCKET_TIMEOUT. A negative timeout removes the timer.
+ */
+static int
+fetch_curl_timer_callback(CURLM *multi, long timeout_ms, void *userp)
+{
+	uint64_t now_ms;
+
+	if (timeout_ms < 0) {
+		fetch_curl_deadline = -1;
+	} else {
+		nsu_getmonotonic_ms(&now_ms);
+		fetch_curl_deadline = (int64_t)now_ms + timeout_ms;
+	}
+
+	return 0;
+}
+
+
 static int fetch_curl_fdset(lwc_string *scheme, fd_set *read_set,
 			    fd_set *write_set, fd_set *error_set)
 {
-	CURLMcode code;
-	int maxfd = -1;
+	int fd;
 
-	code = curl_multi_fdset(fetch_curl_multi,
-				read_set,
-				write_set,
-				error_set,
-				&maxfd);
-	assert(code == CURLM_OK);
+	for (fd = 0; fd <= fetch_curl_maxfd; fd++) {
+		if (FD_ISSET(fd, &fetch_curl_read_set)) {
+			FD_SET(fd, read_set);
+		}
+		if (FD_ISSET(fd, &fetch_curl_write_set)) {
+			FD_SET(fd, write_set);
+		}
+	}
 
-	return maxfd;
+	return fetch_curl_maxfd;
+}
+
+
+static int fetch_curl_timeout(lwc_string *scheme)
+{
+	uint64_t now_ms;
+	int64_t timeout;
+
+	if (fetch_curl_deadline < 0) {
+		if (fetch_curl_unwaitable > 0) {
+			/* activity on these is only found by polling */
+			return FETCH_CURL_UNWAITABLE_POLL;
+		}
+		/* nothing to do until there is activity on a socket */
+		return -1;
+	}
+
+	nsu_getmonotonic_ms(&now_ms);
+	if ((int64_t)now_ms >= fetch_curl_deadline) {
+		return 0;
+	}
+
+	timeout = fetch_curl_deadline - (int64_t)now_ms;
+	if ((fetch_curl_unwaitable > 0) &&
+	    (timeout > FETCH_CURL_UNWAITABLE_POLL)) {
+		timeout = FETCH_CURL_UNWAITABLE_POLL;
+	}
+
+	return timeout;
 }
 
 
@@ -1438,6 +1665,7 @@ nserror fetch_curl_register(void)
 		.free = fetch_curl_free,
 		.poll = fetch_curl_poll,
 		.fdset = fetch_curl_fdset,
+		.timeout = fetch_curl_timeout,
 		.finalise = fetch_curl_finalise
 	};
 
@@ -1455,6 +1683,23 @@ nserror fetch_curl_register(void)
 		return NSERROR_INIT_FAILED;
 	}
 
+	/* track the sockets and timeout cURL is waiting on so the
+	 *  frontend can sleep until there is something to do
+	 */
+	FD_ZERO(&fetch_curl_read_set);
+	FD_ZERO(&fetch_curl_write_set);
+	fetch_curl_maxfd = -1;
+	fetch_curl_deadline = -1;
+	fetch_curl_unwaitable = 0;
+	if ((curl_multi_setopt(fetch_curl_multi, CURLMOPT_SOCKETFUNCTION,
+			       fetch_curl_socket_callback) != CURLM_OK) ||
+	    (curl_multi_setopt(fetch_curl_multi, CURLMOPT_TIMERFUNCTION,
+			       fetch_curl_timer_callback) != CURLM_OK)) {
+		NSLOG(netsurf, INFO, "curl multi socket interface unavailable.");
+		curl_multi_cleanup(fetch_curl_multi);
+		return NSERROR_INIT_FAILED;
+	}
+
 #if LIBCURL_VERSION_NUM >= 0x071e00
 	/* built against 7.30.0 or later: configure caching */
 	{
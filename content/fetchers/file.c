@@ -266,6 +266,7 @@ static void fetch_file_process_plain(struct fetch_file_context *ctx,
 	fetch_msg msg;
 	char *buf = NULL;
 	size_t buf_size;
+	struct stat mapstat;
 
 	int fd; /**< The file descriptor of the object */
 
@@ -290,7 +291,7 @@ static void fetch_file_process_plain(struct fetch_file_context *ctx,
 
 	/* allocate the buffer storage */
 	if (buf_size > 0) {
-		buf = mmap(NULL, buf_size, PROT_READ, MAP_SHARED, fd, 0);
+		buf = mmap(NULL, buf_size, PROT_READ, MAP_PRIVATE, fd, 0);
 		if (buf == MAP_FAILED) {
 			msg.type = FETCH_ERROR;
 			msg.data.error = "Unable to map memory for file data buffer";
@@ -326,9 +327,21 @@ static void fetch_file_process_plain(struct fetch_file_context *ctx,
 		goto fetch_file_process_aborted;
 	}
 
+	/* The mapping is only used for the duration of the fetch and
+	 * the receiver copies the data. A mapping which outlived the
+	 * fetch would see later changes to the file and fault if the
+	 * file was truncated. Pages past the current end of file
+	 * cannot be read so only send data which is still present.
+	 */
+	if ((buf != NULL) &&
+	    (fstat(fd, &mapstat) == 0) &&
+	    ((size_t)mapstat.st_size < buf_size)) {
+		msg.data.header_or_data.len = mapstat.st_size;
+	} else {
+		msg.data.header_or_data.len = buf_size;
+	}
 	msg.type = FETCH_DATA;
 	msg.data.header_or_data.buf = (const uint8_t *) buf;
-	msg.data.header_or_data.len = buf_size;
 	fetch_file_send_callback(&msg, ctx);
 
 	if (ctx->aborted == false) {
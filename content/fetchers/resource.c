@@ -195,9 +195,12 @@ static bool fetch_resource_data_handler(struct fetch_resource_context *ctx)
 	}
 
 
-	msg.type = FETCH_DATA;
-	msg.data.header_or_data.buf = (const uint8_t *) ctx->entry->data;
-	msg.data.header_or_data.len = ctx->entry->data_len;
+	/* direct data outlives the fetch so is used without a copy */
+	msg.type = FETCH_DATA_ADOPT;
+	msg.data.adopt.buf = (uint8_t *) ctx->entry->data;
+	msg.data.adopt.len = ctx->entry->data_len;
+	msg.data.adopt.release = NULL;
+	msg.data.adopt.pw = NULL;
 	fetch_resource_send_callback(&msg, ctx);
 
 	if (ctx->aborted == false) {
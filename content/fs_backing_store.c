@@ -25,7 +25,12 @@
  * \todo Consider improving eviction sorting to include objects size
  *         and remaining lifetime and other cost metrics.
  *
- * \todo Implement mmap retrieval where supported.
+ * Where mmap is available data elements are retrieved as read only
+ * mappings of the backing files so repeat hits are served from the page
+ * cache without copying.
+ *
+ * When built with thread support writes are performed by a worker
+ * thread so element data is persisted without blocking the browser.
  *
  * \todo Implement static retrieval for metadata objects as their heap
  *         lifetime is typically very short, though this may be obsoleted
@@ -33,6 +38,8 @@
  *
  */
 
+#include "utils/config.h"
+
 #include <unistd.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -42,6 +49,13 @@
 #include <time.h>
 #include <stdlib.h>
 #include <nsutils/unistd.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#include <nsutils/time.h>
+#endif
 
 #include "netsurf/inttypes.h"
 #include "utils/filepath.h"
@@ -99,6 +113,12 @@
 /** length in bytes of a block files use map */
 #define BLOCK_USE_MAP_SIZE (1 << (BLOCK_ENTRY_COUNT - 3))
 
+/** Number of bytes which may be queued for the writer before store blocks */
+#define WRITER_QUEUE_LIMIT (8 * 1024 * 1024)
+
+/** Number of milliseconds between checks for completed writes */
+#define WRITER_REAP_TIME 10
+
 /**
  * The type used to store index values referring to store entries. Care
  * must be taken with this type as it is used to build address to
@@ -210,6 +230,54 @@ static const unsigned int log2_block_size[ENTRY_ELEM_COUNT] = {
 	BLOCK_META_SIZE  /**< Metadata block size */
 };
 
+#ifdef WITH_PTHREAD
+/**
+ * An element write waiting for or completed by the writer thread.
+ *
+ * The job holds a reference to the element allocation so neither the
+ * data nor the entry can be released until the write is reaped.
+ */
+struct store_write_job {
+	struct store_write_job *next; /**< next job in queue */
+
+	entry_ident_t ident; /**< identifier of entry being written */
+	int elem_idx; /**< element index within the entry */
+
+	uint8_t *data; /**< element data to write */
+	uint32_t size; /**< size of element data */
+
+	int fd; /**< file descriptor to write to */
+	off_t offset; /**< offset within block file, -1 for separate file */
+
+	ssize_t written; /**< bytes written by the writer thread */
+	uint64_t elapsed; /**< time taken by the write in ms */
+};
+
+/**
+ * Asynchronous writer thread state.
+ */
+struct store_writer {
+	pthread_t thread; /**< the writer thread */
+	pthread_mutex_t lock; /**< protects the job queues */
+	pthread_cond_t cond; /**< signalled on job queue or complete */
+
+	bool running; /**< writer thread has been started */
+	bool quit; /**< writer thread has been asked to exit */
+
+	struct store_write_job *pending; /**< jobs awaiting writing */
+	struct store_write_job *pending_tail; /**< last job awaiting writing */
+	struct store_write_job *complete; /**< jobs awaiting reaping */
+
+	size_t queued_size; /**< bytes awaiting writing */
+	unsigned int outstanding; /**< jobs not yet reaped */
+
+	uint64_t write_count; /**< number of writes completed */
+	uint64_t write_size; /**< bytes written */
+	uint64_t write_elapsed; /**< total ms spent writing in the thread */
+	uint64_t queue_elapsed; /**< total ms the browser waited on the queue */
+};
+#endif
+
 /**
  * Parameters controlling the backing store.
  */
@@ -262,7 +330,15 @@ struct store_state {
 	size_t hit_count; /**< number of cache hits */
 	uint64_t hit_size; /**< size of storage served */
 	size_t miss_count; /**< number of cache misses */
+	size_t map_count; /**< number of hits served by mapping */
 
+	unsigned int evict_count; /**< number of evictions */
+	/** ring of the most recent evictions */
+	struct llcache_store_evict evict[LLCACHE_STORE_EVICT_HISTORY];
+
+#ifdef WITH_PTHREAD
+	struct store_writer writer; /**< asynchronous writer */
+#endif
 };
 
 /**
@@ -612,6 +688,8 @@ static nserror store_evict(struct store_state *state)
 	unsigned int ent;
 	unsigned int ent_count;
 	size_t removed; /* size of removed entries */
+	unsigned int removed_count; /* number of removed entries */
+	struct llcache_store_evict *evict;
 	nserror ret = NSERROR_OK;
 
 	/* check if the cache has exceeded configured limit */
@@ -641,6 +719,7 @@ static nserror store_evict(struct store_state *state)
 
 	/* evict entries in listed order */
 	removed = 0;
+	removed_count = 0;
 	for (ent = 0; ent < ent_count; ent++) {
 		struct store_entry *bse;
 
@@ -653,6 +732,7 @@ static nserror store_evict(struct store_state *state)
 		if (ret != NSERROR_OK) {
 			break;
 		}
+		removed_count++;
 
 		if (removed > state->hysteresis) {
 			break;
@@ -664,6 +744,13 @@ static nserror store_evict(struct store_state *state)
 	NSLOG(netsurf, INFO, "removed %"PRIsizet" in %d entries", removed,
 	      ent);
 
+	/* record the eviction */
+	evict = &state->evict[state->evict_count % LLCACHE_STORE_EVICT_HISTORY];
+	evict->time = time(NULL);
+	evict->entries = removed_count;
+	evict->size = removed;
+	state->evict_count++;
+
 	return ret;
 }
 
@@ -1474,6 +1561,406 @@ control_error: /* problem with the control file */
 }
 
 
+#ifdef HAVE_MMAP
+/**
+ * Offset of an address or file position within its page.
+ *
+ * \param pos The address or file offset.
+ * \return The offset from the start of the page.
+ */
+static inline size_t store_page_offset(uintptr_t pos)
+{
+	return pos & ((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+}
+#endif
+
+/**
+ * release any allocation for an entry
+ */
+static nserror entry_release_alloc(struct store_entry_element *elem)
+{
+	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
+		elem->ref--;
+		if (elem->ref == 0) {
+			NSLOG(netsurf, INFO, "freeing %p", elem->data);
+			free(elem->data);
+			elem->flags &= ~ENTRY_ELEM_FLAG_HEAP;
+		}
+	}
+#ifdef HAVE_MMAP
+	if ((elem->flags & ENTRY_ELEM_FLAG_MMAP) != 0) {
+		elem->ref--;
+		if (elem->ref == 0) {
+			size_t pgoff = store_page_offset((uintptr_t)elem->data);
+
+			NSLOG(netsurf, INFO, "unmapping %p", elem->data);
+			munmap(elem->data - pgoff, elem->size + pgoff);
+			elem->flags &= ~ENTRY_ELEM_FLAG_MMAP;
+		}
+	}
+#endif
+	return NSERROR_OK;
+}
+
+
+/**
+ * Ensure the block file for an element is open.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry being accessed.
+ * \param elem_idx The element index within the entry.
+ * \param offset_out Updated with the elements offset in the block file.
+ * \return NSERROR_OK on success or error code.
+ */
+static nserror store_block_open(struct store_state *state,
+				struct store_entry *bse,
+				int elem_idx,
+				off_t *offset_out)
+{
+	block_index_t bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
+		((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
+	block_index_t bi = bse->elem[elem_idx].block & ((1U << BLOCK_ENTRY_COUNT) -1); /* block index in file */
+
+	/* ensure the block file fd is good */
+	if (state->blocks[elem_idx][bf].fd == -1) {
+		state->blocks[elem_idx][bf].fd = store_open(state, bf,
+				elem_idx + ENTRY_ELEM_COUNT, O_CREAT | O_RDWR);
+		if (state->blocks[elem_idx][bf].fd == -1) {
+			NSLOG(netsurf, INFO, "Open failed errno %d", errno);
+			return NSERROR_SAVE_FAILED;
+		}
+
+		/* flag that a block file has been opened */
+		state->blocks_opened = true;
+	}
+
+	*offset_out = (unsigned int)bi << log2_block_size[elem_idx];
+
+	return NSERROR_OK;
+}
+
+
+#ifdef WITH_PTHREAD
+/**
+ * Perform the write for a job.
+ *
+ * This is called on the writer thread and must not touch any store
+ * state other than that held in the job.
+ *
+ * \param job The job to perform the write for.
+ */
+static void store_writer_write(struct store_write_job *job)
+{
+	ssize_t wr;
+	size_t tot = 0;
+
+	if (job->offset != -1) {
+		/* small block storage */
+		job->written = nsu_pwrite(job->fd,
+					  job->data,
+					  job->size,
+					  job->offset);
+		return;
+	}
+
+	/* separate file in backing store */
+	while (tot < job->size) {
+		wr = write(job->fd, job->data + tot, job->size - tot);
+		if (wr <= 0) {
+			break;
+		}
+		tot += wr;
+	}
+	close(job->fd);
+
+	job->written = tot;
+}
+
+
+/**
+ * Writer thread main loop.
+ *
+ * Jobs are taken from the pending queue in order, written and placed on
+ * the complete list for reaping by the browser thread. The thread exits
+ * when asked to quit once the pending queue is empty.
+ *
+ * \param arg The writer state.
+ * \return NULL
+ */
+static void *store_writer_thread(void *arg)
+{
+	struct store_writer *writer = arg;
+	struct store_write_job *job;
+	uint64_t start;
+	uint64_t end;
+
+	pthread_mutex_lock(&writer->lock);
+	for (;;) {
+		while ((writer->pending == NULL) && (writer->quit == false)) {
+			pthread_cond_wait(&writer->cond, &writer->lock);
+		}
+
+		job = writer->pending;
+		if (job == NULL) {
+			/* asked to quit with nothing left to write */
+			break;
+		}
+		writer->pending = job->next;
+		if (writer->pending == NULL) {
+			writer->pending_tail = NULL;
+		}
+		pthread_mutex_unlock(&writer->lock);
+
+		nsu_getmonotonic_ms(&start);
+		store_writer_write(job);
+		nsu_getmonotonic_ms(&end);
+		job->elapsed = end - start;
+
+		pthread_mutex_lock(&writer->lock);
+		writer->queued_size -= job->size;
+		job->next = writer->complete;
+		writer->complete = job;
+
+		/* wake anything waiting for the queue to drain */
+		pthread_cond_broadcast(&writer->cond);
+	}
+	pthread_mutex_unlock(&writer->lock);
+
+	return NULL;
+}
+
+
+/**
+ * Reap writes completed by the writer thread.
+ *
+ * Releases the reference each job holds on its element allocation and
+ * invalidates entries whose write failed. Reschedules itself while
+ * there are writes outstanding.
+ *
+ * \param s The store state.
+ */
+static void store_writer_reap(void *s)
+{
+	struct store_state *state = s;
+	struct store_writer *writer = &state->writer;
+	struct store_write_job *job;
+	struct store_write_job *next;
+	struct store_entry *bse;
+	entry_index_t sei;
+
+	pthread_mutex_lock(&writer->lock);
+	job = writer->complete;
+	writer->complete = NULL;
+	pthread_mutex_unlock(&writer->lock);
+
+	while (job != NULL) {
+		next = job->next;
+
+		sei = BS_ENTRY_INDEX(job->ident, state);
+		bse = &state->entries[sei];
+
+		if ((sei == 0) || (bse->ident != job->ident)) {
+			/* the job reference should prevent this */
+			NSLOG(netsurf, ERROR,
+			      "completed write for missing entry %x",
+			      job->ident);
+		} else {
+			if (job->written != (ssize_t)job->size) {
+				NSLOG(netsurf, INFO,
+				      "Write failed %"PRIssizet" of %d bytes from %p",
+				      job->written,
+				      job->size,
+				      job->data);
+				bse->flags |= ENTRY_FLAGS_INVALID;
+			} else {
+				NSLOG(netsurf, DEBUG,
+				      "Wrote %"PRIssizet" bytes from %p in %"PRIu64"ms",
+				      job->written,
+				      job->data,
+				      job->elapsed);
+				writer->write_count++;
+				writer->write_size += job->written;
+				writer->write_elapsed += job->elapsed;
+			}
+
+			entry_release_alloc(&bse->elem[job->elem_idx]);
+
+			if ((bse->flags & ENTRY_FLAGS_INVALID) != 0) {
+				invalidate_entry(state, bse);
+			}
+		}
+
+		writer->outstanding--;
+		free(job);
+		job = next;
+	}
+
+	if (writer->outstanding > 0) {
+		guit->misc->schedule(WRITER_REAP_TIME, store_writer_reap, state);
+	}
+}
+
+
+/**
+ * Queue an element of an entry to be written by the writer thread.
+ *
+ * The destination file is opened on the browser thread so the
+ * directory structure and block file descriptors are only ever
+ * manipulated there. The call blocks only if the volume of queued data
+ * exceeds WRITER_QUEUE_LIMIT.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to store
+ * \param elem_idx The element index within the entry.
+ * \return NSERROR_OK on success or error code.
+ */
+static nserror store_writer_queue(struct store_state *state,
+				  struct store_entry *bse,
+				  int elem_idx)
+{
+	struct store_writer *writer = &state->writer;
+	struct store_entry_element *elem = &bse->elem[elem_idx];
+	struct store_write_job *job;
+	block_index_t bf;
+	uint64_t start;
+	uint64_t end;
+	nserror ret;
+
+	job = calloc(1, sizeof(struct store_write_job));
+	if (job == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	job->ident = bse->ident;
+	job->elem_idx = elem_idx;
+	job->data = elem->data;
+	job->size = elem->size;
+
+	if (elem->block != 0) {
+		/* small block storage */
+		ret = store_block_open(state, bse, elem_idx, &job->offset);
+		if (ret != NSERROR_OK) {
+			free(job);
+			return ret;
+		}
+		bf = (elem->block >> BLOCK_ENTRY_COUNT) &
+			((1 << BLOCK_FILE_COUNT) - 1);
+		job->fd = state->blocks[elem_idx][bf].fd;
+	} else {
+		/* separate file in backing store */
+		job->fd = store_open(state, bse->ident, elem_idx,
+				     O_CREAT | O_WRONLY);
+		if (job->fd < 0) {
+			NSLOG(netsurf, INFO, "Open failed %d errno %d",
+			      job->fd, errno);
+			free(job);
+			return NSERROR_SAVE_FAILED;
+		}
+		job->offset = -1;
+	}
+
+	/* the job holds a reference to the allocation until reaped */
+	elem->ref++;
+
+	pthread_mutex_lock(&writer->lock);
+
+	nsu_getmonotonic_ms(&start);
+	while (writer->queued_size > WRITER_QUEUE_LIMIT) {
+		pthread_cond_wait(&writer->cond, &writer->lock);
+	}
+	nsu_getmonotonic_ms(&end);
+	writer->queue_elapsed += end - start;
+
+	if (writer->pending_tail == NULL) {
+		writer->pending = job;
+	} else {
+		writer->pending_tail->next = job;
+	}
+	writer->pending_tail = job;
+	writer->queued_size += job->size;
+
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+
+	writer->outstanding++;
+	if (writer->outstanding == 1) {
+		guit->misc->schedule(WRITER_REAP_TIME, store_writer_reap, state);
+	}
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Start the writer thread.
+ *
+ * \param state The backing store state to use.
+ * \return NSERROR_OK on success or error code.
+ */
+static nserror store_writer_start(struct store_state *state)
+{
+	struct store_writer *writer = &state->writer;
+
+	if (pthread_mutex_init(&writer->lock, NULL) != 0) {
+		return NSERROR_INIT_FAILED;
+	}
+
+	if (pthread_cond_init(&writer->cond, NULL) != 0) {
+		pthread_mutex_destroy(&writer->lock);
+		return NSERROR_INIT_FAILED;
+	}
+
+	if (pthread_create(&writer->thread, NULL,
+			   store_writer_thread, writer) != 0) {
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->lock);
+		return NSERROR_INIT_FAILED;
+	}
+
+	writer->running = true;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Stop the writer thread.
+ *
+ * All queued writes are completed and reaped before returning.
+ *
+ * \param state The backing store state to use.
+ */
+static void store_writer_stop(struct store_state *state)
+{
+	struct store_writer *writer = &state->writer;
+
+	if (writer->running == false) {
+		return;
+	}
+
+	pthread_mutex_lock(&writer->lock);
+	writer->quit = true;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+
+	pthread_join(writer->thread, NULL);
+	writer->running = false;
+
+	guit->misc->schedule(-1, store_writer_reap, state);
+	store_writer_reap(state);
+
+	pthread_cond_destroy(&writer->cond);
+	pthread_mutex_destroy(&writer->lock);
+
+	NSLOG(netsurf, INFO,
+	      "Writer wrote %"PRIu64" bytes in %"PRIu64" writes taking %"PRIu64"ms, %"PRIu64"ms waiting on queue",
+	      writer->write_size,
+	      writer->write_count,
+	      writer->write_elapsed,
+	      writer->queue_elapsed);
+}
+#endif
+
 
 
 /* Functions exported in the backing store table */
@@ -1580,6 +2067,12 @@ initialise(const struct llcache_store_parameters *parameters)
 
 	storestate = newstate;
 
+#ifdef WITH_PTHREAD
+	if (store_writer_start(newstate) != NSERROR_OK) {
+		NSLOG(netsurf, INFO, "Writer thread failed, writing synchronously");
+	}
+#endif
+
 	NSLOG(netsurf, INFO, "FS backing store init successful");
 
 	NSLOG(netsurf, INFO,
@@ -1611,6 +2104,10 @@ finalise(void)
 	unsigned int op_count;
 
 	if (storestate != NULL) {
+#ifdef WITH_PTHREAD
+		/* complete outstanding writes before closing block files */
+		store_writer_stop(storestate);
+#endif
 		guit->misc->schedule(-1, control_maintinance, storestate);
 		write_entries(storestate);
 		write_blocks(storestate);
@@ -1638,6 +2135,8 @@ finalise(void)
 			      (storestate->hit_count * 100) / op_count,
 			      (storestate->miss_count * 100) / op_count,
 			      0);
+			NSLOG(netsurf, INFO, "Cache hits served by mapping %"PRIsizet,
+			      storestate->map_count);
 		}
 
 		free(storestate->path);
@@ -1662,25 +2161,15 @@ static nserror store_write_block(struct store_state *state,
 {
 	block_index_t bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
 		((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
-	block_index_t bi = bse->elem[elem_idx].block & ((1U << BLOCK_ENTRY_COUNT) -1); /* block index in file */
 	ssize_t wr;
 	off_t offst;
+	nserror ret;
 
-	/* ensure the block file fd is good */
-	if (state->blocks[elem_idx][bf].fd == -1) {
-		state->blocks[elem_idx][bf].fd = store_open(state, bf,
-				elem_idx + ENTRY_ELEM_COUNT, O_CREAT | O_RDWR);
-		if (state->blocks[elem_idx][bf].fd == -1) {
-			NSLOG(netsurf, INFO, "Open failed errno %d", errno);
-			return NSERROR_SAVE_FAILED;
-		}
-
-		/* flag that a block file has been opened */
-		state->blocks_opened = true;
+	ret = store_block_open(state, bse, elem_idx, &offst);
+	if (ret != NSERROR_OK) {
+		return ret;
 	}
 
-	offst = (unsigned int)bi << log2_block_size[elem_idx];
-
 	wr = nsu_pwrite(state->blocks[elem_idx][bf].fd,
 		    bse->elem[elem_idx].data,
 		    bse->elem[elem_idx].size,
@@ -1790,6 +2279,13 @@ store(nsurl *url,
 		return ret;
 	}
 
+#ifdef WITH_PTHREAD
+	if (storestate->writer.running) {
+		/* write on the writer thread */
+		return store_writer_queue(storestate, bse, elem_idx);
+	}
+#endif
+
 	if (bse->elem[elem_idx].block != 0) {
 		/* small block storage */
 		ret = store_write_block(storestate, bse, elem_idx);
@@ -1801,22 +2297,6 @@ store(nsurl *url,
 	return ret;
 }
 
-/**
- * release any allocation for an entry
- */
-static nserror entry_release_alloc(struct store_entry_element *elem)
-{
-	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
-		elem->ref--;
-		if (elem->ref == 0) {
-			NSLOG(netsurf, INFO, "freeing %p", elem->data);
-			free(elem->data);
-			elem->flags &= ~ENTRY_ELEM_FLAG_HEAP;
-		}
-	}
-	return NSERROR_OK;
-}
-
 
 /**
  * Read an element of an entry from a small block file in the backing storage.
@@ -1923,6 +2403,87 @@ static nserror store_read_file(struct store_state *state,
 	return ret;
 }
 
+#ifdef HAVE_MMAP
+/**
+ * Map an element of an entry from the backing storage.
+ *
+ * The element is mapped read only directly from its block file or
+ * individual file. As mappings must start on a page boundary the
+ * mapping may begin before the element within a block file.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to map.
+ * \param elem_idx The element index within the entry.
+ * \return NSERROR_OK on success or error code.
+ */
+static nserror store_map_element(struct store_state *state,
+				 struct store_entry *bse,
+				 int elem_idx)
+{
+	struct store_entry_element *elem = &bse->elem[elem_idx];
+	block_index_t bf;
+	struct stat sb;
+	off_t offst = 0;
+	size_t pgoff = 0;
+	uint8_t *map;
+	int fd;
+	nserror ret;
+
+	if (elem->size == 0) {
+		return NSERROR_NOT_FOUND;
+	}
+
+	if (elem->block != 0) {
+		ret = store_block_open(state, bse, elem_idx, &offst);
+		if (ret != NSERROR_OK) {
+			return ret;
+		}
+		bf = (elem->block >> BLOCK_ENTRY_COUNT) &
+			((1 << BLOCK_FILE_COUNT) - 1);
+		fd = state->blocks[elem_idx][bf].fd;
+	} else {
+		fd = store_open(state, bse->ident, elem_idx, O_RDONLY);
+		if (fd < 0) {
+			NSLOG(netsurf, INFO, "Open failed %d errno %d",
+			      fd, errno);
+			return NSERROR_NOT_FOUND;
+		}
+	}
+
+	/* accessing a mapping beyond the end of the file faults */
+	if ((fstat(fd, &sb) != 0) ||
+	    (sb.st_size < (offst + (off_t)elem->size))) {
+		NSLOG(netsurf, INFO, "backing file too short to map");
+		map = MAP_FAILED;
+	} else {
+		pgoff = store_page_offset(offst);
+		map = mmap(NULL, elem->size + pgoff, PROT_READ, MAP_SHARED,
+			   fd, offst - pgoff);
+	}
+
+	if (elem->block == 0) {
+		/* the mapping remains valid once the file is closed */
+		close(fd);
+	}
+
+	if (map == MAP_FAILED) {
+		NSLOG(netsurf, INFO, "Map failed errno %d", errno);
+		return NSERROR_NOT_FOUND;
+	}
+
+	elem->data = map + pgoff;
+	elem->flags |= ENTRY_ELEM_FLAG_MMAP;
+	elem->ref = 1;
+
+	state->map_count++;
+
+	NSLOG(netsurf, INFO, "Mapped %d bytes at %p from 0x%jx",
+	      elem->size, elem->data, (uintmax_t)offst);
+
+	return NSERROR_OK;
+}
+#endif
+
 /**
  * Retrieve an object from the backing store.
  *
@@ -1969,7 +2530,7 @@ fetch(nsurl *url,
 	elem = &bse->elem[elem_idx];
 
 	/* if an allocation already exists return it */
-	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
+	if ((elem->flags & (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0) {
 		/* use the existing allocation and bump the ref count. */
 		elem->ref++;
 
@@ -1977,6 +2538,13 @@ fetch(nsurl *url,
 		      "Using existing entry (%p) allocation %p refs:%d", bse,
 		      elem->data, elem->ref);
 
+#ifdef HAVE_MMAP
+	} else if ((elem_idx == ENTRY_ELEM_DATA) &&
+		   (store_map_element(storestate, bse, elem_idx) == NSERROR_OK)) {
+		/* data element mapped from backing file. Metadata is
+		 * small and short lived so is not worth mapping.
+		 */
+#endif
 	} else {
 		/* allocate from the heap */
 		elem->data = malloc(elem->size);
@@ -2090,6 +2658,72 @@ invalidate(nsurl *url)
 }
 
 
+/**
+ * Get statistics of the backing store.
+ *
+ * @param[out] stats The statistics to fill in.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror stats(struct llcache_store_stats *stats)
+{
+	unsigned int blocks[ENTRY_ELEM_COUNT];
+	unsigned int elem_idx;
+	unsigned int bf;
+	unsigned int idx;
+	unsigned int evict_idx;
+
+	/* check backing store is initialised */
+	if (storestate == NULL) {
+		return NSERROR_INIT_FAILED;
+	}
+
+	/* count the small blocks in use */
+	for (elem_idx = 0; elem_idx < ENTRY_ELEM_COUNT; elem_idx++) {
+		blocks[elem_idx] = 0;
+		for (bf = 0; bf < BLOCK_FILE_COUNT; bf++) {
+			uint8_t *map = &storestate->blocks[elem_idx][bf].use_map[0];
+
+			for (idx = 0; idx < BLOCK_USE_MAP_SIZE; idx++) {
+				uint8_t used = map[idx];
+
+				while (used != 0) {
+					blocks[elem_idx]++;
+					used &= used - 1;
+				}
+			}
+		}
+	}
+
+	stats->limit = storestate->limit;
+	stats->size = storestate->total_alloc;
+
+	/* entry 0 is the empty sentinel */
+	stats->entries = storestate->last_entry - 1;
+	stats->entry_limit = (1U << storestate->entry_bits) - 1;
+
+	stats->data_blocks = blocks[ENTRY_ELEM_DATA];
+	stats->meta_blocks = blocks[ENTRY_ELEM_META];
+	stats->block_limit = BLOCK_FILE_COUNT * BLOCK_USE_MAP_SIZE * 8;
+
+	stats->hit_count = storestate->hit_count;
+	stats->hit_size = storestate->hit_size;
+	stats->miss_count = storestate->miss_count;
+
+	stats->evict_count = storestate->evict_count;
+	for (idx = 0; idx < LLCACHE_STORE_EVICT_HISTORY; idx++) {
+		if (idx < storestate->evict_count) {
+			evict_idx = (storestate->evict_count - 1 - idx) %
+				LLCACHE_STORE_EVICT_HISTORY;
+			stats->evict[idx] = storestate->evict[evict_idx];
+		} else {
+			memset(&stats->evict[idx], 0, sizeof(stats->evict[idx]));
+		}
+	}
+
+	return NSERROR_OK;
+}
+
+
 static struct gui_llcache_table llcache_table = {
 	.initialise = initialise,
 	.finalise = finalise,
@@ -2097,6 +2731,7 @@ static struct gui_llcache_table llcache_table = {
 	.fetch = fetch,
 	.invalidate = invalidate,
 	.release = release,
+	.stats = stats,
 };
 
 struct gui_llcache_table *filesystem_llcache_table = &llcache_table;
@@ -17,6 +17,7 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
@@ -24,6 +25,7 @@
 #include "utils/corestrings.h"
 #include "utils/log.h"
 #include "utils/nsurl.h"
+#include "utils/trace.h"
 #include "netsurf/plot_style.h"
 #include "netsurf/url_db.h"
 #include "desktop/system_colour.h"
@@ -95,6 +97,88 @@ static css_error nscss_compute_font_size(void *pw, const css_hint *parent,
 		css_hint *size);
 
 
+/** Number of recent selection results considered for sharing */
+#define NSCSS_SHARE_CACHE_SIZE 32
+
+/** Number of buckets in the table of shared selection results */
+#define NSCSS_SHARE_HASH_SIZE 256
+
+/** Reference count of a selection result shared between elements */
+struct nscss_share_ref {
+	css_select_results *results;	/**< Shared results */
+	unsigned int count;		/**< Number of holders */
+	struct nscss_share_ref *next;	/**< Next in hash chain */
+};
+
+/** Recently composed selection result, and what it was composed from */
+struct nscss_share_entry {
+	/** Parent style the result was composed with */
+	const css_computed_style *parent;
+	/** Partial styles from libcss; owned by the entry */
+	css_computed_style *partial[CSS_PSEUDO_ELEMENT_COUNT];
+	/** Composed result; the entry holds a reference */
+	css_select_results *results;
+};
+
+/**
+ * Style sharing state.
+ *
+ * libcss shares and interns partial styles, so elements with identical
+ * cascades get the same partial style objects.  Composing those with the
+ * same parent style gives identical results, so rather than compose and
+ * allocate again, the earlier results are shared, with a reference count
+ * kept here.  Cache entries own their partial styles, so that the
+ * pointers used as keys cannot be reused while they are cached.
+ */
+static struct {
+	struct nscss_share_entry entry[NSCSS_SHARE_CACHE_SIZE];
+	unsigned int victim;		/**< Next entry to replace */
+	struct nscss_share_ref *refs[NSCSS_SHARE_HASH_SIZE];
+	unsigned int selected;		/**< Selections since last flush */
+	unsigned int shared;		/**< Of which were shared */
+} nscss_share;
+
+/** Number of names remembered for generic sibling lookups */
+#define NSCSS_SIBLING_NAMED_SIZE 4
+
+/** Number of siblings searched for the previous count of following ones */
+#define NSCSS_SIBLING_AFTER_LIMIT 8
+
+/** Result of a previous sibling count */
+struct nscss_sibling_count {
+	dom_node *node;		/**< Node counted, or NULL; referenced */
+	int32_t count;		/**< Number of matching siblings */
+};
+
+/** Result of a previous generic sibling lookup */
+struct nscss_sibling_named {
+	dom_node *node;		/**< Node searched from, or NULL; referenced */
+	lwc_string *name;	/**< Name searched for; referenced */
+	dom_node *sibling;	/**< Match found, or NULL; referenced */
+};
+
+/**
+ * Sibling memo.
+ *
+ * Elements are selected in document order, so the previous query of a
+ * given kind was usually made for the preceding element sibling.  The
+ * previous answers are kept here, and a sibling walk that reaches the
+ * node they were made for stops and continues from that answer, making
+ * :nth-child() style and generic sibling selectors linear in the number
+ * of siblings rather than quadratic.
+ *
+ * The node data storage available through set_libcss_node_data belongs
+ * to libcss, so the memo lives here instead.  It holds references to the
+ * nodes concerned, and must be emptied with
+ * nscss_select_sibling_cache_invalidate when the document changes.
+ */
+static struct {
+	/** Counts, indexed by same_name and after */
+	struct nscss_sibling_count count[2][2];
+	struct nscss_sibling_named named[NSCSS_SIBLING_NAMED_SIZE];
+	unsigned int victim;	/**< Next named entry to replace */
+} nscss_sibling;
+
 /**
  * Selection callback table for libcss
  */
@@ -244,6 +328,298 @@ static void nscss_dom_user_data_handler(dom_node_operation operation,
 	}
 }
 
+/**
+ * Find the reference count record for a selection result
+ *
+ * \param results  Selection results to look up
+ * \param prev     Updated to point at link to the record
+ * \return Record, or NULL if the results are not shared
+ */
+static struct nscss_share_ref *nscss_share_ref_find(
+		css_select_results *results, struct nscss_share_ref ***prev)
+{
+	struct nscss_share_ref **link;
+	uintptr_t hash = (uintptr_t) results;
+
+	hash = (hash >> 4) ^ (hash >> 12);
+	link = &nscss_share.refs[hash % NSCSS_SHARE_HASH_SIZE];
+
+	while (*link != NULL && (*link)->results != results)
+		link = &(*link)->next;
+
+	*prev = link;
+	return *link;
+}
+
+/**
+ * Take a reference to a selection result
+ *
+ * \param results  Selection results to reference
+ * \return true on success, false on memory exhaustion
+ */
+static bool nscss_share_ref(css_select_results *results)
+{
+	struct nscss_share_ref **link;
+	struct nscss_share_ref *ref;
+
+	ref = nscss_share_ref_find(results, &link);
+	if (ref != NULL) {
+		ref->count++;
+		return true;
+	}
+
+	ref = malloc(sizeof(*ref));
+	if (ref == NULL)
+		return false;
+
+	/* One for the existing holder, one for the new one */
+	ref->results = results;
+	ref->count = 2;
+	ref->next = NULL;
+	*link = ref;
+
+	return true;
+}
+
+/**
+ * Drop a reference to a selection result, destroying it if unshared
+ *
+ * \param results  Selection results to release
+ * \return true if the results were destroyed
+ */
+static bool nscss_share_unref(css_select_results *results)
+{
+	struct nscss_share_ref **link;
+	struct nscss_share_ref *ref;
+
+	ref = nscss_share_ref_find(results, &link);
+	if (ref != NULL) {
+		if (--ref->count > 0)
+			return false;
+		*link = ref->next;
+		free(ref);
+	}
+
+	css_select_results_destroy(results);
+
+	return true;
+}
+
+static void nscss_share_release_children(const css_select_results *results);
+
+/**
+ * Release a style sharing cache entry
+ *
+ * \param entry  Entry to release
+ */
+static void nscss_share_entry_release(struct nscss_share_entry *entry)
+{
+	css_select_results *results = entry->results;
+	struct nscss_share_ref **link;
+	struct nscss_share_ref *ref;
+	int i;
+
+	if (results == NULL)
+		return;
+
+	for (i = 0; i < CSS_PSEUDO_ELEMENT_COUNT; i++) {
+		if (entry->partial[i] != NULL)
+			css_computed_style_destroy(entry->partial[i]);
+		entry->partial[i] = NULL;
+	}
+
+	entry->results = NULL;
+	entry->parent = NULL;
+
+	ref = nscss_share_ref_find(results, &link);
+	if (ref == NULL || ref->count == 1) {
+		/* Last holder; the styles are about to be freed */
+		nscss_share_release_children(results);
+	}
+
+	nscss_share_unref(results);
+}
+
+/**
+ * Release the cache entries composed with one of a result's styles
+ *
+ * Entries are keyed on their parent style's address, so they must go
+ * before that style is freed and the address can be reused.
+ *
+ * \param results  Selection results about to be destroyed
+ */
+static void nscss_share_release_children(const css_select_results *results)
+{
+	unsigned int i;
+	int j;
+
+	for (i = 0; i < NSCSS_SHARE_CACHE_SIZE; i++) {
+		struct nscss_share_entry *entry = &nscss_share.entry[i];
+
+		if (entry->results == NULL)
+			continue;
+
+		for (j = 0; j < CSS_PSEUDO_ELEMENT_COUNT; j++) {
+			if (results->styles[j] != NULL &&
+					entry->parent == results->styles[j]) {
+				nscss_share_entry_release(entry);
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Empty the style sharing cache
+ */
+static void nscss_share_clear(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < NSCSS_SHARE_CACHE_SIZE; i++)
+		nscss_share_entry_release(&nscss_share.entry[i]);
+
+	nscss_share.victim = 0;
+}
+
+/* exported interface documented in css/select.h */
+void nscss_select_share_flush(void)
+{
+	if (nscss_share.selected > 0) {
+		NSLOG(netsurf, INFO,
+		      "Style sharing: %u of %u selections shared (%u%%)",
+		      nscss_share.shared, nscss_share.selected,
+		      (nscss_share.shared * 100) / nscss_share.selected);
+
+		/* Per selection trace events would flood the ring */
+		NSTRACE_COUNTER("css selections", nscss_share.selected);
+		NSTRACE_COUNTER("css selections shared", nscss_share.shared);
+	}
+
+	nscss_share_clear();
+
+	nscss_share.selected = 0;
+	nscss_share.shared = 0;
+}
+
+/* exported interface documented in css/select.h */
+void nscss_select_results_destroy(css_select_results *results)
+{
+	struct nscss_share_ref **link;
+	struct nscss_share_ref *ref;
+
+	ref = nscss_share_ref_find(results, &link);
+	if (ref == NULL || ref->count == 1) {
+		/* The styles are about to be freed, and may be the
+		 * parent style of a cache entry */
+		nscss_share_release_children(results);
+	}
+
+	nscss_share_unref(results);
+}
+
+/* exported interface documented in css/select.h */
+void nscss_select_sibling_cache_invalidate(void)
+{
+	struct nscss_sibling_named *named;
+	unsigned int i, j;
+
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < 2; j++) {
+			if (nscss_sibling.count[i][j].node != NULL)
+				dom_node_unref(nscss_sibling.count[i][j].node);
+			nscss_sibling.count[i][j].node = NULL;
+		}
+	}
+
+	for (i = 0; i < NSCSS_SIBLING_NAMED_SIZE; i++) {
+		named = &nscss_sibling.named[i];
+
+		if (named->node != NULL)
+			dom_node_unref(named->node);
+		if (named->name != NULL)
+			lwc_string_unref(named->name);
+		if (named->sibling != NULL)
+			dom_node_unref(named->sibling);
+
+		named->node = NULL;
+		named->name = NULL;
+		named->sibling = NULL;
+	}
+
+	nscss_sibling.victim = 0;
+}
+
+/**
+ * Look for an earlier selection result that can be shared
+ *
+ * \param parent  Parent style the result is to be composed with
+ * \param styles  Partial styles selected by libcss
+ * \return Shared result, with a reference taken, or NULL if none
+ */
+static css_select_results *nscss_share_find(
+		const css_computed_style *parent,
+		const css_select_results *styles)
+{
+	unsigned int i;
+	int j;
+
+	for (i = 0; i < NSCSS_SHARE_CACHE_SIZE; i++) {
+		struct nscss_share_entry *entry = &nscss_share.entry[i];
+
+		if (entry->results == NULL || entry->parent != parent)
+			continue;
+
+		for (j = 0; j < CSS_PSEUDO_ELEMENT_COUNT; j++) {
+			if (entry->partial[j] != styles->styles[j])
+				break;
+		}
+		if (j != CSS_PSEUDO_ELEMENT_COUNT)
+			continue;
+
+		if (nscss_share_ref(entry->results) == false)
+			return NULL;
+
+		return entry->results;
+	}
+
+	return NULL;
+}
+
+/**
+ * Remember a composed selection result for sharing
+ *
+ * \param parent   Parent style the result was composed with
+ * \param partial  Partial styles it was composed from; ownership passes
+ *                 to the cache, whether or not the result is cached
+ * \param results  Composed result
+ */
+static void nscss_share_insert(const css_computed_style *parent,
+		css_computed_style **partial, css_select_results *results)
+{
+	struct nscss_share_entry *entry;
+	int i;
+
+	entry = &nscss_share.entry[nscss_share.victim];
+	nscss_share_entry_release(entry);
+
+	if (nscss_share_ref(results) == false) {
+		for (i = 0; i < CSS_PSEUDO_ELEMENT_COUNT; i++) {
+			if (partial[i] != NULL)
+				css_computed_style_destroy(partial[i]);
+		}
+		return;
+	}
+
+	entry->parent = parent;
+	for (i = 0; i < CSS_PSEUDO_ELEMENT_COUNT; i++)
+		entry->partial[i] = partial[i];
+	entry->results = results;
+
+	nscss_share.victim = (nscss_share.victim + 1) %
+			NSCSS_SHARE_CACHE_SIZE;
+}
+
 /**
  * Get style selection results for an element
  *
@@ -258,7 +634,9 @@ css_select_results *nscss_get_style(nscss_select_ctx *ctx, dom_node *n,
 		uint64_t media, const css_stylesheet *inline_style)
 {
 	css_computed_style *composed;
+	css_computed_style *partial[CSS_PSEUDO_ELEMENT_COUNT];
 	css_select_results *styles;
+	css_select_results *shared;
 	int pseudo_element;
 	css_error error;
 
@@ -271,6 +649,23 @@ css_select_results *nscss_get_style(nscss_select_ctx *ctx, dom_node *n,
 		return NULL;
 	}
 
+	/* Reuse the result for an earlier element with the same partial
+	 * styles and parent style, if there is one */
+	nscss_share.selected++;
+	shared = nscss_share_find(ctx->parent_style, styles);
+	if (shared != NULL) {
+		nscss_share.shared++;
+		css_select_results_destroy(styles);
+		return shared;
+	}
+
+	/* Keep hold of the partial styles, for later sharing */
+	for (pseudo_element = CSS_PSEUDO_ELEMENT_NONE;
+			pseudo_element < CSS_PSEUDO_ELEMENT_COUNT;
+			pseudo_element++) {
+		partial[pseudo_element] = NULL;
+	}
+
 	/* If there's a parent style, compose with partial to obtain
 	 * complete computed style for element */
 	if (ctx->parent_style != NULL) {
@@ -286,8 +681,8 @@ css_select_results *nscss_get_style(nscss_select_ctx *ctx, dom_node *n,
 		}
 
 		/* Replace select_results style with composed style */
-		css_computed_style_destroy(
-				styles->styles[CSS_PSEUDO_ELEMENT_NONE]);
+		partial[CSS_PSEUDO_ELEMENT_NONE] =
+				styles->styles[CSS_PSEUDO_ELEMENT_NONE];
 		styles->styles[CSS_PSEUDO_ELEMENT_NONE] = composed;
 	}
 
@@ -315,15 +710,46 @@ css_select_results *nscss_get_style(nscss_select_ctx *ctx, dom_node *n,
 		if (error != CSS_OK) {
 			/* TODO: perhaps this shouldn't be quite so
 			 * catastrophic? */
+			for (pseudo_element = CSS_PSEUDO_ELEMENT_NONE;
+					pseudo_element <
+						CSS_PSEUDO_ELEMENT_COUNT;
+					pseudo_element++) {
+				if (partial[pseudo_element] != NULL)
+					css_computed_style_destroy(
+						partial[pseudo_element]);
+			}
 			css_select_results_destroy(styles);
 			return NULL;
 		}
 
 		/* Replace select_results style with composed style */
-		css_computed_style_destroy(styles->styles[pseudo_element]);
+		partial[pseudo_element] = styles->styles[pseudo_element];
 		styles->styles[pseudo_element] = composed;
 	}
 
+	/* Only share results in which every style was composed */
+	for (pseudo_element = CSS_PSEUDO_ELEMENT_NONE;
+			pseudo_element < CSS_PSEUDO_ELEMENT_COUNT;
+			pseudo_element++) {
+		if (partial[pseudo_element] == NULL &&
+				styles->styles[pseudo_element] != NULL) {
+			break;
+		}
+	}
+
+	if (pseudo_element == CSS_PSEUDO_ELEMENT_COUNT) {
+		nscss_share_insert(ctx->parent_style, partial, styles);
+	} else {
+		/* Some styles were not composed; not worth sharing */
+		for (pseudo_element = CSS_PSEUDO_ELEMENT_NONE;
+				pseudo_element < CSS_PSEUDO_ELEMENT_COUNT;
+				pseudo_element++) {
+			if (partial[pseudo_element] != NULL)
+				css_computed_style_destroy(
+						partial[pseudo_element]);
+		}
+	}
+
 	return styles;
 }
 
@@ -666,12 +1092,21 @@ css_error named_sibling_node(void *pw, void *node,
 css_error named_generic_sibling_node(void *pw, void *node,
 		const css_qname *qname, void **sibling)
 {
+	struct nscss_sibling_named *memo = NULL;
 	dom_node *n = node;
 	dom_node *prev;
 	dom_exception err;
+	unsigned int i;
 
 	*sibling = NULL;
 
+	for (i = 0; i < NSCSS_SIBLING_NAMED_SIZE; i++) {
+		if (nscss_sibling.named[i].name == qname->name) {
+			memo = &nscss_sibling.named[i];
+			break;
+		}
+	}
+
 	err = dom_node_get_previous_sibling(n, &n);
 	if (err != DOM_NO_ERR)
 		return CSS_OK;
@@ -703,6 +1138,13 @@ css_error named_generic_sibling_node(void *pw, void *node,
 			dom_string_unref(name);
 		}
 
+		if (memo != NULL && memo->node == n) {
+			/* Searched from here before; the answer holds */
+			dom_node_unref(n);
+			*sibling = memo->sibling;
+			break;
+		}
+
 		err = dom_node_get_previous_sibling(n, &prev);
 		if (err != DOM_NO_ERR) {
 			dom_node_unref(n);
@@ -713,6 +1155,28 @@ css_error named_generic_sibling_node(void *pw, void *node,
 		n = prev;
 	}
 
+	/* Remember the answer for the next sibling */
+	if (memo == NULL) {
+		memo = &nscss_sibling.named[nscss_sibling.victim];
+		nscss_sibling.victim = (nscss_sibling.victim + 1) %
+				NSCSS_SIBLING_NAMED_SIZE;
+
+		if (memo->name != NULL)
+			lwc_string_unref(memo->name);
+		memo->name = lwc_string_ref(qname->name);
+	}
+
+	if (*sibling != NULL)
+		dom_node_ref(*sibling);
+	if (memo->sibling != NULL)
+		dom_node_unref(memo->sibling);
+	memo->sibling = *sibling;
+
+	dom_node_ref(node);
+	if (memo->node != NULL)
+		dom_node_unref(memo->node);
+	memo->node = node;
+
 	return CSS_OK;
 }
 
@@ -1403,35 +1867,77 @@ node_count_siblings_check(dom_node *node,
 css_error node_count_siblings(void *pw, void *n, bool same_name,
 		bool after, int32_t *count)
 {
+	struct nscss_sibling_count *memo;
 	int32_t cnt = 0;
 	dom_exception exc;
 	dom_string *node_name = NULL;
+	dom_node *node;
+	dom_node *next;
+	bool found = false;
+
+	memo = &nscss_sibling.count[same_name ? 1 : 0][after ? 1 : 0];
 
 	if (same_name) {
-		dom_node *node = n;
-		exc = dom_node_get_node_name(node, &node_name);
+		exc = dom_node_get_node_name(n, &node_name);
 		if ((exc != DOM_NO_ERR) || (node_name == NULL)) {
 			return CSS_NOMEM;
 		}
 	}
 
 	if (after) {
-		dom_node *node = dom_node_ref(n);
-		dom_node *next;
+		int steps = 0;
 
-		do {
-			exc = dom_node_get_next_sibling(node, &next);
+		/* If a nearby preceding sibling was counted last, the
+		 * siblings following this node are those it counted less
+		 * this node and any in between */
+		node = dom_node_ref(n);
+
+		while (memo->node != NULL &&
+				steps++ < NSCSS_SIBLING_AFTER_LIMIT) {
+			exc = dom_node_get_previous_sibling(node, &next);
 			if ((exc != DOM_NO_ERR))
 				break;
 
 			dom_node_unref(node);
 			node = next;
 
-			cnt += node_count_siblings_check(node, same_name, node_name);
-		} while (node != NULL);
+			if (node == NULL)
+				break;
+
+			if (node == memo->node) {
+				if (node_count_siblings_check(node, same_name,
+						node_name) == 1) {
+					cnt = memo->count - cnt - 1;
+					found = true;
+				}
+				break;
+			}
+
+			cnt += node_count_siblings_check(node, same_name,
+					node_name);
+		}
+
+		if (node != NULL)
+			dom_node_unref(node);
+
+		if (found == false) {
+			cnt = 0;
+			node = dom_node_ref(n);
+
+			do {
+				exc = dom_node_get_next_sibling(node, &next);
+				if ((exc != DOM_NO_ERR))
+					break;
+
+				dom_node_unref(node);
+				node = next;
+
+				cnt += node_count_siblings_check(node,
+						same_name, node_name);
+			} while (node != NULL);
+		}
 	} else {
-		dom_node *node = dom_node_ref(n);
-		dom_node *next;
+		node = dom_node_ref(n);
 
 		do {
 			exc = dom_node_get_previous_sibling(node, &next);
@@ -1441,6 +1947,15 @@ css_error node_count_siblings(void *pw, void *n, bool same_name,
 			dom_node_unref(node);
 			node = next;
 
+			if (node != NULL && node == memo->node &&
+					node_count_siblings_check(node,
+					same_name, node_name) == 1) {
+				/* Counted from here before; add its count */
+				cnt += 1 + memo->count;
+				dom_node_unref(node);
+				break;
+			}
+
 			cnt += node_count_siblings_check(node, same_name, node_name);
 
 		} while (node != NULL);
@@ -1450,6 +1965,13 @@ css_error node_count_siblings(void *pw, void *n, bool same_name,
 		dom_string_unref(node_name);
 	}
 
+	/* Remember the count for the next sibling */
+	dom_node_ref(n);
+	if (memo->node != NULL)
+		dom_node_unref(memo->node);
+	memo->node = n;
+	memo->count = cnt;
+
 	*count = cnt;
 	return CSS_OK;
 }
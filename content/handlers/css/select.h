@@ -49,6 +49,32 @@ css_select_results *nscss_get_style(nscss_select_ctx *ctx, dom_node *n,
 css_computed_style *nscss_get_blank_style(nscss_select_ctx *ctx,
 		const css_computed_style *parent);
 
+/**
+ * Destroy selection results obtained from nscss_get_style
+ *
+ * Results may be shared between elements, so this must be used in place
+ * of css_select_results_destroy.
+ *
+ * \param results  Selection results to release
+ */
+void nscss_select_results_destroy(css_select_results *results);
+
+/**
+ * Empty the style sharing cache and log and trace its hit rate
+ *
+ * Called when a batch of selections, such as conversion of a document,
+ * is finished.
+ */
+void nscss_select_share_flush(void);
+
+/**
+ * Forget the sibling counts and lookups remembered during selection
+ *
+ * Must be called when the DOM is changed, and when a batch of selections
+ * is finished, to release the nodes the memo holds.
+ */
+void nscss_select_sibling_cache_invalidate(void);
+
 
 css_error named_ancestor_node(void *pw, void *node,
 		const css_qname *qname, void **ancestor);
@@ -26,12 +26,19 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <nsutils/time.h>
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "netsurf/inttypes.h"
 #include "utils/utils.h"
 #include "utils/log.h"
+#include "utils/trace.h"
 #include "netsurf/misc.h"
 #include "netsurf/bitmap.h"
+#include "netsurf/plotters.h"
+#include "netsurf/content.h"
 #include "content/llcache.h"
 #include "content/content_protected.h"
 #include "desktop/gui_internal.h"
@@ -47,6 +54,25 @@
  */
 typedef unsigned int cache_age;
 
+/** Initial number of buckets in the content index */
+#define IMAGE_CACHE_INDEX_INITIAL_SIZE 64
+
+/** Number of background decode threads */
+#define IMAGE_CACHE_DECODE_THREADS 2
+
+/** Number of milliseconds between checks for completed decodes */
+#define IMAGE_CACHE_DECODE_POLL 10
+
+/**
+ * State of a background decode for a cache entry
+ */
+enum image_cache_decode_state {
+	IMAGE_CACHE_DECODE_NONE, /**< no decode outstanding */
+	IMAGE_CACHE_DECODE_QUEUED, /**< waiting for a decode thread */
+	IMAGE_CACHE_DECODE_RUNNING, /**< being decoded */
+	IMAGE_CACHE_DECODE_DONE, /**< decoded, waiting to be collected */
+};
+
 /**
  * Image cache entry
  */
@@ -54,6 +80,14 @@ struct image_cache_entry_s {
 	struct image_cache_entry_s *next; /**< next cache entry in list */
 	struct image_cache_entry_s *prev; /**< previous cache entry in list */
 
+	/** next entry in content index bucket */
+	struct image_cache_entry_s *index_next;
+
+	/** next more recently used entry holding a bitmap */
+	struct image_cache_entry_s *lru_next;
+	/** previous less recently used entry holding a bitmap */
+	struct image_cache_entry_s *lru_prev;
+
 	/** content is used as a key */
 	struct content *content;
 	/** associated bitmap entry */
@@ -69,6 +103,25 @@ struct image_cache_entry_s {
 	cache_age bitmap_age; /**< Age of last conversion to a bitmap by cache*/
 
 	int conversion_count; /**< Number of times image has been converted */
+
+	int plot_width; /**< largest width the image has been plotted at */
+	int plot_height; /**< largest height the image has been plotted at */
+
+	/* Background decode, protected by the decode lock */
+
+	enum image_cache_decode_state decode_state; /**< decode state */
+	struct image_cache_entry_s *decode_next; /**< next in decode list */
+	struct bitmap *decode_bitmap; /**< bitmap from background decode */
+	const char *decode_data; /**< source data for background decode */
+	unsigned long decode_size; /**< size of background decode source */
+	int decode_width; /**< width requested from background decode */
+	int decode_height; /**< height requested from background decode */
+	uint64_t decode_time; /**< time taken by background decode in ms */
+	bool decode_redraw; /**< redraw content when decode completes */
+#ifdef WITH_TRACE
+	uint64_t decode_trace_start; /**< trace time background decode began */
+	uint64_t decode_trace_end; /**< trace time background decode ended */
+#endif
 };
 
 /**
@@ -89,6 +142,17 @@ struct image_cache_s {
 	/* The objects the cache holds */
 	struct image_cache_entry_s *entries;
 
+	/** Content index hash buckets */
+	struct image_cache_entry_s **index;
+	/** Number of buckets in content index */
+	unsigned int index_size;
+	/** Number of entries in content index */
+	unsigned int index_count;
+
+	/** Least recently used entry holding a bitmap */
+	struct image_cache_entry_s *lru_head;
+	/** Most recently used entry holding a bitmap */
+	struct image_cache_entry_s *lru_tail;
 
 	/* Statistics for management algorithm */
 
@@ -134,6 +198,36 @@ struct image_cache_s {
 	int peak_conversions;
 	/** Size of bitmap with most conversions */
 	unsigned int peak_conversions_size;
+
+	/** Number of conversions timed */
+	int decode_count;
+	/** Total time spent converting in ms */
+	uint64_t decode_time;
+	/** Longest single conversion in ms */
+	uint64_t peak_decode_time;
+
+#ifdef WITH_PTHREAD
+	/** Background decode threads are running */
+	bool decode_running;
+	/** Background decode threads should exit */
+	bool decode_quit;
+	/** Lock protecting the decode lists and entry decode state */
+	pthread_mutex_t decode_lock;
+	/** Signalled when decode lists change */
+	pthread_cond_t decode_cond;
+	/** Entries waiting for decode in order */
+	struct image_cache_entry_s *decode_pending;
+	/** Last entry waiting for decode */
+	struct image_cache_entry_s *decode_pending_tail;
+	/** Entries with completed decodes */
+	struct image_cache_entry_s *decode_complete;
+	/** Number of decodes not yet collected */
+	unsigned int decode_outstanding;
+	/** The decode threads */
+	pthread_t decode_thread[IMAGE_CACHE_DECODE_THREADS];
+	/** Number of decode threads started */
+	int decode_thread_count;
+#endif
 };
 
 /** image cache state */
@@ -159,6 +253,119 @@ static struct image_cache_entry_s *image_cache__findn(int entryn)
 }
 
 
+/**
+ * Compute the content index bucket for a content.
+ *
+ * \param c The content to hash.
+ * \param size The number of buckets in the index.
+ * \return The bucket the content belongs in.
+ */
+static inline unsigned int
+image_cache__hash(const struct content *c, unsigned int size)
+{
+	uintptr_t key = (uintptr_t)c;
+
+	/* discard allocation alignment then mix with fibonacci hashing */
+	key >>= 4;
+	return (unsigned int)((key * 2654435761u) & 0xffffffff) & (size - 1);
+}
+
+
+/**
+ * Double the number of buckets in the content index.
+ *
+ * \return NSERROR_OK on success or NSERROR_NOMEM on allocation failure.
+ */
+static nserror image_cache__index_grow(void)
+{
+	struct image_cache_entry_s **index;
+	struct image_cache_entry_s *centry;
+	struct image_cache_entry_s *next;
+	unsigned int size;
+	unsigned int bucket;
+	unsigned int idx;
+
+	if (image_cache->index_size == 0) {
+		size = IMAGE_CACHE_INDEX_INITIAL_SIZE;
+	} else {
+		size = image_cache->index_size * 2;
+	}
+
+	index = calloc(size, sizeof(struct image_cache_entry_s *));
+	if (index == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	for (idx = 0; idx < image_cache->index_size; idx++) {
+		for (centry = image_cache->index[idx];
+		     centry != NULL;
+		     centry = next) {
+			next = centry->index_next;
+			bucket = image_cache__hash(centry->content, size);
+			centry->index_next = index[bucket];
+			index[bucket] = centry;
+		}
+	}
+
+	free(image_cache->index);
+	image_cache->index = index;
+	image_cache->index_size = size;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Add a cache entry to the content index.
+ *
+ * \param centry The entry to add.
+ * \return NSERROR_OK on success or NSERROR_NOMEM on allocation failure.
+ */
+static nserror image_cache__index_insert(struct image_cache_entry_s *centry)
+{
+	unsigned int bucket;
+	nserror res;
+
+	if (image_cache->index_count >= image_cache->index_size) {
+		res = image_cache__index_grow();
+		if (res != NSERROR_OK) {
+			return res;
+		}
+	}
+
+	bucket = image_cache__hash(centry->content, image_cache->index_size);
+	centry->index_next = image_cache->index[bucket];
+	image_cache->index[bucket] = centry;
+	image_cache->index_count++;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Remove a cache entry from the content index.
+ *
+ * \param centry The entry to remove.
+ */
+static void image_cache__index_remove(struct image_cache_entry_s *centry)
+{
+	struct image_cache_entry_s **prev;
+	unsigned int bucket;
+
+	bucket = image_cache__hash(centry->content, image_cache->index_size);
+	for (prev = &image_cache->index[bucket];
+	     *prev != NULL;
+	     prev = &(*prev)->index_next) {
+		if (*prev == centry) {
+			*prev = centry->index_next;
+			centry->index_next = NULL;
+			image_cache->index_count--;
+			return;
+		}
+	}
+}
+
+
 /**
  * Find the cache entry for a content
  *
@@ -169,13 +376,81 @@ static struct image_cache_entry_s *image_cache__find(const struct content *c)
 {
 	struct image_cache_entry_s *found;
 
-	found = image_cache->entries;
+	if (image_cache->index_size == 0) {
+		return NULL;
+	}
+
+	found = image_cache->index[image_cache__hash(c, image_cache->index_size)];
 	while ((found != NULL) && (found->content != c)) {
-		found = found->next;
+		found = found->index_next;
 	}
 	return found;
 }
 
+
+/**
+ * Remove an entry from the bitmap LRU list.
+ *
+ * \param centry The entry to remove.
+ */
+static void image_cache__lru_remove(struct image_cache_entry_s *centry)
+{
+	if (centry->lru_prev == NULL) {
+		image_cache->lru_head = centry->lru_next;
+	} else {
+		centry->lru_prev->lru_next = centry->lru_next;
+	}
+
+	if (centry->lru_next == NULL) {
+		image_cache->lru_tail = centry->lru_prev;
+	} else {
+		centry->lru_next->lru_prev = centry->lru_prev;
+	}
+
+	centry->lru_prev = NULL;
+	centry->lru_next = NULL;
+}
+
+
+/**
+ * Make an entry holding a bitmap the most recently used.
+ *
+ * The list is kept ordered by the later of the entries redraw and
+ * bitmap ages so the least recently used entry is always at the head.
+ *
+ * \param centry The entry to move or add to the tail of the list.
+ */
+static void image_cache__lru_touch(struct image_cache_entry_s *centry)
+{
+	if ((centry->lru_prev != NULL) ||
+	    (image_cache->lru_head == centry)) {
+		image_cache__lru_remove(centry);
+	}
+
+	centry->lru_prev = image_cache->lru_tail;
+	if (image_cache->lru_tail == NULL) {
+		image_cache->lru_head = centry;
+	} else {
+		image_cache->lru_tail->lru_next = centry;
+	}
+	image_cache->lru_tail = centry;
+}
+
+
+/**
+ * Get the age an entry was last used by the cache.
+ *
+ * \param centry The entry to check.
+ * \return The later of the redraw and bitmap conversion ages.
+ */
+static inline cache_age image_cache__used_age(struct image_cache_entry_s *centry)
+{
+	if (centry->redraw_age > centry->bitmap_age) {
+		return centry->redraw_age;
+	}
+	return centry->bitmap_age;
+}
+
 /**
  * Update the image cache statistics with an entry.
  *
@@ -186,6 +461,12 @@ static void image_cache_stats_bitmap_add(struct image_cache_entry_s *centry)
 	centry->bitmap_age = image_cache->current_age;
 	centry->conversion_count++;
 
+	/* bitmaps may be decoded smaller than the content */
+	centry->bitmap_size = guit->bitmap->get_width(centry->bitmap) *
+		guit->bitmap->get_height(centry->bitmap) * 4;
+
+	image_cache__lru_touch(centry);
+
 	image_cache->total_bitmap_size += centry->bitmap_size;
 	image_cache->bitmap_count++;
 
@@ -216,6 +497,20 @@ static void image_cache_stats_bitmap_add(struct image_cache_entry_s *centry)
 	}
 }
 
+/**
+ * Update the image cache statistics with the time taken by a conversion.
+ *
+ * \param elapsed The time taken by the conversion in ms.
+ */
+static void image_cache_stats_decode_add(uint64_t elapsed)
+{
+	image_cache->decode_count++;
+	image_cache->decode_time += elapsed;
+	if (elapsed > image_cache->peak_decode_time) {
+		image_cache->peak_decode_time = elapsed;
+	}
+}
+
 static void image_cache__link(struct image_cache_entry_s *centry)
 {
 	centry->next = image_cache->entries;
@@ -265,6 +560,7 @@ static void image_cache__free_bitmap(struct image_cache_entry_s *centry)
 #endif
 		guit->bitmap->destroy(centry->bitmap);
 		centry->bitmap = NULL;
+		image_cache__lru_remove(centry);
 		image_cache->total_bitmap_size -= centry->bitmap_size;
 		image_cache->bitmap_count--;
 		if (centry->redraw_count == 0) {
@@ -274,6 +570,447 @@ static void image_cache__free_bitmap(struct image_cache_entry_s *centry)
 
 }
 
+#ifdef WITH_PTHREAD
+/**
+ * Remove an entry from a singly linked decode list.
+ *
+ * \param list The head of the list.
+ * \param centry The entry to remove.
+ * \return The previous entry in the list or NULL if the entry was first.
+ */
+static struct image_cache_entry_s *
+image_cache__decode_unlist(struct image_cache_entry_s **list,
+			   struct image_cache_entry_s *centry)
+{
+	struct image_cache_entry_s *prev = NULL;
+	struct image_cache_entry_s **link = list;
+
+	while (*link != NULL) {
+		if (*link == centry) {
+			*link = centry->decode_next;
+			centry->decode_next = NULL;
+			break;
+		}
+		prev = *link;
+		link = &(*link)->decode_next;
+	}
+	return prev;
+}
+
+
+/**
+ * Abandon any background decode for an entry.
+ *
+ * Must be called before the entry or its content is freed. If the
+ * decode is in progress this waits for it to finish as the decoder
+ * is reading the content.
+ *
+ * \param centry The image cache entry.
+ */
+static void image_cache__decode_cancel(struct image_cache_entry_s *centry)
+{
+	struct image_cache_entry_s *prev;
+
+	if (image_cache->decode_running == false) {
+		return;
+	}
+
+	pthread_mutex_lock(&image_cache->decode_lock);
+
+	while (centry->decode_state == IMAGE_CACHE_DECODE_RUNNING) {
+		pthread_cond_wait(&image_cache->decode_cond,
+				  &image_cache->decode_lock);
+	}
+
+	switch (centry->decode_state) {
+	case IMAGE_CACHE_DECODE_QUEUED:
+		prev = image_cache__decode_unlist(&image_cache->decode_pending,
+						  centry);
+		if (image_cache->decode_pending_tail == centry) {
+			image_cache->decode_pending_tail = prev;
+		}
+		image_cache->decode_outstanding--;
+		break;
+
+	case IMAGE_CACHE_DECODE_DONE:
+		image_cache__decode_unlist(&image_cache->decode_complete,
+					   centry);
+		image_cache->decode_outstanding--;
+		break;
+
+	default:
+		break;
+	}
+	centry->decode_state = IMAGE_CACHE_DECODE_NONE;
+
+	pthread_mutex_unlock(&image_cache->decode_lock);
+
+	if (centry->decode_bitmap != NULL) {
+		guit->bitmap->destroy(centry->decode_bitmap);
+		centry->decode_bitmap = NULL;
+	}
+}
+
+
+/**
+ * Wait for a running background decode of an entry to finish.
+ *
+ * A queued decode is left in place, when it is collected its bitmap
+ * is discarded unless it is larger than the one already present.
+ *
+ * \param centry The image cache entry.
+ */
+static void image_cache__decode_wait(struct image_cache_entry_s *centry)
+{
+	if (image_cache->decode_running == false) {
+		return;
+	}
+
+	pthread_mutex_lock(&image_cache->decode_lock);
+	while (centry->decode_state == IMAGE_CACHE_DECODE_RUNNING) {
+		pthread_cond_wait(&image_cache->decode_cond,
+				  &image_cache->decode_lock);
+	}
+	pthread_mutex_unlock(&image_cache->decode_lock);
+}
+
+
+/**
+ * Background decode thread.
+ *
+ * Takes entries from the pending list in order, converts them and
+ * places them on the complete list to be collected by the browser
+ * thread.
+ *
+ * \param p The image cache context.
+ * \return NULL
+ */
+static void *image_cache__decode_thread(void *p)
+{
+	struct image_cache_s *icache = p;
+	struct image_cache_entry_s *centry;
+	struct content *content;
+	image_cache_convert_fn *convert;
+	const char *data;
+	unsigned long size;
+	struct bitmap *bitmap;
+	int width;
+	int height;
+	uint64_t start;
+	uint64_t end;
+#ifdef WITH_TRACE
+	uint64_t trace_start;
+	uint64_t trace_end;
+#endif
+
+	pthread_mutex_lock(&icache->decode_lock);
+	for (;;) {
+		while ((icache->decode_pending == NULL) &&
+		       (icache->decode_quit == false)) {
+			pthread_cond_wait(&icache->decode_cond,
+					  &icache->decode_lock);
+		}
+		if (icache->decode_quit) {
+			break;
+		}
+
+		centry = icache->decode_pending;
+		icache->decode_pending = centry->decode_next;
+		if (icache->decode_pending == NULL) {
+			icache->decode_pending_tail = NULL;
+		}
+		centry->decode_next = NULL;
+		centry->decode_state = IMAGE_CACHE_DECODE_RUNNING;
+		content = centry->content;
+		convert = centry->convert;
+		data = centry->decode_data;
+		size = centry->decode_size;
+		width = centry->decode_width;
+		height = centry->decode_height;
+		pthread_mutex_unlock(&icache->decode_lock);
+
+#ifdef WITH_TRACE
+		trace_start = nstrace_now();
+#endif
+		nsu_getmonotonic_ms(&start);
+		bitmap = convert(content, data, size, width, height);
+		nsu_getmonotonic_ms(&end);
+#ifdef WITH_TRACE
+		trace_end = nstrace_now();
+#endif
+
+		pthread_mutex_lock(&icache->decode_lock);
+		centry->decode_bitmap = bitmap;
+		centry->decode_time = end - start;
+#ifdef WITH_TRACE
+		/* the trace ring belongs to the browser thread so the
+		 * event is recorded when the decode is collected */
+		centry->decode_trace_start = trace_start;
+		centry->decode_trace_end = trace_end;
+#endif
+		centry->decode_state = IMAGE_CACHE_DECODE_DONE;
+		centry->decode_next = icache->decode_complete;
+		icache->decode_complete = centry;
+
+		/* wake anything waiting on this decode */
+		pthread_cond_broadcast(&icache->decode_cond);
+	}
+	pthread_mutex_unlock(&icache->decode_lock);
+
+	return NULL;
+}
+
+
+/**
+ * Collect completed background decodes.
+ *
+ * Scheduled callback which installs decoded bitmaps in their cache
+ * entries and requests a redraw of contents which were plotted without
+ * their bitmap. Reschedules itself while decodes are outstanding.
+ *
+ * \param p The image cache context.
+ */
+static void image_cache__decode_collect(void *p)
+{
+	struct image_cache_s *icache = p;
+	struct image_cache_entry_s *centry;
+	struct image_cache_entry_s *next;
+	union content_msg_data data;
+
+	pthread_mutex_lock(&icache->decode_lock);
+	centry = icache->decode_complete;
+	icache->decode_complete = NULL;
+	for (next = centry; next != NULL; next = next->decode_next) {
+		next->decode_state = IMAGE_CACHE_DECODE_NONE;
+		icache->decode_outstanding--;
+	}
+	pthread_mutex_unlock(&icache->decode_lock);
+
+	while (centry != NULL) {
+		next = centry->decode_next;
+		centry->decode_next = NULL;
+
+		image_cache_stats_decode_add(centry->decode_time);
+		NSTRACE_COMPLETE("image decode",
+				 centry->decode_trace_start,
+				 centry->decode_trace_end);
+
+		if (centry->decode_bitmap == NULL) {
+			icache->fail_count++;
+			icache->fail_size += centry->bitmap_size;
+		} else if ((centry->bitmap != NULL) &&
+			   (guit->bitmap->get_width(centry->decode_bitmap) <=
+			    guit->bitmap->get_width(centry->bitmap))) {
+			/* converted on demand while decode was outstanding */
+			guit->bitmap->destroy(centry->decode_bitmap);
+		} else {
+			/* replace any smaller bitmap */
+			image_cache__free_bitmap(centry);
+			centry->bitmap = centry->decode_bitmap;
+			image_cache_stats_bitmap_add(centry);
+			if (centry->decode_redraw) {
+				icache->miss_count++;
+				icache->miss_size += centry->bitmap_size;
+			}
+		}
+		centry->decode_bitmap = NULL;
+
+		if ((centry->bitmap != NULL) && centry->decode_redraw) {
+			/* replace the placeholder */
+			data.redraw.x = 0;
+			data.redraw.y = 0;
+			data.redraw.width = centry->content->width;
+			data.redraw.height = centry->content->height;
+			data.redraw.full_redraw = true;
+			data.redraw.object = centry->content;
+			data.redraw.object_x = 0;
+			data.redraw.object_y = 0;
+			data.redraw.object_width = centry->content->width;
+			data.redraw.object_height = centry->content->height;
+
+			content_broadcast(centry->content,
+					  CONTENT_MSG_REDRAW,
+					  &data);
+		}
+		centry->decode_redraw = false;
+
+		centry = next;
+	}
+
+	if (icache->decode_outstanding > 0) {
+		guit->misc->schedule(IMAGE_CACHE_DECODE_POLL,
+				     image_cache__decode_collect,
+				     icache);
+	}
+}
+
+
+/**
+ * Queue an entry for background decode.
+ *
+ * \param centry The entry to decode.
+ * \param redraw Whether the content should be redrawn once decoded.
+ * \return true if the decode is queued or already outstanding, false
+ *         if background decoding is unavailable.
+ */
+static bool
+image_cache__decode_queue(struct image_cache_entry_s *centry, bool redraw)
+{
+	if (image_cache->decode_running == false) {
+		return false;
+	}
+
+	pthread_mutex_lock(&image_cache->decode_lock);
+
+	if (redraw) {
+		centry->decode_redraw = true;
+	}
+
+	/* size requested when the decode starts */
+	centry->decode_width = centry->plot_width;
+	centry->decode_height = centry->plot_height;
+
+	if (centry->decode_state != IMAGE_CACHE_DECODE_NONE) {
+		/* already outstanding */
+		pthread_mutex_unlock(&image_cache->decode_lock);
+		return true;
+	}
+
+	/* the source data is obtained here as the low level cache may
+	 * only be used from the browser thread. It remains unchanged
+	 * until the content is destroyed which cancels the decode.
+	 */
+	centry->decode_data = content__get_source_data(centry->content,
+						       &centry->decode_size);
+
+	centry->decode_state = IMAGE_CACHE_DECODE_QUEUED;
+	centry->decode_next = NULL;
+	if (image_cache->decode_pending_tail == NULL) {
+		image_cache->decode_pending = centry;
+	} else {
+		image_cache->decode_pending_tail->decode_next = centry;
+	}
+	image_cache->decode_pending_tail = centry;
+
+	image_cache->decode_outstanding++;
+	if (image_cache->decode_outstanding == 1) {
+		guit->misc->schedule(IMAGE_CACHE_DECODE_POLL,
+				     image_cache__decode_collect,
+				     image_cache);
+	}
+
+	pthread_cond_broadcast(&image_cache->decode_cond);
+	pthread_mutex_unlock(&image_cache->decode_lock);
+
+	return true;
+}
+
+
+/**
+ * Start the background decode threads.
+ *
+ * If the threads cannot be started conversions are performed on
+ * demand on the browser thread.
+ *
+ * \param icache The image cache context.
+ */
+static void image_cache__decode_start(struct image_cache_s *icache)
+{
+	int thread;
+
+	if (pthread_mutex_init(&icache->decode_lock, NULL) != 0) {
+		return;
+	}
+	if (pthread_cond_init(&icache->decode_cond, NULL) != 0) {
+		pthread_mutex_destroy(&icache->decode_lock);
+		return;
+	}
+
+	for (thread = 0; thread < IMAGE_CACHE_DECODE_THREADS; thread++) {
+		if (pthread_create(&icache->decode_thread[thread], NULL,
+				   image_cache__decode_thread, icache) != 0) {
+			break;
+		}
+	}
+	icache->decode_thread_count = thread;
+
+	if (thread == 0) {
+		NSLOG(netsurf, INFO, "Unable to start image decode threads");
+		pthread_cond_destroy(&icache->decode_cond);
+		pthread_mutex_destroy(&icache->decode_lock);
+		return;
+	}
+
+	icache->decode_running = true;
+}
+
+
+/**
+ * Stop the background decode threads.
+ *
+ * Decodes which have not started are abandoned; they are removed along
+ * with their entries.
+ *
+ * \param icache The image cache context.
+ */
+static void image_cache__decode_stop(struct image_cache_s *icache)
+{
+	int thread;
+
+	if (icache->decode_running == false) {
+		return;
+	}
+
+	pthread_mutex_lock(&icache->decode_lock);
+	icache->decode_quit = true;
+	pthread_cond_broadcast(&icache->decode_cond);
+	pthread_mutex_unlock(&icache->decode_lock);
+
+	for (thread = 0; thread < icache->decode_thread_count; thread++) {
+		pthread_join(icache->decode_thread[thread], NULL);
+	}
+
+	guit->misc->schedule(-1, image_cache__decode_collect, icache);
+}
+#endif
+
+/**
+ * Convert an entries content into a bitmap on the calling thread.
+ *
+ * Any background decode of the entry which is running is allowed to
+ * finish first so the content is never decoded twice at once.
+ *
+ * \param centry The image cache entry to convert.
+ * \param width The width the bitmap will be plotted at or 0 for full size.
+ * \param height The height the bitmap will be plotted at or 0 for full size.
+ * \return The converted bitmap or NULL on failure.
+ */
+static struct bitmap *
+image_cache__convert(struct image_cache_entry_s *centry, int width, int height)
+{
+	struct bitmap *bitmap;
+	const char *data;
+	unsigned long size;
+	uint64_t start;
+	uint64_t end;
+
+#ifdef WITH_PTHREAD
+	image_cache__decode_wait(centry);
+#endif
+
+	data = content__get_source_data(centry->content, &size);
+
+	NSTRACE_BEGIN("image decode");
+	nsu_getmonotonic_ms(&start);
+	bitmap = centry->convert(centry->content, data, size, width, height);
+	nsu_getmonotonic_ms(&end);
+	NSTRACE_END("image decode");
+
+	image_cache_stats_decode_add(end - start);
+
+	return bitmap;
+}
+
 /**
  * free image cache entry
  *
@@ -289,8 +1026,13 @@ static void image_cache__free_entry(struct image_cache_entry_s *centry)
 		image_cache->total_unrendered++;
 	}
 
+#ifdef WITH_PTHREAD
+	image_cache__decode_cancel(centry);
+#endif
+
 	image_cache__free_bitmap(centry);
 
+	image_cache__index_remove(centry);
 	image_cache__unlink(centry);
 
 	free(centry);
@@ -299,23 +1041,27 @@ static void image_cache__free_entry(struct image_cache_entry_s *centry)
 /**
  * Image cache cleaner
  *
+ * Bitmaps are freed in least recently used order until the total
+ * bitmap size is below the limit less the hysteresis. Entries used
+ * within the last clean period are never freed so bitmaps for
+ * active content are retained even when the cache is over its limit.
+ *
  * \param icache The image cache context.
  */
 static void image_cache__clean(struct image_cache_s *icache)
 {
-	struct image_cache_entry_s *centry = icache->entries;
+	struct image_cache_entry_s *centry;
 
-	while (centry != NULL) {
-		if ((icache->current_age - centry->redraw_age) >
-		    icache->params.bg_clean_time) {
-			/* only consider older entries, avoids active entries */
-			if ((icache->total_bitmap_size >
-			     (icache->params.limit - icache->params.hysteresis)) &&
-			    (rand() > (RAND_MAX / 2))) {
-				image_cache__free_bitmap(centry);
-			}
+	while (icache->total_bitmap_size >
+	       (icache->params.limit - icache->params.hysteresis)) {
+		centry = icache->lru_head;
+		if ((centry == NULL) ||
+		    ((icache->current_age - image_cache__used_age(centry)) <=
+		     icache->params.bg_clean_time)) {
+			/* all remaining entries are recently used */
+			break;
 		}
-		centry=centry->next;
+		image_cache__free_bitmap(centry);
 	}
 }
 
@@ -352,9 +1098,17 @@ struct bitmap *image_cache_get_bitmap(const struct content *c)
 		return NULL;
 	}
 
+	if ((centry->bitmap != NULL) &&
+	    (centry->convert != NULL) &&
+	    ((guit->bitmap->get_width(centry->bitmap) < c->width) ||
+	     (guit->bitmap->get_height(centry->bitmap) < c->height))) {
+		/* callers expect a full size bitmap */
+		image_cache__free_bitmap(centry);
+	}
+
 	if (centry->bitmap == NULL) {
 		if (centry->convert != NULL) {
-			centry->bitmap = centry->convert(centry->content);
+			centry->bitmap = image_cache__convert(centry, 0, 0);
 		}
 
 		if (centry->bitmap != NULL) {
@@ -422,6 +1176,10 @@ image_cache_init(const struct image_cache_parameters *image_cache_parameters)
 
 	image_cache->params = *image_cache_parameters;
 
+#ifdef WITH_PTHREAD
+	image_cache__decode_start(image_cache);
+#endif
+
 	guit->misc->schedule(image_cache->params.bg_clean_time,
 				image_cache__background_update,
 				image_cache);
@@ -444,10 +1202,22 @@ nserror image_cache_fini(void)
 	NSLOG(netsurf, INFO, "Size at finish %"PRIsizet" (in %d)",
 	      image_cache->total_bitmap_size, image_cache->bitmap_count);
 
+#ifdef WITH_PTHREAD
+	image_cache__decode_stop(image_cache);
+#endif
+
 	while (image_cache->entries != NULL) {
 		image_cache__free_entry(image_cache->entries);
 	}
 
+#ifdef WITH_PTHREAD
+	if (image_cache->decode_running) {
+		pthread_cond_destroy(&image_cache->decode_cond);
+		pthread_mutex_destroy(&image_cache->decode_lock);
+		image_cache->decode_running = false;
+	}
+#endif
+
 	op_count = image_cache->hit_count +
 		image_cache->miss_count +
 		image_cache->fail_count;
@@ -501,6 +1271,13 @@ nserror image_cache_fini(void)
 	      image_cache->peak_conversions_size,
 	      image_cache->peak_conversions);
 
+	NSLOG(netsurf, INFO,
+	      "Total conversion time %"PRIu64"ms in %d conversions (longest %"PRIu64"ms)",
+	      image_cache->decode_time,
+	      image_cache->decode_count,
+	      image_cache->peak_decode_time);
+
+	free(image_cache->index);
 	free(image_cache);
 
 	return NSERROR_OK;
@@ -525,8 +1302,12 @@ nserror image_cache_add(struct content *content,
 		if (centry == NULL) {
 			return NSERROR_NOMEM;
 		}
-		image_cache__link(centry);
 		centry->content = content;
+		if (image_cache__index_insert(centry) != NSERROR_OK) {
+			free(centry);
+			return NSERROR_NOMEM;
+		}
+		image_cache__link(centry);
 
 		centry->bitmap_size = content->width * content->height * 4;
 	}
@@ -548,7 +1329,12 @@ nserror image_cache_add(struct content *content,
 		/* no bitmap, check to see if we should speculatively convert */
 		if ((centry->convert != NULL) &&
 		    (image_cache_speculate(content) == true)) {
-			centry->bitmap = centry->convert(centry->content);
+#ifdef WITH_PTHREAD
+			if (image_cache__decode_queue(centry, false)) {
+				return NSERROR_OK;
+			}
+#endif
+			centry->bitmap = image_cache__convert(centry, 0, 0);
 
 			if (centry->bitmap != NULL) {
 				image_cache_stats_bitmap_add(centry);
@@ -667,6 +1453,9 @@ case chr :					\
 			FMTCHR('v', "d", total_extra_conversions_count);
 			FMTCHR('w', "u", peak_conversions_size);
 			FMTCHR('x', "d", peak_conversions);
+			FMTCHR('y', "d", decode_count);
+			FMTCHR('z', PRIu64, decode_time);
+			FMTCHR('Z', PRIu64, peak_decode_time);
 
 
 			}
@@ -794,6 +1583,54 @@ image_cache_snentryf(char *string,
 }
 
 
+/**
+ * Check if an entries bitmap is smaller than the image is plotted at.
+ *
+ * \param centry The image cache entry with a bitmap.
+ * \return true if a larger bitmap should be converted.
+ */
+static bool image_cache__bitmap_too_small(struct image_cache_entry_s *centry)
+{
+	int width = guit->bitmap->get_width(centry->bitmap);
+	int height = guit->bitmap->get_height(centry->bitmap);
+
+	return (((width < centry->plot_width) &&
+		 (width < centry->content->width)) ||
+		((height < centry->plot_height) &&
+		 (height < centry->content->height)));
+}
+
+#ifdef WITH_PTHREAD
+/**
+ * Plot a placeholder for an image whose bitmap is being decoded.
+ *
+ * \param data The redraw data for the content.
+ * \param clip The current clip rectangle.
+ * \param ctx The redraw context.
+ * \return true on success else false.
+ */
+static bool image_cache__plot_placeholder(struct content_redraw_data *data,
+					  const struct rect *clip,
+					  const struct redraw_context *ctx)
+{
+	struct rect area = *clip;
+
+	if (data->repeat_x != true) {
+		area.x0 = data->x;
+		area.x1 = data->x + data->width;
+	}
+
+	if (data->repeat_y != true) {
+		area.y0 = data->y;
+		area.y1 = data->y + data->height;
+	}
+
+	return (ctx->plot->rectangle(ctx,
+				     plot_style_fill_lightwbasec,
+				     &area) == NSERROR_OK);
+}
+#endif
+
 /* exported interface documented in image_cache.h */
 bool image_cache_redraw(struct content *c,
 			struct content_redraw_data *data,
@@ -810,9 +1647,40 @@ bool image_cache_redraw(struct content *c,
 		return false;
 	}
 
+	/* track the largest size the image is plotted at */
+	if (data->width > centry->plot_width) {
+		centry->plot_width = data->width;
+	}
+	if (data->height > centry->plot_height) {
+		centry->plot_height = data->height;
+	}
+
+	if ((centry->bitmap != NULL) &&
+	    (centry->convert != NULL) &&
+	    image_cache__bitmap_too_small(centry)) {
+#ifdef WITH_PTHREAD
+		/* plot the smaller bitmap until the decode completes */
+		if (!ctx->interactive ||
+		    !image_cache__decode_queue(centry, true))
+#endif
+			image_cache__free_bitmap(centry);
+	}
+
 	if (centry->bitmap == NULL) {
+#ifdef WITH_PTHREAD
+		/* interactive redraws plot a placeholder while the
+		 * bitmap is decoded in the background.
+		 */
+		if ((centry->convert != NULL) &&
+		    ctx->interactive &&
+		    image_cache__decode_queue(centry, true)) {
+			return image_cache__plot_placeholder(data, clip, ctx);
+		}
+#endif
 		if (centry->convert != NULL) {
-			centry->bitmap = centry->convert(centry->content);
+			centry->bitmap = image_cache__convert(centry,
+							      centry->plot_width,
+							      centry->plot_height);
 		}
 
 		if (centry->bitmap != NULL) {
@@ -833,6 +1701,7 @@ bool image_cache_redraw(struct content *c,
 	/* update statistics */
 	centry->redraw_count++;
 	centry->redraw_age = image_cache->current_age;
+	image_cache__lru_touch(centry);
 
 	return image_bitmap_plot(centry->bitmap, data, clip, ctx);
 }
@@ -43,7 +43,28 @@
 struct content_redraw_data;
 struct redraw_context;
 
-typedef struct bitmap * (image_cache_convert_fn) (struct content *content);
+/**
+ * Convert a content into a bitmap.
+ *
+ * The width and height are the largest size the image has been plotted
+ * at, or zero if a full size bitmap is required. The conversion may
+ * produce a bitmap smaller than the content but no smaller than this
+ * size.
+ *
+ * The source data is obtained by the cache on the browser thread.
+ *
+ * When built with thread support conversions may be run on a background
+ * decode thread. The conversion must only read the content and the
+ * source data it is passed, it must not obtain the source data from
+ * the content itself. The frontend bitmap create, get_buffer,
+ * get_rowstride and modified operations must be safe to call from
+ * that thread.
+ */
+typedef struct bitmap * (image_cache_convert_fn) (struct content *content,
+						  const char *data,
+						  unsigned long size,
+						  int width,
+						  int height);
 
 struct image_cache_parameters {
 	/** How frequently the background cache clean process is run (ms) */
@@ -155,6 +176,9 @@ int image_cache_snentryf(char *string, size_t size, unsigned int entryn,
  *     of times.
  * x The number of times the image that was converted (read missed cache) 
  *     highest number of times.
+ * y The number of conversions performed.
+ * z The total time in ms spent performing conversions.
+ * Z The longest time in ms taken by a single conversion.
  *
  * format modifiers:
  * A p before the value modifies the replacement to be a percentage.
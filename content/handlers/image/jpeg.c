@@ -55,7 +55,16 @@
 /* but we don't care if we're not on RISC OS */
 #endif
 
-static char nsjpeg_error_buffer[JMSG_LENGTH_MAX];
+/**
+ * Error handling context of a single decode.
+ *
+ * Decodes may run concurrently on background threads so nothing about
+ * an error is held globally.
+ */
+struct nsjpeg_error_ctx {
+	jmp_buf setjmp_buffer; /**< recovery point for fatal errors */
+	char message[JMSG_LENGTH_MAX]; /**< message of the fatal error */
+};
 
 static unsigned char nsjpeg_eoi[] = { 0xff, JPEG_EOI };
 
@@ -141,8 +150,10 @@ static void nsjpeg_term_source(j_decompress_ptr cinfo)
  */
 static void nsjpeg_error_log(j_common_ptr cinfo)
 {
-	cinfo->err->format_message(cinfo, nsjpeg_error_buffer);
-	NSLOG(netsurf, INFO, "%s", nsjpeg_error_buffer);
+	char buffer[JMSG_LENGTH_MAX];
+
+	cinfo->err->format_message(cinfo, buffer);
+	NSLOG(netsurf, INFO, "%s", buffer);
 }
 
 
@@ -153,22 +164,30 @@ static void nsjpeg_error_log(j_common_ptr cinfo)
  */
 static void nsjpeg_error_exit(j_common_ptr cinfo)
 {
-	jmp_buf *setjmp_buffer = (jmp_buf *) cinfo->client_data;
+	struct nsjpeg_error_ctx *ectx = cinfo->client_data;
 
-	cinfo->err->format_message(cinfo, nsjpeg_error_buffer);
-	NSLOG(netsurf, INFO, "%s", nsjpeg_error_buffer);
+	cinfo->err->format_message(cinfo, ectx->message);
+	NSLOG(netsurf, INFO, "%s", ectx->message);
 
-	longjmp(*setjmp_buffer, 1);
+	longjmp(ectx->setjmp_buffer, 1);
 }
 
+/**
+ * Convert JPEG source data into a bitmap.
+ *
+ * libjpeg DCT scaling is used to decode the image at the smallest
+ * available scale which is no smaller than the plotted size.
+ */
 static struct bitmap *
-jpeg_cache_convert(struct content *c)
+jpeg_cache_convert(struct content *c,
+		   const char *source_data,
+		   unsigned long source_size,
+		   int plot_width,
+		   int plot_height)
 {
-	uint8_t *source_data; /* Jpeg source data */
-	unsigned long source_size; /* length of Jpeg source data */
 	struct jpeg_decompress_struct cinfo;
 	struct jpeg_error_mgr jerr;
-	jmp_buf setjmp_buffer;
+	struct nsjpeg_error_ctx ectx;
 	unsigned int height;
 	unsigned int width;
 	struct bitmap * volatile bitmap = NULL;
@@ -183,9 +202,7 @@ jpeg_cache_convert(struct content *c)
 		jpeg_resync_to_restart,
 		nsjpeg_term_source };
 
-	/* obtain jpeg source data and perfom minimal sanity checks */
-	source_data = (uint8_t *)content__get_source_data(c, &source_size);
-
+	/* perfom minimal sanity checks on the jpeg source data */
 	if ((source_data == NULL) ||
 	    (source_size < MIN_JPEG_SIZE)) {
 		return NULL;
@@ -197,16 +214,16 @@ jpeg_cache_convert(struct content *c)
 	jerr.output_message = nsjpeg_error_log;
 
 	/* handler for fatal errors during decompression */
-	if (setjmp(setjmp_buffer)) {
+	if (setjmp(ectx.setjmp_buffer)) {
 		jpeg_destroy_decompress(&cinfo);
 		return bitmap;
 	}
 
-	cinfo.client_data = &setjmp_buffer;
+	cinfo.client_data = &ectx;
 	jpeg_create_decompress(&cinfo);
 
 	/* setup data source */
-	source_mgr.next_input_byte = source_data;
+	source_mgr.next_input_byte = (const uint8_t *) source_data;
 	source_mgr.bytes_in_buffer = source_size;
 	cinfo.src = &source_mgr;
 
@@ -217,6 +234,21 @@ jpeg_cache_convert(struct content *c)
 	cinfo.out_color_space = JCS_RGB;
 	cinfo.dct_method = JDCT_ISLOW;
 
+	/* scale down by up to 1/8 while remaining no smaller than the
+	 * plotted size.
+	 */
+	if ((plot_width > 0) && (plot_height > 0)) {
+		cinfo.scale_num = 1;
+		cinfo.scale_denom = 1;
+		while ((cinfo.scale_denom < 8) &&
+		       ((cinfo.image_width / (cinfo.scale_denom * 2)) >=
+			(unsigned int)plot_width) &&
+		       ((cinfo.image_height / (cinfo.scale_denom * 2)) >=
+			(unsigned int)plot_height)) {
+			cinfo.scale_denom *= 2;
+		}
+	}
+
 	/* commence the decompression, output parameters now valid */
 	jpeg_start_decompress(&cinfo);
 
@@ -280,7 +312,7 @@ static bool nsjpeg_convert(struct content *c)
 {
 	struct jpeg_decompress_struct cinfo;
 	struct jpeg_error_mgr jerr;
-	jmp_buf setjmp_buffer;
+	struct nsjpeg_error_ctx ectx;
 	struct jpeg_source_mgr source_mgr = { 0, 0,
 		nsjpeg_init_source, nsjpeg_fill_input_buffer,
 		nsjpeg_skip_input_data, jpeg_resync_to_restart,
@@ -297,15 +329,15 @@ static bool nsjpeg_convert(struct content *c)
 	jerr.error_exit = nsjpeg_error_exit;
 	jerr.output_message = nsjpeg_error_log;
 
-	if (setjmp(setjmp_buffer)) {
+	if (setjmp(ectx.setjmp_buffer)) {
 		jpeg_destroy_decompress(&cinfo);
 
-		msg_data.error = nsjpeg_error_buffer;
+		msg_data.error = ectx.message;
 		content_broadcast(c, CONTENT_MSG_ERROR, &msg_data);
 		return false;
 	}
 
-	cinfo.client_data = &setjmp_buffer;
+	cinfo.client_data = &ectx;
 	jpeg_create_decompress(&cinfo);
 	source_mgr.next_input_byte = (unsigned char *) data;
 	source_mgr.bytes_in_buffer = size;
@@ -421,12 +421,93 @@ static png_bytep *calc_row_pointers(struct bitmap *bitmap)
 	return row_ptrs;
 }
 
+/**
+ * Read a non-interlaced PNG into a bitmap reduced by a whole factor.
+ *
+ * Each output pixel is the average of a scale by scale block of image
+ * pixels. The colour channels are weighted by alpha so transparent
+ * pixels, whose colour is not visible, do not darken the result.
+ * Image rows and columns beyond a whole number of blocks are discarded.
+ *
+ * \param png_ptr The png read structure.
+ * \param bitmap The bitmap to fill.
+ * \param row Buffer for one image row.
+ * \param acc Accumulator for one output row of alpha weighted colour
+ *            sums and alpha sums.
+ * \param scale The reduction factor.
+ * \return true on success or false if the bitmap has no buffer.
+ */
+static bool
+png_cache_read_scaled(png_structp png_ptr,
+		      struct bitmap *bitmap,
+		      png_bytep row,
+		      uint64_t *acc,
+		      unsigned int scale)
+{
+	unsigned int width = guit->bitmap->get_width(bitmap);
+	unsigned int height = guit->bitmap->get_height(bitmap);
+	unsigned char *buffer = guit->bitmap->get_buffer(bitmap);
+	size_t rowstride = guit->bitmap->get_rowstride(bitmap);
+	unsigned int area = scale * scale;
+	unsigned char *out;
+	png_bytep in;
+	uint64_t *sum;
+	uint64_t alpha;
+	unsigned int y;
+	unsigned int x;
+
+	if (buffer == NULL) {
+		return false;
+	}
+
+	for (y = 0; y < height * scale; y++) {
+		png_read_row(png_ptr, row, NULL);
+
+		in = row;
+		for (x = 0; x < width * scale; x++) {
+			sum = acc + ((x / scale) * 4);
+			sum[0] += in[0] * in[3];
+			sum[1] += in[1] * in[3];
+			sum[2] += in[2] * in[3];
+			sum[3] += in[3];
+			in += 4;
+		}
+
+		if ((y % scale) == (scale - 1)) {
+			out = buffer + (rowstride * (y / scale));
+			sum = acc;
+			for (x = 0; x < width; x++) {
+				alpha = sum[3];
+				if (alpha == 0) {
+					out[0] = out[1] = out[2] = out[3] = 0;
+				} else {
+					out[0] = (sum[0] + alpha / 2) / alpha;
+					out[1] = (sum[1] + alpha / 2) / alpha;
+					out[2] = (sum[2] + alpha / 2) / alpha;
+					out[3] = (alpha + area / 2) / area;
+				}
+				sum[0] = sum[1] = sum[2] = sum[3] = 0;
+				out += 4;
+				sum += 4;
+			}
+		}
+	}
+
+	return true;
+}
+
 /** PNG content to bitmap conversion.
  *
- * This routine generates a bitmap object from a PNG image content
+ * This routine generates a bitmap object from a PNG image content.
+ * Non-interlaced images are reduced by the largest power of two factor
+ * which keeps the bitmap no smaller than the plotted size.
  */
 static struct bitmap *
-png_cache_convert(struct content *c)
+png_cache_convert(struct content *c,
+		  const char *data,
+		  unsigned long size,
+		  int plot_width,
+		  int plot_height)
 {
 	png_structp png_ptr;
 	png_infop info_ptr;
@@ -435,9 +516,12 @@ png_cache_convert(struct content *c)
 	struct png_cache_read_data_s png_cache_read_data;
 	png_uint_32 width, height;
 	volatile png_bytep * volatile row_pointers = NULL;
+	png_bytep volatile row = NULL;
+	uint64_t * volatile acc = NULL;
+	unsigned int scale = 1;
 
-	png_cache_read_data.data = 
-		content__get_source_data(c, &png_cache_read_data.size);
+	png_cache_read_data.data = data;
+	png_cache_read_data.size = size;
 
 	if ((png_cache_read_data.data == NULL) || 
 	    (png_cache_read_data.size <= 8)) {
@@ -480,6 +564,39 @@ png_cache_convert(struct content *c)
 	width = png_get_image_width(png_ptr, info_ptr);
 	height = png_get_image_height(png_ptr, info_ptr);
 
+	/* interlaced images must be read completely so are not scaled */
+	if ((plot_width > 0) && (plot_height > 0) &&
+	    (png_get_interlace_type(png_ptr, info_ptr) == PNG_INTERLACE_NONE)) {
+		while (((width / (scale * 2)) >= (png_uint_32)plot_width) &&
+		       ((height / (scale * 2)) >= (png_uint_32)plot_height)) {
+			scale *= 2;
+		}
+	}
+
+	if (scale > 1) {
+		bitmap = guit->bitmap->create(width / scale,
+					      height / scale,
+					      BITMAP_NEW);
+		if (bitmap == NULL) {
+			/* cleanup and bail */
+			goto png_cache_convert_error;
+		}
+
+		row = malloc(png_get_rowbytes(png_ptr, info_ptr));
+		acc = calloc((width / scale) * 4, sizeof(uint64_t));
+		if ((row == NULL) ||
+		    (acc == NULL) ||
+		    !png_cache_read_scaled(png_ptr,
+					   (struct bitmap *)bitmap,
+					   row,
+					   acc,
+					   scale)) {
+			guit->bitmap->destroy((struct bitmap *)bitmap);
+			bitmap = NULL;
+		}
+		goto png_cache_convert_error;
+	}
+
 	/* Claim the required memory for the converted PNG */
 	bitmap = guit->bitmap->create(width, height, BITMAP_NEW);
 	if (bitmap == NULL) {
@@ -505,6 +622,9 @@ png_cache_convert_error:
 		free((png_bytep *) row_pointers);
 	}
 
+	free(row);
+	free(acc);
+
 	if (bitmap != NULL) {
 		guit->bitmap->modified((struct bitmap *)bitmap);
 	}
@@ -34,6 +34,7 @@
 #include "netsurf/content.h"
 #include "desktop/gui_internal.h"
 
+#include "content/fetch.h"
 #include "content/mimesniff.h"
 #include "content/hlcache.h"
 
@@ -629,6 +630,39 @@ void hlcache_finalise(void)
 	llcache_finalise();
 }
 
+/* See hlcache.h for documentation */
+nserror hlcache_get_stats(struct hlcache_stats *stats)
+{
+	hlcache_entry *entry;
+	uint32_t users;
+
+	if (hlcache == NULL) {
+		return NSERROR_INIT_FAILED;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (entry = hlcache->content_list; entry != NULL; entry = entry->next) {
+		if (entry->content == NULL)
+			continue;
+
+		users = content_count_users(entry->content);
+
+		stats->content_count++;
+		stats->user_count += users;
+		if (users == 0) {
+			stats->unused_count++;
+		} else if (users > 1) {
+			stats->shared_count++;
+		}
+	}
+
+	stats->hit_count = hlcache->hit_count;
+	stats->miss_count = hlcache->miss_count;
+
+	return NSERROR_OK;
+}
+
 /* See hlcache.h for documentation */
 nserror hlcache_handle_retrieve(nsurl *url, uint32_t flags,
 		nsurl *referer, llcache_post_data *post,
@@ -664,6 +698,20 @@ nserror hlcache_handle_retrieve(nsurl *url, uint32_t flags,
 		ctx->child.quirks = child->quirks;
 	}
 
+	/* fetch priority follows from what the caller will accept
+	 * unless they have chosen one.
+	 */
+	if (((flags & LLCACHE_RETRIEVE_PRIORITY_MASK) == 0) &&
+	    (accepted_types != CONTENT_NONE)) {
+		if ((accepted_types & ~(CONTENT_CSS | CONTENT_SCRIPT)) == 0) {
+			flags |= LLCACHE_RETRIEVE_PRIORITY(
+					FETCH_PRIORITY_STYLE);
+		} else if ((accepted_types & ~CONTENT_IMAGE) == 0) {
+			flags |= LLCACHE_RETRIEVE_PRIORITY(
+					FETCH_PRIORITY_IMAGE);
+		}
+	}
+
 	ctx->flags = flags;
 	ctx->accepted_types = accepted_types;
 
@@ -51,6 +51,18 @@ struct hlcache_parameters {
 	struct llcache_parameters llcache;
 };
 
+/**
+ * Statistics of the high-level cache.
+ */
+struct hlcache_stats {
+	unsigned int content_count; /**< Number of contents */
+	unsigned int unused_count; /**< Contents with no users */
+	unsigned int shared_count; /**< Contents with more than one user */
+	unsigned int user_count; /**< Total users of all contents */
+	unsigned int hit_count; /**< Retrievals sharing an existing content */
+	unsigned int miss_count; /**< Retrievals creating a new content */
+};
+
 /**
  * Client callback for high-level cache events
  *
@@ -93,6 +105,15 @@ void hlcache_stop(void);
  */
 void hlcache_finalise(void);
 
+/**
+ * Get statistics of the high-level cache.
+ *
+ * \param stats The statistics to fill in.
+ * \return NSERROR_OK on success or NSERROR_INIT_FAILED if the cache is
+ *         not initialised.
+ */
+nserror hlcache_get_stats(struct hlcache_stats *stats);
+
 /**
  * Retrieve a high-level cache handle for an object
  *
@@ -45,6 +45,7 @@
 #include "utils/nsurl.h"
 #include "utils/utils.h"
 #include "utils/time.h"
+#include "utils/trace.h"
 #include "netsurf/misc.h"
 #include "desktop/gui_internal.h"
 
@@ -156,21 +157,70 @@ typedef enum {
 	LLCACHE_STATE_DISC, /**< source data is stored on disc */
 } llcache_store_state;
 
+/**
+ * Minimum size of a heap allocated source data segment.
+ */
+#define LLCACHE_SEGMENT_MIN_SIZE (64 * 1024)
+
+/**
+ * Release function for source data not allocated by the cache.
+ */
+typedef void (*llcache_segment_release_fn)(uint8_t *data, size_t len, void *pw);
+
+/**
+ * Segment of an objects source data.
+ *
+ * Source data is held as a list of segments so fetched data can be
+ * appended without moving the data already received and so regions
+ * owned by someone else, such as static resource data or a backing
+ * store allocation, can be used without copying.
+ */
+typedef struct llcache_segment {
+	struct llcache_segment *next; /**< Next segment of source data */
+
+	uint8_t *data;		/**< Segment data */
+	size_t len;		/**< Byte length of data in the segment */
+	size_t alloc;		/**< Heap allocation size, 0 if adopted */
+
+	llcache_segment_release_fn release; /**< Release for adopted data */
+	void *pw;		/**< Context for release function */
+} llcache_segment;
+
+/**
+ * Initial number of buckets in the object url index.
+ *
+ * This must be a power of two as the bucket is selected by masking
+ * the url hash.
+ */
+#define LLCACHE_URL_INDEX_INITIAL_SIZE 256
+
 /**
  * Low-level cache object
  *
- * \todo Consider whether a list is a sane container.
+ * Objects are kept on either the cached or uncached object list and
+ * are additionally indexed by url hash so retrieval does not have to
+ * scan the lists.
  */
 struct llcache_object {
 	llcache_object *prev;	     /**< Previous in list */
 	llcache_object *next;	     /**< Next in list */
+	llcache_object **list;	     /**< List the object is on or NULL */
+
+	llcache_object *index_next;  /**< Next in url index bucket */
+
+	llcache_object *lru_prev;    /**< Previous (less recently used) in LRU */
+	llcache_object *lru_next;    /**< Next (more recently used) in LRU */
+	size_t accounted_size;	     /**< Size counted in the cached total */
 
 	nsurl *url;		     /**< Post-redirect URL for object */
+	uint32_t url_hash;	     /**< Hash of url used by the index */
 
-	/** \todo We need a generic dynamic buffer object */
-	uint8_t *source_data;	     /**< Source data for object */
+	llcache_segment *source_head; /**< First segment of source data */
+	llcache_segment *source_tail; /**< Last segment of source data */
+	uint8_t *source_data;	     /**< Contiguous view of source data,
+				      * NULL if not present or segmented
+				      */
 	size_t source_len;	     /**< Byte length of source data */
-	size_t source_alloc;	     /**< Allocated size of source buffer */
 
 	llcache_store_state store_state; /**< where the data for the object is stored */
 
@@ -197,6 +247,14 @@ struct llcache_object {
 	time_t last_used; /**< time the last user was removed from the object */
 };
 
+/**
+ * Least recently used ordering of cached objects.
+ */
+struct llcache_lru {
+	llcache_object *head; /**< Least recently used object */
+	llcache_object *tail; /**< Most recently used object */
+};
+
 /**
  * Core llcache control context.
  */
@@ -213,6 +271,27 @@ struct llcache_s {
 	/** Head of the low-level uncached object list */
 	llcache_object *uncached_objects;
 
+	/** Url hash index over cached and uncached objects */
+	llcache_object **url_index;
+
+	/** Number of buckets in the url index, always a power of two */
+	size_t url_index_size;
+
+	/** Number of objects in the url index */
+	size_t url_index_count;
+
+	/** Some objects could not be indexed, lookups must scan the lists */
+	bool url_index_incomplete;
+
+	/** Cached objects whose source data is only held in RAM */
+	struct llcache_lru lru_ram;
+
+	/** Cached objects whose source data is in the backing store */
+	struct llcache_lru lru_disc;
+
+	/** Total RAM usage of all objects on the cached list */
+	size_t cached_size;
+
 	/** The target upper bound for the RAM cache size */
 	uint32_t limit;
 
@@ -260,6 +339,15 @@ struct llcache_s {
 	 */
 	uint64_t total_elapsed;
 
+
+	/* statistics */
+
+	unsigned int hit_count; /**< retrievals of fresh cached objects */
+	unsigned int store_count; /**< objects found in backing store */
+	unsigned int revalidate_count; /**< retrievals needing validation */
+	unsigned int notmodified_count; /**< validations found unmodified */
+	unsigned int miss_count; /**< retrievals needing a full fetch */
+	unsigned int uncachable_count; /**< retrievals never cached */
 };
 
 /** low level cache state */
@@ -271,6 +359,9 @@ static void llcache_fetch_callback(const fetch_msg *msg, void *p);
 /* forward referenced catch up function */
 static void llcache_users_not_caught_up(void);
 
+/* forward referenced LRU update function */
+static void llcache_lru_touch(llcache_object *object);
+
 
 /******************************************************************************
  * Low-level cache internals						      *
@@ -368,6 +459,8 @@ static nserror llcache_object_remove_user(llcache_object *object,
 		object->last_used = time(NULL);
 	}
 
+	llcache_lru_touch(object);
+
 	NSLOG(llcache, DEBUG, "Removing user %p from %p", user, object);
 
 	return NSERROR_OK;
@@ -411,6 +504,357 @@ static nserror llcache_send_event_to_users(llcache_object *object,
 	return error;
 }
 
+/**
+ * Release a source data segment
+ *
+ * \param seg The segment to release.
+ */
+static void llcache_segment_destroy(llcache_segment *seg)
+{
+	if (seg->alloc != 0) {
+		free(seg->data);
+	} else if (seg->release != NULL) {
+		seg->release(seg->data, seg->len, seg->pw);
+	}
+	free(seg);
+}
+
+/**
+ * Update the contiguous view of an objects source data
+ *
+ * \param object The object to update.
+ */
+static inline void llcache_source_update_view(llcache_object *object)
+{
+	if ((object->source_head != NULL) &&
+	    (object->source_head == object->source_tail)) {
+		object->source_data = object->source_head->data;
+	} else {
+		object->source_data = NULL;
+	}
+}
+
+/**
+ * Release all of an objects source data
+ *
+ * The source length is retained as it is still the length of the
+ * data held in the backing store.
+ *
+ * \param object The object to release the source data of.
+ */
+static void llcache_source_free(llcache_object *object)
+{
+	llcache_segment *seg, *next;
+
+	for (seg = object->source_head; seg != NULL; seg = next) {
+		next = seg->next;
+		llcache_segment_destroy(seg);
+	}
+
+	object->source_head = object->source_tail = NULL;
+	object->source_data = NULL;
+}
+
+/**
+ * Add a segment to the end of an objects source data
+ *
+ * \param object The object to add the segment to.
+ * \param seg The segment to add.
+ */
+static void llcache_source_link(llcache_object *object, llcache_segment *seg)
+{
+	seg->next = NULL;
+
+	if (object->source_tail != NULL) {
+		object->source_tail->next = seg;
+	} else {
+		object->source_head = seg;
+	}
+	object->source_tail = seg;
+
+	object->source_len += seg->len;
+
+	llcache_source_update_view(object);
+}
+
+/**
+ * Append a copy of some data to an objects source data
+ *
+ * Data is copied into the spare space of the last segment. When that
+ * is exhausted a new segment is allocated, sized in proportion to the
+ * data already received so the number of segments grows only
+ * logarithmically and no data is ever moved.
+ *
+ * \param object The object to append to.
+ * \param data The data to append.
+ * \param len The length of \a data.
+ * \return NSERROR_OK on success or NSERROR_NOMEM.
+ */
+static nserror
+llcache_source_append(llcache_object *object, const uint8_t *data, size_t len)
+{
+	llcache_segment *seg = object->source_tail;
+	size_t space;
+	size_t alloc;
+
+	if ((seg != NULL) && (seg->alloc != 0)) {
+		space = seg->alloc - seg->len;
+		if (space > len) {
+			space = len;
+		}
+		memcpy(seg->data + seg->len, data, space);
+		seg->len += space;
+		object->source_len += space;
+		data += space;
+		len -= space;
+	}
+
+	if (len == 0) {
+		return NSERROR_OK;
+	}
+
+	alloc = max(object->source_len, LLCACHE_SEGMENT_MIN_SIZE);
+	if (alloc < len) {
+		alloc = len;
+	}
+
+	seg = malloc(sizeof(llcache_segment));
+	if (seg == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	seg->data = malloc(alloc);
+	if (seg->data == NULL) {
+		free(seg);
+		return NSERROR_NOMEM;
+	}
+
+	memcpy(seg->data, data, len);
+	seg->len = len;
+	seg->alloc = alloc;
+	seg->release = NULL;
+	seg->pw = NULL;
+
+	llcache_source_link(object, seg);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Append data not owned by the cache to an objects source data
+ *
+ * The data is used in place and \a release is called once the
+ * cache no longer requires it.
+ *
+ * \param object The object to append to.
+ * \param data The data to adopt.
+ * \param len The length of \a data.
+ * \param release The function to release the data or NULL if the
+ *                data outlives the cache.
+ * \param pw The context for \a release.
+ * \return NSERROR_OK on success or NSERROR_NOMEM in which case the
+ *         data has been released.
+ */
+static nserror
+llcache_source_adopt(llcache_object *object,
+		     uint8_t *data,
+		     size_t len,
+		     llcache_segment_release_fn release,
+		     void *pw)
+{
+	llcache_segment *seg;
+
+	seg = malloc(sizeof(llcache_segment));
+	if (seg == NULL) {
+		if (release != NULL) {
+			release(data, len, pw);
+		}
+		return NSERROR_NOMEM;
+	}
+
+	seg->data = data;
+	seg->len = len;
+	seg->alloc = 0;
+	seg->release = release;
+	seg->pw = pw;
+
+	llcache_source_link(object, seg);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Check if any of an objects source data is not owned by the cache
+ *
+ * \param object The object to check.
+ * \return true if any source segment was adopted else false.
+ */
+static bool llcache_source_is_adopted(const llcache_object *object)
+{
+	const llcache_segment *seg;
+
+	for (seg = object->source_head; seg != NULL; seg = seg->next) {
+		if (seg->alloc == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Ensure an objects source data is held in a single segment
+ *
+ * \param object The object to make contiguous.
+ * \return NSERROR_OK on success or NSERROR_NOMEM.
+ */
+static nserror llcache_source_flatten(llcache_object *object)
+{
+	llcache_segment *seg, *next;
+	uint8_t *data;
+	size_t offset = 0;
+
+	if (object->source_head == object->source_tail) {
+		return NSERROR_OK;
+	}
+
+	NSLOG(llcache, DEBUG, "Flattening %p source of %"PRIsizet" bytes",
+	      object, object->source_len);
+
+	data = malloc(object->source_len);
+	if (data == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	/* first segment is reused to describe the new data */
+	seg = object->source_head;
+	memcpy(data, seg->data, seg->len);
+	offset = seg->len;
+
+	for (next = seg->next; next != NULL; next = seg->next) {
+		memcpy(data + offset, next->data, next->len);
+		offset += next->len;
+		seg->next = next->next;
+		llcache_segment_destroy(next);
+	}
+
+	if (seg->alloc != 0) {
+		free(seg->data);
+	} else if (seg->release != NULL) {
+		seg->release(seg->data, seg->len, seg->pw);
+	}
+
+	seg->data = data;
+	seg->len = object->source_len;
+	seg->alloc = object->source_len;
+	seg->release = NULL;
+	seg->pw = NULL;
+
+	object->source_tail = seg;
+	llcache_source_update_view(object);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Release unused space at the end of an objects source data
+ *
+ * \param object The object to trim.
+ */
+static void llcache_source_trim(llcache_object *object)
+{
+	llcache_segment *seg = object->source_tail;
+	uint8_t *temp;
+
+	if ((seg == NULL) || (seg->alloc == 0) || (seg->len == seg->alloc)) {
+		return;
+	}
+
+	/* If the length is 0, then temp may be NULL */
+	if (seg->len == 0) {
+		return;
+	}
+
+	temp = realloc(seg->data, seg->len);
+	if (temp != NULL) {
+		seg->data = temp;
+		seg->alloc = seg->len;
+		llcache_source_update_view(object);
+	}
+}
+
+/**
+ * Find the source data following an offset
+ *
+ * \param object The object to look in.
+ * \param offset The offset into the source data.
+ * \param len Updated with the length of contiguous data at the offset.
+ * \return The source data at \a offset.
+ */
+static const uint8_t *
+llcache_source_at(llcache_object *object, size_t offset, size_t *len)
+{
+	llcache_segment *seg;
+
+	for (seg = object->source_head; seg != NULL; seg = seg->next) {
+		if (offset < seg->len) {
+			*len = seg->len - offset;
+			return seg->data + offset;
+		}
+		offset -= seg->len;
+	}
+
+	*len = 0;
+	return NULL;
+}
+
+/**
+ * Discard the first segment of an objects source data
+ *
+ * Used when streaming where data is not retained once it has been
+ * delivered. The segment is kept for reuse if it is the only one.
+ *
+ * \param object The object to discard source data from.
+ */
+static void llcache_source_consume(llcache_object *object)
+{
+	llcache_segment *seg = object->source_head;
+
+	if (seg == NULL) {
+		return;
+	}
+
+	object->source_len -= seg->len;
+
+	if ((seg == object->source_tail) && (seg->alloc != 0)) {
+		seg->len = 0;
+		return;
+	}
+
+	object->source_head = seg->next;
+	if (object->source_head == NULL) {
+		object->source_tail = NULL;
+	}
+	llcache_segment_destroy(seg);
+
+	llcache_source_update_view(object);
+}
+
+/**
+ * Release source data adopted from the backing store
+ *
+ * \param data The source data.
+ * \param len The length of the source data.
+ * \param pw The object the data belongs to.
+ */
+static void
+llcache_source_release_store(uint8_t *data, size_t len, void *pw)
+{
+	llcache_object *object = pw;
+
+	guit->llcache->release(object->url, BACKING_STORE_NONE);
+}
+
 /**
  * Create a new low-level cache object
  *
@@ -427,6 +871,7 @@ static nserror llcache_object_new(nsurl *url, llcache_object **result)
 	NSLOG(llcache, DEBUG, "Created object %p (%s)", obj, nsurl_access(url));
 
 	obj->url = nsurl_ref(url);
+	obj->url_hash = nsurl_hash(url);
 
 	*result = obj;
 
@@ -788,6 +1233,25 @@ static nserror llcache_fetch_process_header(llcache_object *object,
 	return NSERROR_OK;
 }
 
+/**
+ * Get the fetch priority class selected by retrieval flags
+ *
+ * \param flags The retrieval flags.
+ * \return The priority class, documents if none was selected.
+ */
+static enum fetch_priority llcache_fetch_priority(uint32_t flags)
+{
+	uint32_t priority;
+
+	priority = (flags & LLCACHE_RETRIEVE_PRIORITY_MASK) >>
+		LLCACHE_RETRIEVE_PRIORITY_SHIFT;
+	if ((priority == 0) || (priority > FETCH_PRIORITY_COUNT)) {
+		return FETCH_PRIORITY_DOCUMENT;
+	}
+
+	return priority - 1;
+}
+
 /**
  * (Re)fetch an object
  *
@@ -878,6 +1342,7 @@ static nserror llcache_object_refetch(llcache_object *object)
 			  object->fetch.flags & LLCACHE_RETRIEVE_VERIFIABLE,
 			  object->fetch.tried_with_tls_downgrade,
 			  (const char **)headers,
+			  llcache_fetch_priority(object->fetch.flags),
 			  &object->fetch.fetch);
 
 	/* Clean up cache-control headers */
@@ -949,13 +1414,7 @@ static nserror llcache_object_destroy(llcache_object *object)
 	NSLOG(llcache, DEBUG, "Destroying object %p, %s", object,
 	      nsurl_access(object->url));
 
-	if (object->source_data != NULL) {
-		if (object->store_state == LLCACHE_STATE_DISC) {
-			guit->llcache->release(object->url, BACKING_STORE_NONE);
-		} else {
-			free(object->source_data);
-		}
-	}
+	llcache_source_free(object);
 
 	nsurl_unref(object->url);
 
@@ -986,9 +1445,352 @@ static nserror llcache_object_destroy(llcache_object *object)
 	}
 	free(object->headers);
 
-	free(object);
+	free(object);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Rebuild the url index from the object lists
+ *
+ * Used once an index can be allocated after objects were added without
+ * one, so those objects are indexed too.
+ *
+ * \param index  Empty index to fill
+ * \param size   Number of buckets in \a index
+ */
+static void llcache_url_index_rebuild(llcache_object **index, size_t size)
+{
+	llcache_object *lists[2] = {
+		llcache->cached_objects, llcache->uncached_objects
+	};
+	llcache_object *object;
+	size_t count = 0;
+	unsigned int list;
+
+	for (list = 0; list < 2; list++) {
+		for (object = lists[list]; object != NULL;
+		     object = object->next) {
+			object->index_next = index[object->url_hash & (size - 1)];
+			index[object->url_hash & (size - 1)] = object;
+			count++;
+		}
+	}
+
+	llcache->url_index_count = count;
+	llcache->url_index_incomplete = false;
+}
+
+/**
+ * Grow the url index
+ *
+ * The bucket count is doubled and every indexed object rehashed. If
+ * the allocation fails the existing index is kept, lookups remain
+ * correct but chains become longer.
+ */
+static void llcache_url_index_grow(void)
+{
+	llcache_object **index;
+	llcache_object *object, *next;
+	size_t size;
+	size_t bucket;
+
+	if (llcache->url_index_size == 0) {
+		size = LLCACHE_URL_INDEX_INITIAL_SIZE;
+	} else {
+		size = llcache->url_index_size * 2;
+	}
+
+	index = calloc(size, sizeof(llcache_object *));
+	if (index == NULL) {
+		return;
+	}
+
+	if (llcache->url_index_incomplete) {
+		llcache_url_index_rebuild(index, size);
+	} else {
+		for (bucket = 0; bucket < llcache->url_index_size; bucket++) {
+			for (object = llcache->url_index[bucket];
+			     object != NULL;
+			     object = next) {
+				next = object->index_next;
+				object->index_next =
+					index[object->url_hash & (size - 1)];
+				index[object->url_hash & (size - 1)] = object;
+			}
+		}
+	}
+
+	free(llcache->url_index);
+	llcache->url_index = index;
+	llcache->url_index_size = size;
+
+	NSLOG(llcache, DEBUG, "url index grown to %"PRIsizet" buckets", size);
+}
+
+/**
+ * Add a low-level cache object to the url index
+ *
+ * \param object  Object to add
+ */
+static void llcache_url_index_insert(llcache_object *object)
+{
+	llcache_object **bucket;
+
+	if (llcache->url_index_count >= llcache->url_index_size) {
+		bool rebuild = llcache->url_index_incomplete;
+
+		llcache_url_index_grow();
+		if (llcache->url_index_size == 0) {
+			/* no index could be created, lookups scan the
+			 * lists until one can be
+			 */
+			llcache->url_index_incomplete = true;
+			return;
+		}
+		if (rebuild && !llcache->url_index_incomplete) {
+			/* the object is already on its list so the
+			 * rebuild indexed it
+			 */
+			return;
+		}
+	}
+
+	bucket = &llcache->url_index[object->url_hash &
+				     (llcache->url_index_size - 1)];
+	object->index_next = *bucket;
+	*bucket = object;
+
+	llcache->url_index_count++;
+}
+
+/**
+ * Remove a low-level cache object from the url index
+ *
+ * \param object  Object to remove
+ */
+static void llcache_url_index_remove(llcache_object *object)
+{
+	llcache_object **link;
+
+	if (llcache->url_index_size == 0) {
+		return;
+	}
+
+	link = &llcache->url_index[object->url_hash &
+				   (llcache->url_index_size - 1)];
+	while (*link != NULL) {
+		if (*link == object) {
+			*link = object->index_next;
+			object->index_next = NULL;
+			llcache->url_index_count--;
+			return;
+		}
+		link = &(*link)->index_next;
+	}
+}
+
+/**
+ * Find the most recently requested object on a list with a given url
+ *
+ * \param url   The url to search for
+ * \param list  The list the object must be on
+ * \return The matching object with the newest request time or NULL
+ */
+static llcache_object *
+llcache_url_index_find(nsurl *url, llcache_object **list)
+{
+	llcache_object *object;
+	llcache_object *newest = NULL;
+	uint32_t hash;
+
+	hash = nsurl_hash(url);
+
+	if (llcache->url_index_incomplete) {
+		/* objects added without an index are only on the list */
+		for (object = *list; object != NULL; object = object->next) {
+			if ((object->url_hash == hash) &&
+			    (newest == NULL ||
+			     object->cache.req_time > newest->cache.req_time) &&
+			    nsurl_compare(object->url, url,
+					  NSURL_COMPLETE) == true) {
+				newest = object;
+			}
+		}
+		return newest;
+	}
+
+	if (llcache->url_index_size == 0) {
+		return NULL;
+	}
+
+	for (object = llcache->url_index[hash & (llcache->url_index_size - 1)];
+	     object != NULL;
+	     object = object->index_next) {
+		if ((object->list == list) &&
+		    (object->url_hash == hash) &&
+		    (newest == NULL ||
+		     object->cache.req_time > newest->cache.req_time) &&
+		    nsurl_compare(object->url, url, NSURL_COMPLETE) == true) {
+			newest = object;
+		}
+	}
+
+	return newest;
+}
+
+/**
+ * total ram usage of object
+ *
+ * \param object The object to calculate the total RAM usage of.
+ * \return The total RAM usage in bytes.
+ */
+static inline uint32_t
+total_object_size(llcache_object *object)
+{
+	uint32_t tot;
+	size_t hdrc;
+
+	tot = sizeof(*object);
+	tot += nsurl_length(object->url);
+
+	if (object->source_head != NULL) {
+		tot += object->source_len;
+	}
+
+	tot += sizeof(llcache_header) * object->num_headers;
+
+	for (hdrc = 0; hdrc < object->num_headers; hdrc++) {
+		if (object->headers[hdrc].name != NULL) {
+			tot += strlen(object->headers[hdrc].name);
+		}
+		if (object->headers[hdrc].value != NULL) {
+			tot += strlen(object->headers[hdrc].value);
+		}
+	}
+
+	return tot;
+}
+
+/**
+ * Get the LRU ordering a cached object belongs to
+ *
+ * \param object The object to get the ordering for.
+ * \return The LRU list selected by the objects store state.
+ */
+static inline struct llcache_lru *llcache_object_lru(llcache_object *object)
+{
+	if (object->store_state == LLCACHE_STATE_DISC) {
+		return &llcache->lru_disc;
+	}
+	return &llcache->lru_ram;
+}
+
+/**
+ * Append a low-level cache object to the most recently used end of an LRU
+ *
+ * \param lru	  LRU list to add to
+ * \param object  Object to add
+ */
+static void llcache_lru_insert(struct llcache_lru *lru, llcache_object *object)
+{
+	object->lru_next = NULL;
+	object->lru_prev = lru->tail;
+
+	if (lru->tail != NULL) {
+		lru->tail->lru_next = object;
+	} else {
+		lru->head = object;
+	}
+	lru->tail = object;
+}
+
+/**
+ * Remove a low-level cache object from an LRU
+ *
+ * \param lru	  LRU list to remove from
+ * \param object  Object to remove
+ */
+static void llcache_lru_remove(struct llcache_lru *lru, llcache_object *object)
+{
+	if (object->lru_prev != NULL) {
+		object->lru_prev->lru_next = object->lru_next;
+	} else {
+		lru->head = object->lru_next;
+	}
+
+	if (object->lru_next != NULL) {
+		object->lru_next->lru_prev = object->lru_prev;
+	} else {
+		lru->tail = object->lru_prev;
+	}
+
+	object->lru_prev = object->lru_next = NULL;
+}
+
+/**
+ * Mark a low-level cache object as most recently used
+ *
+ * \param object  Object which has been used
+ */
+static void llcache_lru_touch(llcache_object *object)
+{
+	struct llcache_lru *lru;
+
+	if (object->list != &llcache->cached_objects) {
+		return;
+	}
+
+	lru = llcache_object_lru(object);
+	if (lru->tail != object) {
+		llcache_lru_remove(lru, object);
+		llcache_lru_insert(lru, object);
+	}
+}
+
+/**
+ * Mark a low-level cache object as the first to be evicted
+ *
+ * \param object  Object which is no longer of value
+ */
+static void llcache_lru_demote(llcache_object *object)
+{
+	struct llcache_lru *lru;
+
+	if (object->list != &llcache->cached_objects) {
+		return;
+	}
+
+	lru = llcache_object_lru(object);
+	if (lru->head != object) {
+		llcache_lru_remove(lru, object);
+
+		object->lru_prev = NULL;
+		object->lru_next = lru->head;
+		lru->head->lru_prev = object;
+		lru->head = object;
+	}
+}
+
+/**
+ * Update the cached total with the current RAM usage of an object
+ *
+ * Only objects on the cached list are accounted, the uncached list
+ * is short lived and is summed when the cache is cleaned.
+ *
+ * \param object  Object whose size may have changed
+ */
+static void llcache_object_account(llcache_object *object)
+{
+	size_t size = 0;
+
+	if (object->list == &llcache->cached_objects) {
+		size = total_object_size(object);
+	}
 
-	return NSERROR_OK;
+	llcache->cached_size -= object->accounted_size;
+	llcache->cached_size += size;
+	object->accounted_size = size;
 }
 
 /**
@@ -1003,11 +1805,19 @@ static nserror llcache_object_add_to_list(llcache_object *object,
 {
 	object->prev = NULL;
 	object->next = *list;
+	object->list = list;
 
 	if (*list != NULL)
 		(*list)->prev = object;
 	*list = object;
 
+	llcache_url_index_insert(object);
+
+	if (list == &llcache->cached_objects) {
+		llcache_lru_insert(llcache_object_lru(object), object);
+		llcache_object_account(object);
+	}
+
 	return NSERROR_OK;
 }
 
@@ -1151,6 +1961,8 @@ static nserror llcache_object_clone_cache_data(llcache_object *source,
 static nserror
 llcache_object_remove_from_list(llcache_object *object, llcache_object **list)
 {
+	assert(object->list == list);
+
 	if (object == *list)
 		*list = object->next;
 	else
@@ -1159,6 +1971,15 @@ llcache_object_remove_from_list(llcache_object *object, llcache_object **list)
 	if (object->next != NULL)
 		object->next->prev = object->prev;
 
+	if (list == &llcache->cached_objects) {
+		llcache_lru_remove(llcache_object_lru(object), object);
+	}
+
+	object->list = NULL;
+	llcache_object_account(object);
+
+	llcache_url_index_remove(object);
+
 	return NSERROR_OK;
 }
 
@@ -1174,8 +1995,12 @@ llcache_object_remove_from_list(llcache_object *object, llcache_object **list)
  */
 static nserror llcache_persist_retrieve(llcache_object *object)
 {
+	nserror res;
+	uint8_t *data;
+	size_t len;
+
 	/* ensure the source data is present if necessary */
-	if ((object->source_data != NULL) ||
+	if ((object->source_head != NULL) ||
 	    (object->store_state != LLCACHE_STATE_DISC)) {
 		/* source data does not require retrieving from
 		 * persistent store.
@@ -1184,10 +2009,19 @@ static nserror llcache_persist_retrieve(llcache_object *object)
 	}
 
 	/* Source data for the object may be in the persistent store */
-	return guit->llcache->fetch(object->url,
-				    BACKING_STORE_NONE,
-				    &object->source_data,
-				    &object->source_len);
+	res = guit->llcache->fetch(object->url,
+				   BACKING_STORE_NONE,
+				   &data,
+				   &len);
+	if (res == NSERROR_OK) {
+		/* the backing store length is authoritative */
+		object->source_len = 0;
+		res = llcache_source_adopt(object, data, len,
+				llcache_source_release_store, object);
+		llcache_object_account(object);
+	}
+
+	return res;
 }
 
 /**
@@ -1481,9 +2315,6 @@ llcache_process_metadata(llcache_object *object)
 	/* update object on successful parse of metadata  */
 	object->source_len = source_length;
 
-	/** \todo really not sure this is right, nothing is allocated here? */
-	object->source_alloc = metadatalen;
-
 	object->cache.req_time = request_time;
 	object->cache.res_time = reponse_time;
 	object->cache.fin_time = completion_time;
@@ -1576,22 +2407,14 @@ llcache_object_retrieve_from_cache(nsurl *url,
 				   llcache_object **result)
 {
 	nserror error;
-	llcache_object *obj, *newest = NULL;
+	llcache_object *obj, *newest;
 
 	NSLOG(llcache, DEBUG, "Searching cache for %s flags:%x referer:%s post:%p",
 			nsurl_access(url), flags,
 			referer==NULL?"":nsurl_access(referer), post);
 
 	/* Search for the most recently fetched matching object */
-	for (obj = llcache->cached_objects; obj != NULL; obj = obj->next) {
-
-		if ((newest == NULL ||
-		     obj->cache.req_time > newest->cache.req_time) &&
-		    nsurl_compare(obj->url, url,
-				  NSURL_COMPLETE) == true) {
-			newest = obj;
-		}
-	}
+	newest = llcache_url_index_find(url, &llcache->cached_objects);
 
 	/* No viable object found in cache create one and attempt to
 	 * pull from persistent store.
@@ -1612,6 +2435,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 			 * will cause the normal object handling to be used.
 			 */
 			newest = obj;
+			llcache->store_count++;
 
 			/* Add new object to cached object list */
 			llcache_object_add_to_list(obj, &llcache->cached_objects);
@@ -1636,6 +2460,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 			/* source data was successfully retrieved from
 			 * persistent store
 			 */
+			llcache->hit_count++;
 			*result = newest;
 
 			return NSERROR_OK;
@@ -1691,6 +2516,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 			/* Add new object to cache */
 			llcache_object_add_to_list(obj, &llcache->cached_objects);
 
+			llcache->revalidate_count++;
 			*result = obj;
 
 			return NSERROR_OK;
@@ -1722,6 +2548,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 	/* Add new object to cache */
 	llcache_object_add_to_list(obj, &llcache->cached_objects);
 
+	llcache->miss_count++;
 	*result = obj;
 
 	return NSERROR_OK;
@@ -1807,6 +2634,8 @@ llcache_object_retrieve(nsurl *url,
 
 		/* Add new object to uncached list */
 		llcache_object_add_to_list(obj, &llcache->uncached_objects);
+
+		llcache->uncachable_count++;
 	} else {
 		error = llcache_object_retrieve_from_cache(defragmented_url,
 				flags, referer, post, redirect_count, &obj);
@@ -1851,6 +2680,8 @@ static nserror llcache_object_add_user(llcache_object *object,
 		object->users->prev = user;
 	object->users = user;
 
+	llcache_lru_touch(object);
+
 	NSLOG(llcache, DEBUG, "Adding user %p to %p", user, object);
 
 	return NSERROR_OK;
@@ -2018,6 +2849,8 @@ static nserror llcache_fetch_notmodified(llcache_object *object,
 	if (object->candidate != NULL) {
 		llcache_object_user *user, *next;
 
+		llcache->notmodified_count++;
+
 		/* Move user(s) to candidate content */
 		for (user = object->users; user != NULL; user = next) {
 			next = user->next;
@@ -2059,7 +2892,10 @@ static nserror llcache_fetch_notmodified(llcache_object *object,
 	/* Mark it complete */
 	object->fetch.state = LLCACHE_FETCH_COMPLETE;
 
-	/* Old object will be flushed from the cache on the next poll */
+	/* Old object will be flushed from the cache on the next clean */
+	if (*replacement != object) {
+		llcache_lru_demote(object);
+	}
 
 	return NSERROR_OK;
 }
@@ -2067,15 +2903,15 @@ static nserror llcache_fetch_notmodified(llcache_object *object,
 /**
  * Process a chunk of fetched data
  *
+ * Data from a FETCH_DATA message is copied into the objects source
+ * while the buffer of a FETCH_DATA_ADOPT message is used in place.
+ *
  * \param object  Object being fetched
- * \param data	  Data to process
- * \param len	  Byte length of data
+ * \param msg	  The fetch data message
  * \return NSERROR_OK on success, appropriate error otherwise.
  */
 static nserror
-llcache_fetch_process_data(llcache_object *object,
-			   const uint8_t *data,
-			   size_t len)
+llcache_fetch_process_data(llcache_object *object, const fetch_msg *msg)
 {
 	if (object->fetch.state != LLCACHE_FETCH_DATA) {
 		/**
@@ -2111,22 +2947,17 @@ llcache_fetch_process_data(llcache_object *object,
 		object->fetch.state = LLCACHE_FETCH_DATA;
 	}
 
-	/* Resize source buffer if it's too small */
-	if (object->source_len + len >= object->source_alloc) {
-		const size_t new_len = object->source_len + len + 64 * 1024;
-		uint8_t *temp = realloc(object->source_data, new_len);
-		if (temp == NULL)
-			return NSERROR_NOMEM;
-
-		object->source_data = temp;
-		object->source_alloc = new_len;
+	if (msg->type == FETCH_DATA_ADOPT) {
+		return llcache_source_adopt(object,
+					    msg->data.adopt.buf,
+					    msg->data.adopt.len,
+					    msg->data.adopt.release,
+					    msg->data.adopt.pw);
 	}
 
-	/* Append this data chunk to source buffer */
-	memcpy(object->source_data + object->source_len, data, len);
-	object->source_len += len;
-
-	return NSERROR_OK;
+	return llcache_source_append(object,
+				     msg->data.header_or_data.buf,
+				     msg->data.header_or_data.len);
 }
 
 /**
@@ -2344,7 +3175,7 @@ static nserror llcache_fetch_ssl_error(llcache_object *object)
 static nserror
 build_candidate_list(struct llcache_object ***lst_out, int *lst_len_out)
 {
-	llcache_object *object, *next;
+	llcache_object *object;
 	struct llcache_object **lst;
 	int lst_len = 0;
 	int remaining_lifetime;
@@ -2356,21 +3187,27 @@ build_candidate_list(struct llcache_object ***lst_out, int *lst_len_out)
 		return NSERROR_NOMEM;
 	}
 
-	for (object = llcache->cached_objects; object != NULL; object = next) {
-		next = object->next;
-
+	/* Objects only held in RAM are considered from most to least
+	 * recently used so the most valuable objects are written first.
+	 */
+	for (object = llcache->lru_ram.tail;
+	     object != NULL;
+	     object = object->lru_prev) {
 		remaining_lifetime = llcache_object_rfc2616_remaining_lifetime(
 				&object->cache);
 
 		/* cacehable objects with no pending fetches, not
 		 * already on disc and with sufficient lifetime to
-		 * make disc cache worthwhile
+		 * make disc cache worthwhile. Objects holding data
+		 * adopted from a fetcher are skipped, the data
+		 * cannot be passed to the backing store and is
+		 * cheap to fetch again.
 		 */
 		if ((object->candidate_count == 0) &&
 		    (object->fetch.fetch == NULL) &&
 		    (object->fetch.outstanding_query == false) &&
-		    (object->store_state == LLCACHE_STATE_RAM) &&
-		    (remaining_lifetime > llcache->minimum_lifetime)) {
+		    (remaining_lifetime > llcache->minimum_lifetime) &&
+		    (llcache_source_is_adopted(object) == false)) {
 			lst[lst_len] = object;
 			lst_len++;
 			if (lst_len == MAX_PERSIST_PER_RUN)
@@ -2383,8 +3220,6 @@ build_candidate_list(struct llcache_object ***lst_out, int *lst_len_out)
 		return NSERROR_NOT_FOUND;
 	}
 
-	/** \todo sort list here */
-
 	*lst_len_out = lst_len;
 	*lst_out = lst;
 
@@ -2414,6 +3249,16 @@ write_backing_store(struct llcache_object *object,
 
 	nsu_getmonotonic_ms(&startms);
 
+	/* the backing store requires a single heap allocation */
+	ret = llcache_source_flatten(object);
+	if (ret != NSERROR_OK) {
+		return ret;
+	}
+	if ((object->source_head == NULL) ||
+	    (object->source_head->alloc == 0)) {
+		return NSERROR_INVALID;
+	}
+
 	/* put object data in backing store */
 	ret = guit->llcache->store(object->url,
 				   BACKING_STORE_NONE,
@@ -2424,6 +3269,11 @@ write_backing_store(struct llcache_object *object,
 		return ret;
 	}
 
+	/* the backing store now owns the source data allocation */
+	object->source_head->alloc = 0;
+	object->source_head->release = llcache_source_release_store;
+	object->source_head->pw = object;
+
 	ret = llcache_serialise_metadata(object, &metadata, &metadatasize);
 	if (ret != NSERROR_OK) {
 		/* There has been a metadata serialisation error. Ensure the
@@ -2447,7 +3297,14 @@ write_backing_store(struct llcache_object *object,
 	}
 	nsu_getmonotonic_ms(&endms);
 
-	object->store_state = LLCACHE_STATE_DISC;
+	/* move the object to the persisted LRU */
+	if (object->list == &llcache->cached_objects) {
+		llcache_lru_remove(&llcache->lru_ram, object);
+		object->store_state = LLCACHE_STATE_DISC;
+		llcache_lru_insert(&llcache->lru_disc, object);
+	} else {
+		object->store_state = LLCACHE_STATE_DISC;
+	}
 
 	*written_out = object->source_len + metadatasize;
 
@@ -2518,9 +3375,12 @@ static void llcache_persist(void *p)
 	unsigned long total_elapsed = 1; /* total ms used to write bytes */
 	unsigned long total_bandwidth = 0; /* total bandwidth */
 
+	NSTRACE_BEGIN("llcache persist");
+
 	ret = build_candidate_list(&lst, &lst_count);
 	if (ret != NSERROR_OK) {
 		NSLOG(llcache, DEBUG, "Unable to construct candidate list for persistent writeout");
+		NSTRACE_END("llcache persist");
 		return;
 	}
 
@@ -2610,6 +3470,8 @@ static void llcache_persist(void *p)
 
 	NSLOG(llcache, DEBUG, "Rescheduling writeout in %dms", next);
 	guit->misc->schedule(next, llcache_persist, NULL);
+
+	NSTRACE_END("llcache persist");
 }
 
 
@@ -2635,6 +3497,7 @@ static void llcache_fetch_callback(const fetch_msg *msg, void *p)
 		error = llcache_fetch_process_header(object,
 				msg->data.header_or_data.buf,
 				msg->data.header_or_data.len);
+		llcache_object_account(object);
 		break;
 
 	/* 3xx responses */
@@ -2657,27 +3520,19 @@ static void llcache_fetch_callback(const fetch_msg *msg, void *p)
 
 	/* Normal 2xx state machine */
 	case FETCH_DATA:
+	case FETCH_DATA_ADOPT:
 		/* Received some data */
-		error = llcache_fetch_process_data(object,
-				msg->data.header_or_data.buf,
-				msg->data.header_or_data.len);
+		error = llcache_fetch_process_data(object, msg);
+		llcache_object_account(object);
 		break;
 	case FETCH_FINISHED:
 		/* Finished fetching */
 	{
-		uint8_t *temp;
-
 		object->fetch.state = LLCACHE_FETCH_COMPLETE;
 		object->fetch.fetch = NULL;
 
 		/* Shrink source buffer to required size */
-		temp = realloc(object->source_data,
-				object->source_len);
-		/* If source_len is 0, then temp may be NULL */
-		if (temp != NULL || object->source_len == 0) {
-			object->source_data = temp;
-			object->source_alloc = object->source_len;
-		}
+		llcache_source_trim(object);
 
 		llcache_object_cache_update(object);
 
@@ -2826,16 +3681,9 @@ static llcache_object_user *llcache_object_find_user(
  * \return True if object resides in list, false otherwise
  */
 static bool llcache_object_in_list(const llcache_object *object,
-		const llcache_object *list)
+		llcache_object **list)
 {
-	while (list != NULL) {
-		if (list == object)
-			break;
-
-		list = list->next;
-	}
-
-	return list != NULL;
+	return object->list == list;
 }
 
 /**
@@ -2971,30 +3819,45 @@ static nserror llcache_object_notify_users(llcache_object *object)
 				objstate >= LLCACHE_FETCH_DATA &&
 				object->source_len > handle->bytes) {
 			size_t orig_handle_read;
+			bool streaming;
 
-			/* Construct HAD_DATA event */
+			/* Construct HAD_DATA event from the source
+			 * segment holding the next unread byte.
+			 */
 			event.type = LLCACHE_EVENT_HAD_DATA;
-			event.data.data.buf =
-					object->source_data + handle->bytes;
-			event.data.data.len =
-					object->source_len - handle->bytes;
+			event.data.data.buf = llcache_source_at(object,
+					handle->bytes,
+					&event.data.data.len);
+
+			if (handle->bytes + event.data.data.len <
+					object->source_len) {
+				/* remaining segments are sent on the
+				 * next catch up */
+				llcache_users_not_caught_up();
+			}
 
 			/* Update record of last byte emitted */
-			if (object->fetch.flags &
-					LLCACHE_RETRIEVE_STREAM_DATA) {
+			streaming = ((object->fetch.flags &
+				      LLCACHE_RETRIEVE_STREAM_DATA) != 0);
+			if (streaming) {
 				/* Streaming, so reset to zero to
 				 * minimise amount of cached source data.
 				 * Additionally, we don't support replay
 				 * when streaming. */
 				orig_handle_read = 0;
-				handle->bytes = object->source_len = 0;
+				handle->bytes = 0;
 			} else {
 				orig_handle_read = handle->bytes;
-				handle->bytes = object->source_len;
+				handle->bytes += event.data.data.len;
 			}
 
 			/* Emit event */
 			error = handle->cb(handle, &event, handle->pw);
+
+			if (streaming) {
+				/* delivered source is no longer required */
+				llcache_source_consume(object);
+			}
 			if (user->queued_for_delete) {
 				next_user = user->next;
 				llcache_object_remove_user(object, user);
@@ -3088,16 +3951,17 @@ llcache_object_snapshot(llcache_object *object,	llcache_object **snapshot)
 	if (error != NSERROR_OK)
 		return error;
 
-	newobj->source_alloc = newobj->source_len = object->source_len;
-
 	if (object->source_len > 0) {
-		newobj->source_data = malloc(newobj->source_alloc);
-		if (newobj->source_data == NULL) {
-			llcache_object_destroy(newobj);
-			return NSERROR_NOMEM;
+		llcache_segment *seg;
+
+		for (seg = object->source_head; seg != NULL; seg = seg->next) {
+			if (llcache_source_append(newobj, seg->data,
+					seg->len) != NSERROR_OK) {
+				llcache_object_destroy(newobj);
+				return NSERROR_NOMEM;
+			}
 		}
-		memcpy(newobj->source_data, object->source_data,
-				newobj->source_len);
+		llcache_source_trim(newobj);
 	}
 
 	if (object->num_headers > 0) {
@@ -3129,59 +3993,99 @@ llcache_object_snapshot(llcache_object *object,	llcache_object **snapshot)
 	return NSERROR_OK;
 }
 
+/******************************************************************************
+ * Public API								      *
+ ******************************************************************************/
+
 /**
- * total ram usage of object
+ * Evict objects from one of the cached object LRU orderings
  *
- * \param object The object to calculate the total RAM usage of.
- * \return The total RAM usage in bytes.
+ * Objects are considered from least to most recently used. While the
+ * cache exceeds its limit every unused object is discarded, once
+ * within the limit only the leading run of stale unused objects is
+ * removed. Objects still in use are skipped so in steady state only
+ * the objects being evicted are visited.
+ *
+ * \param lru The LRU ordering to evict from.
+ * \param limit The target cache size.
+ * \param llcache_size The current cache size, updated on return.
  */
-static inline uint32_t
-total_object_size(llcache_object *object)
+static void
+llcache_clean_lru(struct llcache_lru *lru, size_t limit, size_t *llcache_size)
 {
-	uint32_t tot;
-	size_t hdrc;
+	llcache_object *object, *next;
+	int remaining_lifetime;
 
-	tot = sizeof(*object);
-	tot += nsurl_length(object->url);
+	for (object = lru->head; object != NULL; object = next) {
+		next = object->lru_next;
 
-	if (object->source_data != NULL) {
-		tot += object->source_len;
-	}
+		if ((object->users != NULL) ||
+		    (object->candidate_count != 0) ||
+		    (object->fetch.fetch != NULL) ||
+		    (object->fetch.outstanding_query == true)) {
+			/* object in use */
+			if (limit >= *llcache_size) {
+				break;
+			}
+			continue;
+		}
 
-	tot += sizeof(llcache_header) * object->num_headers;
+		remaining_lifetime = llcache_object_rfc2616_remaining_lifetime(
+				&object->cache);
 
-	for (hdrc = 0; hdrc < object->num_headers; hdrc++) {
-		if (object->headers[hdrc].name != NULL) {
-			tot += strlen(object->headers[hdrc].name);
-		}
-		if (object->headers[hdrc].value != NULL) {
-			tot += strlen(object->headers[hdrc].value);
+		if (remaining_lifetime <= 0) {
+			/* object is stale */
+			NSLOG(llcache, DEBUG, "discarding stale cacheable object with no "
+					"users or pending fetches (%p) %s",
+					object, nsurl_access(object->url));
+
+			if (object->store_state == LLCACHE_STATE_DISC) {
+				guit->llcache->invalidate(object->url);
+			}
+		} else if (limit < *llcache_size) {
+			/* fresh object while the cache exceeds its limit */
+			NSLOG(llcache, DEBUG,
+			      "discarding %s object len:%zd age:%ld (%p) %s",
+			      (object->store_state == LLCACHE_STATE_DISC) ?
+			      "backed" : "fresh",
+			      object->source_len,
+			      (long)(time(NULL) - object->last_used),
+			      object,
+			      nsurl_access(object->url));
+		} else {
+			/* remaining objects are more recently used */
+			break;
 		}
-	}
 
-	return tot;
-}
+		*llcache_size -= object->accounted_size;
 
-/******************************************************************************
- * Public API								      *
- ******************************************************************************/
+		llcache_object_remove_from_list(object,
+				&llcache->cached_objects);
+		llcache_object_destroy(object);
+	}
+}
 
 /*
  * Attempt to clean the cache
  *
- * The memory cache cleaning discards objects in order of increasing value.
+ * The memory cache cleaning discards objects in order of increasing
+ * value. Objects whose source data is already in the backing store
+ * are cheapest to replace so they are evicted before objects which
+ * would require a network fetch. Within each group the least
+ * recently used objects are evicted first.
  *
  * Exported interface documented in llcache.h
  */
 void llcache_clean(bool purge)
 {
 	llcache_object *object, *next;
-	uint32_t llcache_size = 0;
-	int remaining_lifetime;
-	uint32_t limit;
+	size_t llcache_size = 0;
+	size_t limit;
 
 	NSLOG(llcache, DEBUG, "Attempting cache clean");
 
+	NSTRACE_BEGIN("llcache clean");
+
 	/* If the cache is being purged set the size limit to zero. */
 	if (purge) {
 		limit = 0;
@@ -3211,40 +4115,8 @@ void llcache_clean(bool purge)
 		}
 	}
 
-
-	/* Stale cacheable objects with no users or pending fetches */
-	for (object = llcache->cached_objects;
-	     object != NULL;
-	     object = next) {
-		next = object->next;
-
-		remaining_lifetime = llcache_object_rfc2616_remaining_lifetime(
-				&object->cache);
-
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->fetch.outstanding_query == false) &&
-		    (remaining_lifetime <= 0)) {
-			/* object is stale */
-			NSLOG(llcache, DEBUG, "discarding stale cacheable object with no "
-					"users or pending fetches (%p) %s",
-					object, nsurl_access(object->url));
-
-				llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
-
-				if (object->store_state == LLCACHE_STATE_DISC) {
-					guit->llcache->invalidate(object->url);
-				}
-
-				llcache_object_destroy(object);
-
-		} else {
-			/* object has users so account for the storage */
-			llcache_size += total_object_size(object);
-		}
-	}
+	/* cacheable objects are accounted as they change */
+	llcache_size += llcache->cached_size;
 
 	/* if the cache limit is exceeded try to make some objects
 	 * persistent so their RAM can be reclaimed in the next
@@ -3254,92 +4126,21 @@ void llcache_clean(bool purge)
 		llcache_persist(NULL);
 	}
 
-	/* Source data of fresh cacheable objects with no users, no
-	 * pending fetches and pushed to persistent store while the
-	 * cache exceeds the configured size.
-	 */
-	for (object = llcache->cached_objects;
-	     ((limit < llcache_size) && (object != NULL));
-	     object = next) {
-		next = object->next;
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->fetch.outstanding_query == false) &&
-		    (object->store_state == LLCACHE_STATE_DISC)) {
-			guit->llcache->release(object->url, BACKING_STORE_NONE);
-
-			object->source_data = NULL;
-
-			llcache_size -=	object->source_len;
-
-			NSLOG(llcache, DEBUG, "Freeing source data for %p len:%zd",
-				     object,
-				     object->source_len);
-		}
-	}
-
-	/* Fresh cacheable objects with no users, no pending fetches
-	 * and pushed to persistent store while the cache exceeds
-	 * the configured size. Effectively just the llcache object metadata.
+	/* Objects pushed to persistent store, replacing these only
+	 * requires reading them back.
 	 */
-	for (object = llcache->cached_objects;
-	     ((limit < llcache_size) && (object != NULL));
-	     object = next) {
-		next = object->next;
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->fetch.outstanding_query == false) &&
-		    (object->store_state == LLCACHE_STATE_DISC) &&
-		    (object->source_data == NULL)) {
-			NSLOG(llcache, DEBUG,
-			     "discarding backed object len:%zd age:%ld (%p) %s",
-			      object->source_len,
-			      (long)(time(NULL) - object->last_used),
-			      object,
-			      nsurl_access(object->url));
-
-			llcache_size -=	total_object_size(object);
-
-			llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
-			llcache_object_destroy(object);
+	llcache_clean_lru(&llcache->lru_disc, limit, &llcache_size);
 
-		}
-	}
-
-	/* Fresh cacheable objects with no users or pending fetches
-	 * while the cache exceeds the configured size. These are the
-	 * most valuable objects as replacing them is a full network
-	 * fetch
+	/* Objects only held in RAM. These are the most valuable
+	 * objects as replacing them is a full network fetch
 	 */
-	for (object = llcache->cached_objects;
-	     ((limit < llcache_size) && (object != NULL));
-	     object = next) {
-		next = object->next;
-
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->fetch.outstanding_query == false) &&
-		    (object->store_state == LLCACHE_STATE_RAM)) {
-			NSLOG(llcache, DEBUG,
-			      "discarding fresh object len:%zd age:%ld (%p) %s",
-			      object->source_len,
-			      (long)(time(NULL) - object->last_used),
-			      object,
-			      nsurl_access(object->url));
+	llcache_clean_lru(&llcache->lru_ram, limit, &llcache_size);
 
-			llcache_size -=	object->source_len + sizeof(*object);
+	NSLOG(llcache, DEBUG, "Size: %"PRIsizet" (limit: %"PRIsizet")",
+	      llcache_size, limit);
 
-			llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
-			llcache_object_destroy(object);
-		}
-	}
-
-	NSLOG(llcache, DEBUG, "Size: %u (limit: %u)", llcache_size, limit);
+	NSTRACE_COUNTER("llcache size", llcache_size);
+	NSTRACE_END("llcache clean");
 }
 
 /* Exported interface documented in content/llcache.h */
@@ -3370,6 +4171,64 @@ llcache_initialise(const struct llcache_parameters *prm)
 }
 
 
+/* Exported interface documented in content/llcache.h */
+nserror llcache_get_stats(struct llcache_stats *stats)
+{
+	llcache_object *object;
+
+	if (llcache == NULL) {
+		return NSERROR_INIT_FAILED;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (object = llcache->cached_objects;
+	     object != NULL;
+	     object = object->next) {
+		stats->cached_count++;
+		if (object->store_state == LLCACHE_STATE_DISC) {
+			stats->disc_count++;
+		} else {
+			stats->ram_count++;
+		}
+	}
+
+	for (object = llcache->uncached_objects;
+	     object != NULL;
+	     object = object->next) {
+		stats->uncached_count++;
+	}
+
+	stats->size = llcache->cached_size;
+	stats->limit = llcache->limit;
+
+	stats->hit_count = llcache->hit_count;
+	stats->store_count = llcache->store_count;
+	stats->revalidate_count = llcache->revalidate_count;
+	stats->notmodified_count = llcache->notmodified_count;
+	stats->miss_count = llcache->miss_count;
+	stats->uncachable_count = llcache->uncachable_count;
+
+	stats->total_written = llcache->total_written;
+	stats->total_elapsed = llcache->total_elapsed;
+	stats->minimum_bandwidth = llcache->minimum_bandwidth;
+	stats->maximum_bandwidth = llcache->maximum_bandwidth;
+
+	return NSERROR_OK;
+}
+
+
+/* Exported interface documented in content/llcache.h */
+nserror llcache_get_store_stats(struct llcache_store_stats *stats)
+{
+	if (guit->llcache->stats == NULL) {
+		return NSERROR_NOT_IMPLEMENTED;
+	}
+
+	return guit->llcache->stats(stats);
+}
+
+
 /* Exported interface documented in content/llcache.h */
 void llcache_finalise(void)
 {
@@ -3418,6 +4277,8 @@ void llcache_finalise(void)
 		llcache_object_destroy(object);
 	}
 
+	free(llcache->url_index);
+
 	/* backing store finalisation */
 	guit->llcache->finalise();
 
@@ -3641,7 +4502,7 @@ nserror llcache_handle_force_stream(llcache_handle *handle)
 		return NSERROR_OK;
 
 	/* Forcibly uncache this object */
-	if (llcache_object_in_list(object, llcache->cached_objects)) {
+	if (llcache_object_in_list(object, &llcache->cached_objects)) {
 		llcache_object_remove_from_list(object,
 				&llcache->cached_objects);
 		llcache_object_add_to_list(object, &llcache->uncached_objects);
@@ -3674,9 +4535,22 @@ nsurl *llcache_handle_get_url(const llcache_handle *handle)
 const uint8_t *llcache_handle_get_source_data(const llcache_handle *handle,
 		size_t *size)
 {
-	*size = handle->object != NULL ? handle->object->source_len : 0;
+	llcache_object *object = handle->object;
+
+	if (object == NULL) {
+		*size = 0;
+		return NULL;
+	}
+
+	/* provide a contiguous view of segmented source data */
+	if (llcache_source_flatten(object) != NSERROR_OK) {
+		*size = 0;
+		return NULL;
+	}
+
+	*size = object->source_len;
 
-	return handle->object != NULL ? handle->object->source_data : NULL;
+	return object->source_data;
 }
 
 /* See llcache.h for documentation */
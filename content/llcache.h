@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "utils/errors.h"
 #include "utils/nsurl.h"
@@ -102,6 +103,21 @@ enum llcache_retrieve_flag {
 	LLCACHE_RETRIEVE_STREAM_DATA    = (1 << 3)
 };
 
+/**
+ * Position of the fetch priority class in the retrieval flags.
+ *
+ * The three bits hold one more than a ::fetch_priority, or zero when
+ * the caller has not chosen one.
+ */
+#define LLCACHE_RETRIEVE_PRIORITY_SHIFT 4
+
+/** Retrieval flag bits holding the fetch priority class */
+#define LLCACHE_RETRIEVE_PRIORITY_MASK (7 << LLCACHE_RETRIEVE_PRIORITY_SHIFT)
+
+/** Retrieval flags selecting the ::fetch_priority class \a p */
+#define LLCACHE_RETRIEVE_PRIORITY(p) \
+	((((uint32_t)(p)) + 1) << LLCACHE_RETRIEVE_PRIORITY_SHIFT)
+
 /** Low-level cache query types */
 typedef enum {
 	LLCACHE_QUERY_AUTH,		/**< Need authentication details */
@@ -236,6 +252,66 @@ struct llcache_parameters {
 	struct llcache_store_parameters store;
 };
 
+/** Number of recent evictions kept in the backing store statistics */
+#define LLCACHE_STORE_EVICT_HISTORY 8
+
+/**
+ * A backing store eviction.
+ */
+struct llcache_store_evict {
+	time_t time; /**< Time the eviction happened */
+	unsigned int entries; /**< Number of entries removed */
+	size_t size; /**< Number of bytes removed */
+};
+
+/**
+ * Statistics of the low level cache backing store.
+ */
+struct llcache_store_stats {
+	size_t limit; /**< The upper bound target size */
+	uint64_t size; /**< Total size of the stored data */
+
+	unsigned int entries; /**< Number of entries in use */
+	unsigned int entry_limit; /**< Number of entries available */
+
+	unsigned int data_blocks; /**< Number of data blocks in use */
+	unsigned int meta_blocks; /**< Number of metadata blocks in use */
+	unsigned int block_limit; /**< Number of blocks available of each */
+
+	size_t hit_count; /**< Number of successful fetches */
+	uint64_t hit_size; /**< Size of data fetched */
+	size_t miss_count; /**< Number of unsuccessful fetches */
+
+	unsigned int evict_count; /**< Number of evictions */
+	/** The most recent evictions, newest first */
+	struct llcache_store_evict evict[LLCACHE_STORE_EVICT_HISTORY];
+};
+
+/**
+ * Statistics of the low level cache.
+ */
+struct llcache_stats {
+	unsigned int cached_count; /**< Number of cached objects */
+	unsigned int uncached_count; /**< Number of uncached objects */
+	unsigned int ram_count; /**< Cached objects with source in RAM */
+	unsigned int disc_count; /**< Cached objects with source on disc */
+
+	size_t size; /**< RAM used by cached objects */
+	size_t limit; /**< The target upper bound for the RAM cache size */
+
+	unsigned int hit_count; /**< Retrievals of fresh cached objects */
+	unsigned int store_count; /**< Objects found in the backing store */
+	unsigned int revalidate_count; /**< Retrievals needing validation */
+	unsigned int notmodified_count; /**< Validations found unmodified */
+	unsigned int miss_count; /**< Retrievals needing a full fetch */
+	unsigned int uncachable_count; /**< Retrievals which are never cached */
+
+	uint64_t total_written; /**< Bytes written to the backing store */
+	uint64_t total_elapsed; /**< Time taken writing, in ms */
+	size_t minimum_bandwidth; /**< Bandwidth below which writes stop */
+	size_t maximum_bandwidth; /**< Bandwidth writes are limited to */
+};
+
 /**
  * Initialise the low-level cache
  *
@@ -260,6 +336,24 @@ void llcache_finalise(void);
  */
 void llcache_clean(bool purge);
 
+/**
+ * Get statistics of the low-level cache.
+ *
+ * \param stats The statistics to fill in.
+ * \return NSERROR_OK on success or NSERROR_INIT_FAILED if the cache is
+ *         not initialised.
+ */
+nserror llcache_get_stats(struct llcache_stats *stats);
+
+/**
+ * Get statistics of the low-level cache backing store.
+ *
+ * \param stats The statistics to fill in.
+ * \return NSERROR_OK on success or NSERROR_NOT_IMPLEMENTED if the
+ *         backing store does not provide statistics.
+ */
+nserror llcache_get_store_stats(struct llcache_store_stats *stats);
+
 /**
  * Retrieve a handle for a low-level cache object
  *
@@ -47,6 +47,7 @@
 #include "utils/utils.h"
 #include "utils/utf8.h"
 #include "utils/nsoption.h"
+#include "utils/trace.h"
 #include "netsurf/misc.h"
 #include "netsurf/window.h"
 #include "netsurf/content.h"
@@ -292,8 +293,10 @@ browser_window_redraw(struct browser_window *bw,
 	}
 
 	/* Render the content */
+	NSTRACE_BEGIN("redraw");
 	plot_ok &= content_redraw(bw->current_content, &data,
 			&content_clip, &new_ctx);
+	NSTRACE_END("redraw");
 
 	/* Back to full clip rect */
 	new_ctx.plot->clip(&new_ctx, clip);
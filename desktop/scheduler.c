@@ -0,0 +1,433 @@
+/*
+ * Copyright 2017 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Common callback scheduler implementation.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <nsutils/time.h>
+
+#include "utils/log.h"
+#include "netsurf/inttypes.h"
+
+#include "desktop/scheduler.h"
+
+/** Minimum number of hash buckets; must be a power of two */
+#define SCHEDULER_HASH_MIN 64
+
+/**
+ * Scheduled callback.
+ */
+struct scheduler_entry {
+	uint64_t due;		/**< Monotonic time callback is due, in ms */
+	uint64_t sequence;	/**< Order in which callbacks were scheduled */
+	void (*callback)(void *p);
+	void *p;
+	unsigned int heap_index; /**< Position in heap */
+	struct scheduler_entry *hash_next; /**< Next entry in hash bucket */
+};
+
+/**
+ * Scheduler state.
+ */
+static struct {
+	/** Binary heap of entries, earliest due first */
+	struct scheduler_entry **heap;
+	unsigned int count;		/**< Number of entries */
+	unsigned int heap_alloc;	/**< Size of heap array */
+	/** Hash of entries by callback and parameter */
+	struct scheduler_entry **hash;
+	unsigned int hash_size;		/**< Number of buckets */
+	uint64_t sequence;		/**< Sequence of next entry */
+} scheduler;
+
+
+/**
+ * Compute the hash bucket for a callback and parameter.
+ *
+ * \param callback callback function
+ * \param p user parameter
+ * \return bucket index
+ */
+static unsigned int
+scheduler_hash(void (*callback)(void *p), void *p)
+{
+	uint64_t h;
+
+	h = ((uint64_t)(uintptr_t)p * UINT64_C(0x9e3779b97f4a7c15)) ^
+		((uint64_t)(uintptr_t)callback * UINT64_C(0xc2b2ae3d27d4eb4f));
+
+	return (unsigned int)(h >> 32) & (scheduler.hash_size - 1);
+}
+
+
+/**
+ * Determine if one entry is due before another.
+ *
+ * Entries due at the same time are ordered by when they were scheduled.
+ */
+static inline bool
+scheduler_before(const struct scheduler_entry *a,
+		 const struct scheduler_entry *b)
+{
+	if (a->due != b->due) {
+		return a->due < b->due;
+	}
+	return a->sequence < b->sequence;
+}
+
+
+/**
+ * Place an entry at a position in the heap.
+ */
+static inline void
+scheduler_heap_set(unsigned int idx, struct scheduler_entry *entry)
+{
+	scheduler.heap[idx] = entry;
+	entry->heap_index = idx;
+}
+
+
+/**
+ * Move an entry towards the root of the heap until it is in order.
+ */
+static void scheduler_heap_up(struct scheduler_entry *entry)
+{
+	unsigned int idx = entry->heap_index;
+
+	while (idx > 0) {
+		unsigned int parent = (idx - 1) / 2;
+
+		if (!scheduler_before(entry, scheduler.heap[parent])) {
+			break;
+		}
+		scheduler_heap_set(idx, scheduler.heap[parent]);
+		idx = parent;
+	}
+	scheduler_heap_set(idx, entry);
+}
+
+
+/**
+ * Move an entry towards the leaves of the heap until it is in order.
+ */
+static void scheduler_heap_down(struct scheduler_entry *entry)
+{
+	unsigned int idx = entry->heap_index;
+
+	while (true) {
+		unsigned int child = (idx * 2) + 1;
+
+		if (child >= scheduler.count) {
+			break;
+		}
+		if ((child + 1 < scheduler.count) &&
+		    scheduler_before(scheduler.heap[child + 1],
+				     scheduler.heap[child])) {
+			child++;
+		}
+		if (!scheduler_before(scheduler.heap[child], entry)) {
+			break;
+		}
+		scheduler_heap_set(idx, scheduler.heap[child]);
+		idx = child;
+	}
+	scheduler_heap_set(idx, entry);
+}
+
+
+/**
+ * Find the scheduled entry for a callback and parameter.
+ *
+ * \param callback callback function
+ * \param p user parameter
+ * \param link_out updated with the link to the entry, or to the end of
+ *                 the bucket if there is none
+ * \return the entry or NULL if none is scheduled
+ */
+static struct scheduler_entry *
+scheduler_find(void (*callback)(void *p),
+	       void *p,
+	       struct scheduler_entry ***link_out)
+{
+	struct scheduler_entry **link;
+
+	link = &scheduler.hash[scheduler_hash(callback, p)];
+	while ((*link != NULL) &&
+	       (((*link)->callback != callback) || ((*link)->p != p))) {
+		link = &(*link)->hash_next;
+	}
+
+	*link_out = link;
+	return *link;
+}
+
+
+/**
+ * Double the number of hash buckets, rehashing every entry.
+ *
+ * \return NSERROR_OK on success else NSERROR_NOMEM
+ */
+static nserror scheduler_hash_grow(void)
+{
+	struct scheduler_entry **hash;
+	unsigned int hash_size;
+	unsigned int idx;
+
+	hash_size = scheduler.hash_size * 2;
+	if (hash_size < SCHEDULER_HASH_MIN) {
+		hash_size = SCHEDULER_HASH_MIN;
+	}
+
+	hash = calloc(hash_size, sizeof(*hash));
+	if (hash == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	free(scheduler.hash);
+	scheduler.hash = hash;
+	scheduler.hash_size = hash_size;
+
+	/* every entry is in the heap, so rebuild the buckets from it */
+	for (idx = 0; idx < scheduler.count; idx++) {
+		struct scheduler_entry *entry = scheduler.heap[idx];
+		unsigned int bucket;
+
+		bucket = scheduler_hash(entry->callback, entry->p);
+		entry->hash_next = hash[bucket];
+		hash[bucket] = entry;
+	}
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Remove an entry from the heap and hash, and free it.
+ *
+ * \param entry the entry to remove
+ * \param link the link to the entry in its hash bucket
+ */
+static void
+scheduler_remove(struct scheduler_entry *entry, struct scheduler_entry **link)
+{
+	struct scheduler_entry *last;
+
+	*link = entry->hash_next;
+
+	scheduler.count--;
+	if (entry->heap_index != scheduler.count) {
+		/* move the last entry into the hole and restore order */
+		last = scheduler.heap[scheduler.count];
+		scheduler_heap_set(entry->heap_index, last);
+		scheduler_heap_up(last);
+		scheduler_heap_down(last);
+	}
+
+	free(entry);
+}
+
+
+/* exported interface documented in desktop/scheduler.h */
+nserror scheduler_schedule(int tival, void (*callback)(void *p), void *p)
+{
+	struct scheduler_entry *entry;
+	struct scheduler_entry **link;
+	uint64_t now_ms;
+	nserror ret;
+
+	if (scheduler.hash_size == 0) {
+		if (tival < 0) {
+			return NSERROR_OK;
+		}
+		ret = scheduler_hash_grow();
+		if (ret != NSERROR_OK) {
+			return ret;
+		}
+	}
+
+	entry = scheduler_find(callback, p, &link);
+
+	if (tival < 0) {
+		if (entry != NULL) {
+			NSLOG(schedule, DEBUG, "removing %p, %p", callback, p);
+			scheduler_remove(entry, link);
+		}
+		return NSERROR_OK;
+	}
+
+	NSLOG(schedule, DEBUG, "Adding %p(%p) in %d", callback, p, tival);
+
+	nsu_getmonotonic_ms(&now_ms);
+
+	if (entry != NULL) {
+		/* reschedule in place */
+		entry->due = now_ms + tival;
+		entry->sequence = scheduler.sequence++;
+		scheduler_heap_up(entry);
+		scheduler_heap_down(entry);
+		return NSERROR_OK;
+	}
+
+	if (scheduler.count == scheduler.heap_alloc) {
+		struct scheduler_entry **heap;
+		unsigned int heap_alloc;
+
+		heap_alloc = (scheduler.heap_alloc == 0) ?
+			SCHEDULER_HASH_MIN : scheduler.heap_alloc * 2;
+		heap = realloc(scheduler.heap, heap_alloc * sizeof(*heap));
+		if (heap == NULL) {
+			return NSERROR_NOMEM;
+		}
+		scheduler.heap = heap;
+		scheduler.heap_alloc = heap_alloc;
+	}
+
+	if (scheduler.count >= scheduler.hash_size) {
+		ret = scheduler_hash_grow();
+		if (ret != NSERROR_OK) {
+			return ret;
+		}
+		/* the bucket has changed */
+		scheduler_find(callback, p, &link);
+	}
+
+	entry = malloc(sizeof(*entry));
+	if (entry == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	entry->due = now_ms + tival;
+	entry->sequence = scheduler.sequence++;
+	entry->callback = callback;
+	entry->p = p;
+	entry->hash_next = NULL;
+	*link = entry;
+
+	entry->heap_index = scheduler.count++;
+	scheduler_heap_up(entry);
+
+	return NSERROR_OK;
+}
+
+
+/* exported interface documented in desktop/scheduler.h */
+int scheduler_run(void)
+{
+	uint64_t now_ms;
+	uint64_t run_sequence;
+	uint64_t next_ms;
+
+	if (scheduler.count == 0) {
+		return -1;
+	}
+
+	nsu_getmonotonic_ms(&now_ms);
+
+	/* callbacks scheduled from here on wait for the next run; they
+	 * are due no earlier than now, so sort after any which are due */
+	run_sequence = scheduler.sequence;
+
+	while (scheduler.count > 0) {
+		struct scheduler_entry *entry = scheduler.heap[0];
+		struct scheduler_entry **link;
+		void (*callback)(void *p);
+		void *p;
+
+		if ((entry->due > now_ms) || (entry->sequence >= run_sequence)) {
+			break;
+		}
+
+		callback = entry->callback;
+		p = entry->p;
+
+		scheduler_find(callback, p, &link);
+		scheduler_remove(entry, link);
+
+		/* the callback may modify the schedule */
+		callback(p);
+	}
+
+	if (scheduler.count == 0) {
+		return -1;
+	}
+
+	next_ms = scheduler.heap[0]->due;
+	if (next_ms <= now_ms) {
+		return 0;
+	}
+
+	NSLOG(schedule, DEBUG, "returning time to next event as %"PRIu64"ms",
+	      next_ms - now_ms);
+
+	/* return next event time in milliseconds (24days max wait) */
+	if (next_ms - now_ms > INT32_MAX) {
+		return INT32_MAX;
+	}
+	return (int)(next_ms - now_ms);
+}
+
+
+/* exported interface documented in desktop/scheduler.h */
+void scheduler_list(void)
+{
+	uint64_t now_ms;
+	unsigned int idx;
+
+	nsu_getmonotonic_ms(&now_ms);
+
+	NSLOG(netsurf, INFO, "schedule list at %"PRIu64" (%u callbacks)",
+	      now_ms, scheduler.count);
+
+	for (idx = 0; idx < scheduler.count; idx++) {
+		struct scheduler_entry *entry = scheduler.heap[idx];
+
+		NSLOG(netsurf, INFO, "Schedule %p(%p) at %"PRIu64,
+		      entry->callback, entry->p, entry->due);
+	}
+}
+
+
+/* exported interface documented in desktop/scheduler.h */
+unsigned int scheduler_count(void)
+{
+	return scheduler.count;
+}
+
+
+/* exported interface documented in desktop/scheduler.h */
+void scheduler_finalise(void)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < scheduler.count; idx++) {
+		free(scheduler.heap[idx]);
+	}
+	free(scheduler.heap);
+	free(scheduler.hash);
+
+	scheduler.heap = NULL;
+	scheduler.count = 0;
+	scheduler.heap_alloc = 0;
+	scheduler.hash = NULL;
+	scheduler.hash_size = 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2017 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Interface to the common callback scheduler.
+ *
+ * Frontends without a scheduler provided by their toolkit may use this
+ * to implement the schedule entry of the miscellaneous operation table,
+ * calling scheduler_run() from their main loop.
+ *
+ * Callbacks are kept in a binary heap ordered by the time they are due,
+ * with a hash of callback and parameter so that they can be found for
+ * rescheduling or removal without a search.
+ */
+
+#ifndef NETSURF_DESKTOP_SCHEDULER_H
+#define NETSURF_DESKTOP_SCHEDULER_H
+
+#include "utils/errors.h"
+
+/**
+ * Schedule a callback.
+ *
+ * Any callback already scheduled with the same function and parameter is
+ * replaced.
+ *
+ * \param tival interval before the callback should be made in ms, or
+ *              negative to remove any scheduled callback.
+ * \param callback callback function
+ * \param p user parameter passed to callback function
+ * \return NSERROR_OK on success else appropriate error code.
+ */
+nserror scheduler_schedule(int tival, void (*callback)(void *p), void *p);
+
+/**
+ * Make the callbacks which are due.
+ *
+ * Callbacks scheduled by the callbacks made are not made until the next
+ * call, even if they are already due.
+ *
+ * \return The number of milliseconds until the next scheduled callback
+ *         or -1 if there are none.
+ */
+int scheduler_run(void);
+
+/**
+ * Log the scheduled callbacks.
+ */
+void scheduler_list(void);
+
+/**
+ * Get the number of scheduled callbacks.
+ *
+ * \return The number of callbacks waiting to be made.
+ */
+unsigned int scheduler_count(void);
+
+/**
+ * Remove all scheduled callbacks and release the scheduler's memory.
+ */
+void scheduler_finalise(void);
+
+#endif
@@ -172,7 +172,9 @@ static char *amiga_dt_picture_datatype(struct content *c)
 	return filetype;
 }
 
-static struct bitmap *amiga_dt_picture_cache_convert(struct content *c)
+static struct bitmap *amiga_dt_picture_cache_convert(struct content *c,
+		const char *data, unsigned long size,
+		int plot_width, int plot_height)
 {
 	NSLOG(netsurf, INFO, "amiga_dt_picture_cache_convert");
 
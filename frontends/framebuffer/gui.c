@@ -23,6 +23,7 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <sys/select.h>
 #include <nsutils/time.h>
 
 #include <libnsfb.h>
@@ -59,6 +60,14 @@
 
 #define NSFB_TOOLBAR_DEFAULT_LAYOUT "blfsrutc"
 
+/**
+ * Longest time in ms to wait on fetch sockets before checking for input.
+ *
+ * libnsfb cannot wait on the fetch sockets so while fetches are
+ * active the wait is split between the two.
+ */
+#define FB_FETCH_WAIT_SLICE 10
+
 fbtk_widget_t *fbtk;
 
 static bool fb_complete = false;
@@ -588,8 +597,14 @@ static void framebuffer_run(void)
 {
 	nsfb_event_t event;
 	int timeout; /* timeout in miliseconds */
+	fd_set read_fd_set, write_fd_set, exc_fd_set;
+	int max_fd;
+	struct timeval tv;
 
 	while (fb_complete != true) {
+		/* obtain the sockets the fetchers are waiting on */
+		fetch_fdset(&read_fd_set, &write_fd_set, &exc_fd_set, &max_fd);
+
 		/* run the scheduler and discover how long to wait for
 		 * the next event.
 		 */
@@ -601,6 +616,23 @@ static void framebuffer_run(void)
 		if (fbtk_get_redraw_pending(fbtk))
 			timeout = 0;
 
+		/* wake as soon as fetch data arrives rather than
+		 * having the fetchers polled on a timer
+		 */
+		if ((max_fd >= 0) && (timeout != 0)) {
+			if ((timeout < 0) || (timeout > FB_FETCH_WAIT_SLICE)) {
+				timeout = FB_FETCH_WAIT_SLICE;
+			}
+			tv.tv_sec = 0;
+			tv.tv_usec = timeout * 1000;
+			select(max_fd + 1,
+			       &read_fd_set,
+			       &write_fd_set,
+			       &exc_fd_set,
+			       &tv);
+			timeout = 0;
+		}
+
 		if (fbtk_event(fbtk, &event, timeout)) {
 			if ((event.type == NSFB_EVENT_CONTROL) &&
 			    (event.value.controlcode ==  NSFB_CONTROL_QUIT))
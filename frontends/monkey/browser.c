@@ -21,16 +21,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <nsutils/time.h>
+
 
 #include "utils/utils.h"
 #include "utils/ring.h"
 #include "utils/log.h"
 #include "utils/messages.h"
 #include "utils/nsurl.h"
+#include "netsurf/inttypes.h"
 #include "netsurf/mouse.h"
 #include "netsurf/window.h"
 #include "netsurf/browser_window.h"
 #include "netsurf/plotters.h"
+#include "netsurf/content.h"
+#include "render/box.h"
+#include "render/html.h"
 
 #include "monkey/browser.h"
 #include "monkey/plot.h"
@@ -477,6 +483,109 @@ monkey_window_handle_redraw(int argc, char **argv)
 	fprintf(stdout, "WINDOW REDRAW WIN %d STOP\n", atoi(argv[2]));
 }
 
+/**
+ * Count the boxes in a window's content
+ *
+ * \param gw The window whose content to count the boxes of
+ * \return The number of boxes or 0 if the content is not HTML
+ */
+static unsigned long monkey_window_count_boxes(struct gui_window *gw)
+{
+	struct hlcache_handle *h = browser_window_get_content(gw->bw);
+	struct box *root;
+	struct box *box;
+	unsigned long count = 0;
+
+	if ((h == NULL) || (content_get_type(h) != CONTENT_HTML)) {
+		return 0;
+	}
+
+	root = html_get_box_tree(h);
+	for (box = root; box != NULL; ) {
+		count++;
+		if (box->children != NULL) {
+			box = box->children;
+			continue;
+		}
+		while ((box != root) && (box->next == NULL)) {
+			box = box->parent;
+		}
+		box = (box == root) ? NULL : box->next;
+	}
+
+	return count;
+}
+
+/**
+ * Time repeated redraws of a window's whole content through null plotters
+ *
+ * The cost is reported per plot operation issued and, for HTML, per
+ * box in the content's box tree.
+ */
+static void
+monkey_window_handle_bench(int argc, char **argv)
+{
+	struct gui_window *gw;
+	struct rect clip;
+	struct redraw_context ctx = {
+		.interactive = true,
+		.background_images = true,
+		.plot = monkey_null_plotters
+	};
+	int width, height;
+	int iterations, i;
+	uint64_t ms_before, ms_after, ms;
+	unsigned long boxes;
+
+	if (argc != 4) {
+		fprintf(stdout, "ERROR WINDOW BENCH ARGS BAD\n");
+		return;
+	}
+
+	gw = monkey_find_window_by_num(atoi(argv[2]));
+
+	if (gw == NULL) {
+		fprintf(stdout, "ERROR WINDOW NUM BAD\n");
+		return;
+	}
+
+	iterations = atoi(argv[3]);
+	if (iterations < 1) {
+		fprintf(stdout, "ERROR WINDOW BENCH ARGS BAD\n");
+		return;
+	}
+
+	if (browser_window_get_extents(gw->bw, false,
+			&width, &height) != NSERROR_OK) {
+		fprintf(stdout, "ERROR WINDOW BENCH NO CONTENT\n");
+		return;
+	}
+
+	clip.x0 = 0;
+	clip.y0 = 0;
+	clip.x1 = width;
+	clip.y1 = height;
+
+	boxes = monkey_window_count_boxes(gw);
+	monkey_null_plot_count = 0;
+
+	nsu_getmonotonic_ms(&ms_before);
+	for (i = 0; i < iterations; i++) {
+		browser_window_redraw(gw->bw, 0, 0, &clip, &ctx);
+	}
+	nsu_getmonotonic_ms(&ms_after);
+	ms = ms_after - ms_before;
+
+	fprintf(stdout, "WINDOW BENCH WIN %d ITERATIONS %d TIME %"PRIu64
+			" PLOTS %lu NS_PER_PLOT %"PRIu64
+			" BOXES %lu NS_PER_BOX %"PRIu64"\n",
+			atoi(argv[2]), iterations, ms, monkey_null_plot_count,
+			monkey_null_plot_count ?
+			(ms * 1000000) / monkey_null_plot_count : 0,
+			boxes,
+			boxes ? (ms * 1000000) / (boxes * iterations) : 0);
+}
+
 static void
 monkey_window_handle_reload(int argc, char **argv)
 {
@@ -511,6 +620,8 @@ monkey_window_handle_command(int argc, char **argv)
 		monkey_window_handle_redraw(argc, argv);
 	} else if (strcmp(argv[1], "RELOAD") == 0) {
 		monkey_window_handle_reload(argc, argv);
+	} else if (strcmp(argv[1], "BENCH") == 0) {
+		monkey_window_handle_bench(argc, argv);
 	} else {
 		fprintf(stdout, "ERROR WINDOW COMMAND UNKNOWN %s\n", argv[1]);
 	}
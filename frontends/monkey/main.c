@@ -31,6 +31,7 @@
 #include "utils/filepath.h"
 #include "utils/nsoption.h"
 #include "utils/nsurl.h"
+#include "utils/trace.h"
 #include "netsurf/misc.h"
 #include "netsurf/netsurf.h"
 #include "netsurf/url_db.h"
@@ -213,6 +214,49 @@ static void monkey_options_handle_command(int argc, char **argv)
 	nsoption_commandline(&argc, argv, nsoptions);
 }
 
+/**
+ * Handle the TRACE command.
+ *
+ * TRACE DUMP <filename> writes the recorded performance trace as Chrome
+ * trace event JSON and TRACE CLEAR discards it.
+ */
+static void monkey_trace_handle_command(int argc, char **argv)
+{
+	FILE *fp;
+	nserror ret;
+
+	if (argc == 1)
+		return;
+
+	if (strcmp(argv[1], "CLEAR") == 0) {
+		nstrace_clear();
+		fprintf(stdout, "GENERIC TRACE CLEARED\n");
+	} else if (strcmp(argv[1], "DUMP") == 0) {
+		if (argc != 3) {
+			fprintf(stdout, "ERROR TRACE DUMP ARGS BAD\n");
+			return;
+		}
+
+		fp = fopen(argv[2], "w");
+		if (fp == NULL) {
+			fprintf(stdout, "ERROR TRACE DUMP OPEN %s\n", argv[2]);
+			return;
+		}
+		ret = nstrace_dump(fp);
+		if (fclose(fp) != 0) {
+			ret = NSERROR_SAVE_FAILED;
+		}
+
+		if (ret != NSERROR_OK) {
+			fprintf(stdout, "ERROR TRACE DUMP WRITE %s\n", argv[2]);
+		} else {
+			fprintf(stdout, "GENERIC TRACE DUMPED %s\n", argv[2]);
+		}
+	} else {
+		fprintf(stdout, "ERROR TRACE COMMAND UNKNOWN %s\n", argv[1]);
+	}
+}
+
 /**
  * Set option defaults for monkey frontend
  *
@@ -392,6 +436,11 @@ main(int argc, char **argv)
 		die("options handler failed to register");
 	}
 
+	ret = monkey_register_handler("TRACE", monkey_trace_handle_command);
+	if (ret != NSERROR_OK) {
+		die("trace handler failed to register");
+	}
+
 	fprintf(stdout, "GENERIC STARTED\n");
 	monkey_run();
 
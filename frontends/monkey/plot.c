@@ -277,3 +277,119 @@ static const struct plotter_table plotters = {
 };
 
 const struct plotter_table* monkey_plotters = &plotters;
+
+
+/*
+ * Null plotters.
+ *
+ * These discard everything, only counting the operations, so that the
+ * cost of walking the content for redraw can be measured on its own.
+ */
+
+unsigned long monkey_null_plot_count;
+
+static nserror
+monkey_null_clip(const struct redraw_context *ctx, const struct rect *clip)
+{
+	monkey_null_plot_count++;
+	return NSERROR_OK;
+}
+
+static nserror
+monkey_null_arc(const struct redraw_context *ctx,
+		const plot_style_t *style,
+		int x, int y, int radius, int angle1, int angle2)
+{
+	monkey_null_plot_count++;
+	return NSERROR_OK;
+}
+
+static nserror
+monkey_null_disc(const struct redraw_context *ctx,
+		 const plot_style_t *style,
+		 int x, int y, int radius)
+{
+	monkey_null_plot_count++;
+	return NSERROR_OK;
+}
+
+static nserror
+monkey_null_line(const struct redraw_context *ctx,
+		 const plot_style_t *style,
+		 const struct rect *line)
+{
+	monkey_null_plot_count++;
+	return NSERROR_OK;
+}
+
+static nserror
+monkey_null_rectangle(const struct redraw_context *ctx,
+		      const plot_style_t *style,
+		      const struct rect *rect)
+{
+	monkey_null_plot_count++;
+	return NSERROR_OK;
+}
+
+static nserror
+monkey_null_polygon(const struct redraw_context *ctx,
+		    const plot_style_t *style,
+		    const int *p,
+		    unsigned int n)
+{
+	monkey_null_plot_count++;
+	return NSERROR_OK;
+}
+
+static nserror
+monkey_null_path(const struct redraw_context *ctx,
+		 const plot_style_t *pstyle,
+		 const float *p,
+		 unsigned int n,
+		 float width,
+		 const float transform[6])
+{
+	monkey_null_plot_count++;
+	return NSERROR_OK;
+}
+
+static nserror
+monkey_null_bitmap(const struct redraw_context *ctx,
+		   struct bitmap *bitmap,
+		   int x, int y,
+		   int width,
+		   int height,
+		   colour bg,
+		   bitmap_flags_t flags)
+{
+	monkey_null_plot_count++;
+	return NSERROR_OK;
+}
+
+static nserror
+monkey_null_text(const struct redraw_context *ctx,
+		 const struct plot_font_style *fstyle,
+		 int x,
+		 int y,
+		 const char *text,
+		 size_t length)
+{
+	monkey_null_plot_count++;
+	return NSERROR_OK;
+}
+
+/** monkey null plotter operations table */
+static const struct plotter_table null_plotters = {
+	.clip = monkey_null_clip,
+	.arc = monkey_null_arc,
+	.disc = monkey_null_disc,
+	.line = monkey_null_line,
+	.rectangle = monkey_null_rectangle,
+	.polygon = monkey_null_polygon,
+	.path = monkey_null_path,
+	.bitmap = monkey_null_bitmap,
+	.text = monkey_null_text,
+	.option_knockout = true,
+};
+
+const struct plotter_table* monkey_null_plotters = &null_plotters;
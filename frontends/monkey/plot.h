@@ -23,4 +23,10 @@ struct plotter_table;
 
 extern const struct plotter_table *monkey_plotters;
 
+/** Plotters which discard all output, for benchmarking redraw */
+extern const struct plotter_table *monkey_null_plotters;
+
+/** Number of operations issued to monkey_null_plotters */
+extern unsigned long monkey_null_plot_count;
+
 #endif
@@ -25,6 +25,7 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -38,6 +39,7 @@
 #include "netsurf/mouse.h"
 #include "css/utils.h"
 #include "css/dump.h"
+#include "css/select.h"
 #include "desktop/scrollbar.h"
 #include "desktop/gui_internal.h"
 
@@ -48,6 +50,9 @@
 #define box_is_float(box) (box->type == BOX_FLOAT_LEFT || \
 		box->type == BOX_FLOAT_RIGHT)
 
+/** Minimum number of in-flow children for a box's children to be indexed */
+#define BOX_CHILD_INDEX_MIN 16
+
 /**
  * Destructor for box nodes which own styles
  *
@@ -64,7 +69,7 @@ static int box_talloc_destructor(struct box *b)
 	}
 	
 	if (b->styles != NULL) {
-		css_select_results_destroy(b->styles);
+		nscss_select_results_destroy(b->styles);
 		b->styles = NULL;
 	}
 
@@ -126,7 +131,7 @@ struct box * box_create(css_select_results *styles, css_computed_style *style,
 	talloc_set_destructor(box, box_talloc_destructor);
 
 	box->type = BOX_INLINE;
-	box->flags = 0;
+	box->flags = NEEDS_LAYOUT;
 	box->flags = style_owned ? (box->flags | STYLE_OWNED) : box->flags;
 	box->styles = styles;
 	box->style = style;
@@ -160,6 +165,12 @@ struct box * box_create(css_select_results *styles, css_computed_style *style,
 	box->float_container = NULL;
 	box->next_float = NULL;
 	box->cached_place_below_level = 0;
+	box->cached_layout.width = UNKNOWN_WIDTH;
+	box->cached_layout.height = 0;
+	box->cached_layout.result_width = 0;
+	box->cached_layout.result_height = 0;
+	box->cached_layout.result_padding_bottom = 0;
+	box->child_index = NULL;
 	box->list_marker = NULL;
 	box->col = NULL;
 	box->gadget = NULL;
@@ -285,8 +296,10 @@ void box_free_box(struct box *box)
 			scrollbar_destroy(box->scroll_x);
 		if (box->scroll_y != NULL)
 			scrollbar_destroy(box->scroll_y);
-		if (box->styles != NULL)
-			css_select_results_destroy(box->styles);
+		if (box->styles != NULL) {
+			nscss_select_results_destroy(box->styles);
+			box->styles = NULL;
+		}
 	}
 
 	talloc_free(box);
@@ -479,16 +492,32 @@ enum box_walk_dir {
  * \param dir	direction to move in
  * \param x	box's global x-coord, updated to position of next box
  * \param y	box's global y-coord, updated to position of next box
+ * \param py	global y-coord of point being searched for
  *
  * If no box can be found in given direction, NULL is returned.
+ *
+ * Where the children have been indexed, those which cannot contain the
+ * point are stepped over.
  */
 static inline struct box *box_move_xy(struct box *b, enum box_walk_dir dir,
-		int *x, int *y)
+		int *x, int *y, int py)
 {
 	struct box *rb = NULL;
+	unsigned int first, last;
 
 	switch (dir) {
 	case BOX_WALK_CHILDREN:
+		if (b->child_index != NULL) {
+			box_child_index_range(b, py - *y, py - *y,
+					&first, &last);
+			if (first == last)
+				break;
+			b = b->child_index->child[first];
+			*x += b->x;
+			*y += b->y;
+			rb = b;
+			break;
+		}
 		b = b->children;
 		if (b == NULL)
 			break;
@@ -501,6 +530,19 @@ static inline struct box *box_move_xy(struct box *b, enum box_walk_dir dir,
 		/* Fall through */
 
 	case BOX_WALK_NEXT_SIBLING:
+		if (b->parent != NULL && b->parent->child_index != NULL &&
+				!box_is_float(b)) {
+			int parent_y = *y - b->y;
+			box_child_index_range(b->parent,
+					py - parent_y, py - parent_y,
+					&first, &last);
+			if (last == 0 ||
+					b->parent->child_index->child[last - 1]
+					== b) {
+				/* No further siblings can contain point */
+				break;
+			}
+		}
 		do {
 			*x -= b->x;
 			*y -= b->y;
@@ -559,13 +601,14 @@ static inline struct box *box_move_xy(struct box *b, enum box_walk_dir dir,
  * \param b	box to find next box from
  * \param x	box's global x-coord, updated to position of next box
  * \param y	box's global y-coord, updated to position of next box
+ * \param py	global y-coord of point being searched for
  * \param skip_children	whether to skip box's children
  *
  * This walks to a boxes float children before its children.  When walking
  * children, floating boxes are skipped.
  */
 static inline struct box *box_next_xy(struct box *b, int *x, int *y,
-		bool skip_children)
+		int py, bool skip_children)
 {
 	struct box *n;
 	int tx, ty;
@@ -578,7 +621,7 @@ static inline struct box *box_next_xy(struct box *b, int *x, int *y,
 	}
 
 	tx = *x; ty = *y;
-	n = box_move_xy(b, BOX_WALK_FLOAT_CHILDREN, &tx, &ty);
+	n = box_move_xy(b, BOX_WALK_FLOAT_CHILDREN, &tx, &ty, py);
 	if (n) {
 		/* Next node is float child */
 		*x = tx;
@@ -588,7 +631,7 @@ static inline struct box *box_next_xy(struct box *b, int *x, int *y,
 done_float_children:
 
 	tx = *x; ty = *y;
-	n = box_move_xy(b, BOX_WALK_CHILDREN, &tx, &ty);
+	n = box_move_xy(b, BOX_WALK_CHILDREN, &tx, &ty, py);
 	if (n) {
 		/* Next node is child */
 		*x = tx;
@@ -598,7 +641,7 @@ done_float_children:
 
 skip_children:
 	tx = *x; ty = *y;
-	n = box_move_xy(b, BOX_WALK_NEXT_FLOAT_SIBLING, &tx, &ty);
+	n = box_move_xy(b, BOX_WALK_NEXT_FLOAT_SIBLING, &tx, &ty, py);
 	if (n) {
 		/* Go to next float sibling */
 		*x = tx;
@@ -611,14 +654,14 @@ skip_children:
 		 * or siblings, or ansestors with siblings.  Change to
 		 * float container and move past handling its float children.
 		 */
-		b = box_move_xy(b, BOX_WALK_FLOAT_CONTAINER, x, y);
+		b = box_move_xy(b, BOX_WALK_FLOAT_CONTAINER, x, y, py);
 		goto done_float_children;
 	}
 
 	/* Go to next sibling, or nearest ancestor with next sibling. */
 	while (b) {
 		while (!b->next && b->parent) {
-			b = box_move_xy(b, BOX_WALK_PARENT, x, y);
+			b = box_move_xy(b, BOX_WALK_PARENT, x, y, py);
 			if (box_is_float(b)) {
 				/* Go on to next float, if there is one */
 				goto skip_children;
@@ -630,7 +673,7 @@ skip_children:
 		}
 
 		tx = *x; ty = *y;
-		n = box_move_xy(b, BOX_WALK_NEXT_SIBLING, &tx, &ty);
+		n = box_move_xy(b, BOX_WALK_NEXT_SIBLING, &tx, &ty, py);
 		if (n) {
 			/* Go to non-float (ancestor) sibling */
 			*x = tx;
@@ -638,7 +681,7 @@ skip_children:
 			return n;
 
 		} else if (b->parent) {
-			b = box_move_xy(b, BOX_WALK_PARENT, x, y);
+			b = box_move_xy(b, BOX_WALK_PARENT, x, y, py);
 			if (box_is_float(b)) {
 				/* Go on to next float, if there is one */
 				goto skip_children;
@@ -689,7 +732,8 @@ struct box *box_at_point(struct box *box, const int x, const int y,
 	assert(box);
 
 	skip_children = false;
-	while ((box = box_next_xy(box, box_x, box_y, skip_children))) {
+	while ((box = box_next_xy(box, box_x, box_y, y,
+			skip_children))) {
 		if (box_contains_point(box, x - *box_x, y - *box_y,
 				&physically)) {
 			*box_x -= scrollbar_get_offset(box->scroll_x);
@@ -962,6 +1006,197 @@ struct box *box_find_by_id(struct box *box, lwc_string *id)
 }
 
 
+/**
+ * Mark a box as changed so that the next layout recalculates it.
+ *
+ * The minimum and maximum widths of the box and its ancestors are
+ * discarded and every ancestor is marked as needing layout, so that
+ * only the subtrees containing the box are laid out again.
+ *
+ * \param  box  box which has changed
+ */
+
+void box_invalidate_layout(struct box *box)
+{
+	for (; box != NULL; box = box->parent) {
+		box->max_width = UNKNOWN_MAX_WIDTH;
+		box->flags |= NEEDS_LAYOUT;
+
+		/* Children may be about to move or be unlinked */
+		talloc_free(box->child_index);
+		box->child_index = NULL;
+	}
+}
+
+
+/**
+ * Find the vertical extent of a child box, relative to its parent.
+ *
+ * \param  c       box to find extent of
+ * \param  top     updated to top edge of box and its descendants
+ * \param  bottom  updated to bottom edge of box and its descendants
+ *
+ * The extent covers everything box_contains_point() may find in the box.
+ */
+
+static void box_child_extent(struct box *c, int *top, int *bottom)
+{
+	css_computed_clip_rect css_rect;
+
+	*top = c->y + c->descendant_y0;
+	*bottom = c->y + c->descendant_y1;
+
+	if (c->style != NULL &&
+			css_computed_position(c->style) ==
+					CSS_POSITION_ABSOLUTE &&
+			css_computed_clip(c->style, &css_rect) ==
+					CSS_CLIP_RECT) {
+		/* Clip rect may lie anywhere; never exclude the box */
+		*top = INT_MIN;
+		*bottom = INT_MAX;
+		return;
+	}
+
+	if (c->list_marker != NULL) {
+		struct box *m = c->list_marker;
+		int m0 = m->y - m->border[TOP].width;
+		int m1 = m->y + m->padding[TOP] + m->height +
+				m->padding[BOTTOM] + m->border[BOTTOM].width;
+
+		/* Marker may be taken relative to either the list item
+		 * or its parent, so allow for both */
+		if (m0 < *top)
+			*top = m0;
+		if (m1 > *bottom)
+			*bottom = m1;
+		if (c->y + m0 < *top)
+			*top = c->y + m0;
+		if (c->y + m1 > *bottom)
+			*bottom = c->y + m1;
+	}
+}
+
+
+/**
+ * Build spatial indexes of the children of a laid out box tree.
+ *
+ * \param  box  root of box tree, with descendant bounding boxes calculated
+ *
+ * Boxes with enough in-flow children get a box_child_index, so redraw
+ * and box_at_point() can skip children lying outside the area of
+ * interest.  Any existing indexes are replaced.
+ */
+
+void box_index_children(struct box *box)
+{
+	struct box_child_index *index;
+	struct box *c;
+	unsigned int count = 0;
+	unsigned int i;
+	int top, bottom;
+	int extreme;
+
+	talloc_free(box->child_index);
+	box->child_index = NULL;
+
+	if (box->flags & REPLACE_DIM)
+		/* Box's children aren't displayed if the box is replaced */
+		return;
+
+	for (c = box->children; c != NULL; c = c->next) {
+		box_index_children(c);
+		if (!box_is_float(c))
+			count++;
+	}
+	for (c = box->float_children; c != NULL; c = c->next_float)
+		box_index_children(c);
+
+	if (count < BOX_CHILD_INDEX_MIN)
+		return;
+
+	/* One allocation holds the header and all three arrays */
+	index = talloc_size(box, sizeof(*index) +
+			count * (sizeof(struct box *) + 2 * sizeof(int)));
+	if (index == NULL) {
+		/* Not fatal; children will be walked in full */
+		return;
+	}
+	index->count = count;
+	index->child = (struct box **) (index + 1);
+	index->max_bottom = (int *) (index->child + count);
+	index->min_top = index->max_bottom + count;
+
+	i = 0;
+	extreme = INT_MIN;
+	for (c = box->children; c != NULL; c = c->next) {
+		if (box_is_float(c))
+			continue;
+		box_child_extent(c, &top, &bottom);
+		if (bottom > extreme)
+			extreme = bottom;
+		index->child[i] = c;
+		index->max_bottom[i] = extreme;
+		index->min_top[i] = top;
+		i++;
+	}
+
+	extreme = INT_MAX;
+	for (i = count; i != 0; i--) {
+		if (index->min_top[i - 1] < extreme)
+			extreme = index->min_top[i - 1];
+		index->min_top[i - 1] = extreme;
+	}
+
+	box->child_index = index;
+}
+
+
+/**
+ * Find the indexed children of a box which may overlap a vertical range.
+ *
+ * \param  box    box with child_index
+ * \param  y0     top of range, relative to box
+ * \param  y1     bottom of range, relative to box
+ * \param  first  updated to index of first candidate child
+ * \param  last   updated to one past index of last candidate child
+ *
+ * Children outside [first, last) do not overlap the range.  Children
+ * inside it may not either; callers must still test each one.
+ */
+
+void box_child_index_range(struct box *box, int y0, int y1,
+		unsigned int *first, unsigned int *last)
+{
+	const struct box_child_index *index = box->child_index;
+	unsigned int lo, hi, mid;
+
+	assert(index != NULL);
+
+	/* First child whose running bottom reaches y0 */
+	lo = 0;
+	hi = index->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->max_bottom[mid] < y0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*first = lo;
+
+	/* First child after which every top lies below y1 */
+	hi = index->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->min_top[mid] <= y1)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*last = lo;
+}
+
+
 /**
  * Determine if a box is visible when the tree is rendered.
  *
@@ -133,7 +133,10 @@ typedef enum {
 	REPLACE_DIM = 1 << 9,	/* replaced element has given dimensions */
 	IFRAME      = 1 << 10,	/* box contains an iframe */
 	CONVERT_CHILDREN = 1 << 11,  /* wanted children converting */
-	IS_REPLACED = 1 << 12	/* box is a replaced element */
+	IS_REPLACED = 1 << 12,	/* box is a replaced element */
+	NEEDS_LAYOUT = 1 << 13,	/* box or a descendant changed since layout */
+	HAS_POSITIONED = 1 << 14, /* box or a descendant is positioned */
+	HAS_FLOATS  = 1 << 15	/* inline container has float children */
 } box_flags;
 
 /* Sides of a box */
@@ -148,7 +151,44 @@ struct box_border {
 	int width;			/**< border-width (pixels) */
 };
 
-/** Node in box tree. All dimensions are in pixels. */
+/**
+ * Inputs and results of the last layout of a box.
+ *
+ * Used to skip laying out subtrees which have not changed and are
+ * being given the same space as before.
+ */
+struct box_layout_cache {
+	int width;	   /**< Width given to layout, or UNKNOWN_WIDTH */
+	int height;	   /**< Height given to layout, or AUTO */
+	int result_width;  /**< Width of content box after layout */
+	int result_height; /**< Height of content box after layout */
+	int result_padding_bottom; /**< Bottom padding, with any scrollbar */
+};
+
+/**
+ * Index of a box's in-flow children by vertical extent.
+ *
+ * Children are kept in tree order.  Since siblings may overlap, each
+ * entry records the greatest bottom edge of any child up to and
+ * including it, and the least top edge of any child from it onwards,
+ * so a range of candidates can be found by binary search without
+ * requiring the children to be sorted.  Edges are relative to the
+ * parent box and include descendants.
+ */
+struct box_child_index {
+	unsigned int count;	/**< Number of entries */
+	struct box **child;	/**< Non-float children, in tree order */
+	int *max_bottom;	/**< Greatest bottom edge of child[0..i] */
+	int *min_top;		/**< Least top edge of child[i..count-1] */
+};
+
+/**
+ * Node in box tree. All dimensions are in pixels.
+ *
+ * Members used when walking, redrawing and hit testing the laid out tree
+ * come first, so those passes touch as few cache lines per box as
+ * possible.  Members not read by those tree walks follow.
+ */
 struct box {
 	/** Type of box. */
 	box_type type;
@@ -156,10 +196,6 @@ struct box {
 	/** Box flags */
 	box_flags flags;
 
-	/** Computed styles for elements and their pseudo elements.  NULL on
-	 *  non-element boxes. */
-	css_select_results *styles;
-
 	/** Style for this box. 0 for INLINE_CONTAINER and FLOAT_*. Pointer into
 	 *  a box's 'styles' select results, except for implied boxes, where it
 	 *  is a pointer to an owned computed style. */
@@ -193,22 +229,26 @@ struct box {
 	int descendant_x1;  /**< right edge of descendants */
 	int descendant_y1;  /**< bottom edge of descendants */
 
-	int margin[4];   /**< Margin: TOP, RIGHT, BOTTOM, LEFT. */
-	int padding[4];  /**< Padding: TOP, RIGHT, BOTTOM, LEFT. */
-	struct box_border border[4];   /**< Border: TOP, RIGHT, BOTTOM, LEFT. */
+	struct box *next;      /**< Next sibling box, or 0. */
+	struct box *children;  /**< First child box, or 0. */
+	struct box *parent;    /**< Parent box, or 0. */
+
+	/** First float child box, or 0. Float boxes are in the tree twice, in
+	 * this list for the block box which defines the area for floats, and
+	 * also in the standard tree given by children, next, prev, etc. */
+	struct box *float_children;
+	/** Next sibling float box. */
+	struct box *next_float;
+
+	/** Spatial index of children, or NULL if not indexed. */
+	struct box_child_index *child_index;
 
 	struct scrollbar *scroll_x;  /**< Horizontal scroll. */
 	struct scrollbar *scroll_y;  /**< Vertical scroll. */
 
-	/** Width of box taking all line breaks (including margins etc). Must
-	 * be non-negative. */
-	int min_width;
-	/** Width that would be taken with no line breaks. Must be
-	 * non-negative. */
-	int max_width;
-
-	/**< Byte offset within a textual representation of this content. */
-	size_t byte_offset;
+	int padding[4];  /**< Padding: TOP, RIGHT, BOTTOM, LEFT. */
+	struct box_border border[4];   /**< Border: TOP, RIGHT, BOTTOM, LEFT. */
+	int margin[4];   /**< Margin: TOP, RIGHT, BOTTOM, LEFT. */
 
 	char *text;     /**< Text, or 0 if none. Unterminated. */
 	size_t length;  /**< Length of text. */
@@ -216,29 +256,55 @@ struct box {
 	/** Width of space after current text (depends on font and size). */
 	int space;
 
+	/**< Byte offset within a textual representation of this content. */
+	size_t byte_offset;
+
+	/** INLINE_END box corresponding to this INLINE box, or INLINE box
+	 * corresponding to this INLINE_END box. */
+	struct box *inline_end;
+
+	/** Object in this box (usually an image), or 0 if none. */
+	struct hlcache_handle* object;
+
+	/** Background image for this box, or 0 if none */
+	struct hlcache_handle *background;
+
+	/** Form control data, or 0 if not a form control. */
+	struct form_control* gadget;
+
+	/** List marker box if this is a list-item, or 0. */
+	struct box *list_marker;
+
+	/** Iframe's browser_window, or NULL if none */
+	struct browser_window *iframe;
+
+	/* Members below are not read while walking the tree for redraw or
+	 * box_at_point(). Mouse handling still reads the link, title,
+	 * usemap and id members, but only of the boxes found under the
+	 * pointer.
+	 */
+
+	/** Computed styles for elements and their pseudo elements.  NULL on
+	 *  non-element boxes. */
+	css_select_results *styles;
+
+	/** Width of box taking all line breaks (including margins etc). Must
+	 * be non-negative. */
+	int min_width;
+	/** Width that would be taken with no line breaks. Must be
+	 * non-negative. */
+	int max_width;
+
 	struct nsurl *href;   /**< Link, or 0. */
 	const char *target;  /**< Link target, or 0. */
 	const char *title;  /**< Title, or 0. */
 
 	unsigned int columns;  /**< Number of columns for TABLE / TABLE_CELL. */
 	unsigned int rows;     /**< Number of rows for TABLE only. */
-	unsigned int start_column;  /**< Start column for TABLE_CELL only. */
 
-	struct box *next;      /**< Next sibling box, or 0. */
 	struct box *prev;      /**< Previous sibling box, or 0. */
-	struct box *children;  /**< First child box, or 0. */
 	struct box *last;      /**< Last child box, or 0. */
-	struct box *parent;    /**< Parent box, or 0. */
-	/** INLINE_END box corresponding to this INLINE box, or INLINE box
-	 * corresponding to this INLINE_END box. */
-	struct box *inline_end;
 
-	/** First float child box, or 0. Float boxes are in the tree twice, in
-	 * this list for the block box which defines the area for floats, and
-	 * also in the standard tree given by children, next, prev, etc. */
-	struct box *float_children;
-	/** Next sibling float box. */
-	struct box *next_float;
 	/** If box is a float, points to box's containing block */
 	struct box *float_container;
 	/** Level below which subsequent floats must be cleared.
@@ -248,28 +314,19 @@ struct box {
 	/* Level below which floats have been placed. */
 	int cached_place_below_level;
 
-	/** List marker box if this is a list-item, or 0. */
-	struct box *list_marker;
+	unsigned int start_column;  /**< Start column for TABLE_CELL only. */
 
-	struct column *col;  /**< Array of table column data for TABLE only. */
+	/** Last layout of this box, if it is a layout root. */
+	struct box_layout_cache cached_layout;
 
-	/** Form control data, or 0 if not a form control. */
-	struct form_control* gadget;
+	struct column *col;  /**< Array of table column data for TABLE only. */
 
 	char *usemap; /** (Image)map to use with this object, or 0 if none */
 	lwc_string *id; /**<  value of id attribute (or name for anchors) */
 
-	/** Background image for this box, or 0 if none */
-	struct hlcache_handle *background;
-
-	/** Object in this box (usually an image), or 0 if none. */
-	struct hlcache_handle* object;
 	/** Parameters for the object, or 0. */
 	struct object_params *object_params;
 
-	/** Iframe's browser_window, or NULL if none */
-	struct browser_window *iframe;
-
 	struct dom_node *node; /**< DOM node that generated this box or NULL */
 };
 
@@ -334,6 +391,10 @@ struct box *box_pick_text_box(struct html_content *html,
 		int x, int y, int dir, int *dx, int *dy);
 struct box *box_find_by_id(struct box *box, lwc_string *id);
 bool box_visible(struct box *box);
+void box_invalidate_layout(struct box *box);
+void box_index_children(struct box *box);
+void box_child_index_range(struct box *box, int y0, int y1,
+		unsigned int *first, unsigned int *last);
 void box_dump(FILE *stream, struct box *box, unsigned int depth, bool style);
 
 /**
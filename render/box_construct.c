@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <nsutils/time.h>
 
 #include "utils/config.h"
 #include "utils/nsoption.h"
@@ -40,6 +41,7 @@
 #include "utils/talloc.h"
 #include "utils/string.h"
 #include "utils/ascii.h"
+#include "utils/trace.h"
 #include "netsurf/css.h"
 #include "netsurf/misc.h"
 #include "netsurf/plot_style.h"
@@ -53,6 +55,15 @@
 #include "render/form_internal.h"
 #include "render/html_internal.h"
 
+/** Size of each block of the box tree's talloc pool */
+#define BOX_POOL_BLOCK_SIZE (64 * 1024)
+
+/** Time to spend converting before yielding to the scheduler, in ms */
+#define BOX_CONSTRUCT_SLICE_MS 10
+
+/** Number of elements to convert between checks of the clock */
+#define BOX_CONSTRUCT_CLOCK_INTERVAL 16
+
 /**
  * Context for box tree construction
  */
@@ -166,8 +177,10 @@ nserror dom_to_box(dom_node *n, html_content *c, box_construct_complete_cb cb)
 	struct box_construct_ctx *ctx;
 
 	if (c->bctx == NULL) {
-		/* create a context allocation for this box tree */
-		c->bctx = talloc_zero(0, int);
+		/* create a pool for this box tree, so boxes and their
+		 * data are carved from large blocks and released together
+		 */
+		c->bctx = talloc_pool(NULL, BOX_POOL_BLOCK_SIZE);
 		if (c->bctx == NULL) {
 			return NSERROR_NOMEM;
 		}
@@ -363,22 +376,26 @@ static dom_node *next_node(dom_node *n, html_content *content,
 }
 
 /**
- * Convert an ELEMENT node to a box tree fragment,
- * then schedule conversion of the next ELEMENT node
+ * Convert ELEMENT nodes to box tree fragments for up to
+ * BOX_CONSTRUCT_SLICE_MS, then schedule conversion of the rest
  */
 void convert_xml_to_box(struct box_construct_ctx *ctx)
 {
 	dom_node *next;
 	bool convert_children;
 	uint32_t num_processed = 0;
-	const uint32_t max_processed_before_yield = 10;
+	uint64_t ms_start, ms_now;
 
-	do {
+	NSTRACE_BEGIN("box convert");
+	nsu_getmonotonic_ms(&ms_start);
+
+	while (true) {
 		convert_children = true;
 
 		assert(ctx->n != NULL);
 
 		if (box_construct_element(ctx, &convert_children) == false) {
+			NSTRACE_END("box convert");
 			ctx->cb(ctx->content, false);
 			dom_node_unref(ctx->n);
 			free(ctx);
@@ -393,6 +410,7 @@ void convert_xml_to_box(struct box_construct_ctx *ctx)
 
 			err = dom_node_get_node_type(next, &type);
 			if (err != DOM_NO_ERR) {
+				NSTRACE_END("box convert");
 				ctx->cb(ctx->content, false);
 				dom_node_unref(next);
 				free(ctx);
@@ -405,6 +423,7 @@ void convert_xml_to_box(struct box_construct_ctx *ctx)
 			if (type == DOM_TEXT_NODE) {
 				ctx->n = next;
 				if (box_construct_text(ctx) == false) {
+					NSTRACE_END("box convert");
 					ctx->cb(ctx->content, false);
 					dom_node_unref(ctx->n);
 					free(ctx);
@@ -421,6 +440,9 @@ void convert_xml_to_box(struct box_construct_ctx *ctx)
 			/* Conversion complete */
 			struct box root;
 
+			nscss_select_share_flush();
+			nscss_select_sibling_cache_invalidate();
+
 			memset(&root, 0, sizeof(root));
 
 			root.type = BOX_BLOCK;
@@ -429,8 +451,10 @@ void convert_xml_to_box(struct box_construct_ctx *ctx)
 
 			/** \todo Remove box_normalise_block */
 			if (box_normalise_block(&root, ctx->content) == false) {
+				NSTRACE_END("box convert");
 				ctx->cb(ctx->content, false);
 			} else {
+				NSTRACE_END("box convert");
 				ctx->content->layout = root.children;
 				ctx->content->layout->parent = NULL;
 
@@ -442,7 +466,16 @@ void convert_xml_to_box(struct box_construct_ctx *ctx)
 			free(ctx);
 			return;
 		}
-	} while (++num_processed < max_processed_before_yield);
+
+		/* Yield once this slice's time is used up */
+		if (++num_processed % BOX_CONSTRUCT_CLOCK_INTERVAL == 0) {
+			nsu_getmonotonic_ms(&ms_now);
+			if (ms_now - ms_start >= BOX_CONSTRUCT_SLICE_MS)
+				break;
+		}
+	}
+
+	NSTRACE_END("box convert");
 
 	/* More work to do: schedule a continuation */
 	guit->misc->schedule(0, (void *)convert_xml_to_box, ctx);
@@ -879,7 +912,7 @@ bool box_construct_element(struct box_construct_ctx *ctx,
 	if (box->type == BOX_NONE || (css_computed_display(box->style,
 			props.node_is_root) == CSS_DISPLAY_NONE &&
 			props.node_is_root == false)) {
-		css_select_results_destroy(styles);
+		nscss_select_results_destroy(styles);
 		box->styles = NULL;
 		box->style = NULL;
 
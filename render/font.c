@@ -22,12 +22,49 @@
  * Renderer internal font handling implementation.
  */
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "utils/nsoption.h"
+#include "utils/log.h"
 #include "netsurf/plot_style.h"
+#include "netsurf/layout.h"
 #include "css/utils.h"
 
 #include "render/font.h"
 
+/** Number of buckets in the text measurement cache */
+#define FONT_WIDTH_CACHE_SIZE 4096
+
+/** Longest string, in bytes, whose measurement is cached */
+#define FONT_WIDTH_CACHE_MAX_LENGTH 64
+
+/** Number of cached measurements at which the cache is emptied */
+#define FONT_WIDTH_CACHE_MAX_ENTRIES 32768
+
+/** A cached text measurement */
+struct font_width_entry {
+	struct font_width_entry *next; /**< Next entry in bucket */
+	const struct gui_layout_table *font_func; /**< Measuring functions */
+	plot_font_generic_family_t family; /**< Font family */
+	int size; /**< Font size */
+	int weight; /**< Font weight */
+	plot_font_flags_t flags; /**< Font flags */
+	int width; /**< Measured width */
+	size_t length; /**< Length of text */
+	char text[]; /**< Text that was measured */
+};
+
+/** Text measurement cache */
+static struct {
+	struct font_width_entry *bucket[FONT_WIDTH_CACHE_SIZE];
+	unsigned int count; /**< Number of entries */
+	uint32_t options; /**< Hash of font options entries were made with */
+	unsigned int hits; /**< Measurements found in the cache */
+	unsigned int misses; /**< Measurements made by the font engine */
+} font_width_cache;
+
 /**
  * Map a generic CSS font family to a generic plot font family
  *
@@ -159,3 +196,182 @@ void font_plot_style_from_css(const css_computed_style *css,
 	fstyle->foreground = nscss_color_to_ns(col);
 	fstyle->background = 0;
 }
+
+
+/**
+ * Fowler Noll Vo hash of a block of data.
+ *
+ * \param hash    Hash to continue from
+ * \param data    Data to hash
+ * \param length  Length of data
+ * \return Updated hash value
+ */
+static uint32_t
+font_width_hash(uint32_t hash, const void *data, size_t length)
+{
+	const uint8_t *byte = data;
+
+	while (length-- > 0) {
+		hash ^= *byte++;
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+
+/**
+ * Hash the font options which affect text measurement.
+ *
+ * \return Hash of the current font options
+ */
+static uint32_t font_width_options_hash(void)
+{
+	const char *faces[5];
+	int values[3];
+	uint32_t hash = 0x811c9dc5;
+	unsigned int i;
+
+	faces[0] = nsoption_charp(font_sans);
+	faces[1] = nsoption_charp(font_serif);
+	faces[2] = nsoption_charp(font_mono);
+	faces[3] = nsoption_charp(font_cursive);
+	faces[4] = nsoption_charp(font_fantasy);
+	values[0] = nsoption_int(font_size);
+	values[1] = nsoption_int(font_min_size);
+	values[2] = nsoption_int(font_default);
+
+	for (i = 0; i < sizeof(faces) / sizeof(faces[0]); i++) {
+		if (faces[i] != NULL) {
+			hash = font_width_hash(hash, faces[i], strlen(faces[i]));
+		}
+		hash = font_width_hash(hash, "", 1);
+	}
+
+	return font_width_hash(hash, values, sizeof(values));
+}
+
+
+/**
+ * Empty the text measurement cache.
+ */
+static void font_width_cache_flush(void)
+{
+	struct font_width_entry *entry;
+	unsigned int i;
+
+	for (i = 0; i < FONT_WIDTH_CACHE_SIZE; i++) {
+		while (font_width_cache.bucket[i] != NULL) {
+			entry = font_width_cache.bucket[i];
+			font_width_cache.bucket[i] = entry->next;
+			free(entry);
+		}
+	}
+	font_width_cache.count = 0;
+}
+
+
+/* exported function documented in render/font.h */
+nserror font_width(const struct gui_layout_table *font_func,
+		   const plot_font_style_t *fstyle,
+		   const char *string,
+		   size_t length,
+		   int *width)
+{
+	struct font_width_entry *entry;
+	uint32_t hash;
+	unsigned int bucket;
+	nserror res;
+
+	if (length > FONT_WIDTH_CACHE_MAX_LENGTH) {
+		font_width_cache.misses++;
+		return font_func->width(fstyle, string, length, width);
+	}
+
+	hash = font_width_hash(0x811c9dc5, string, length);
+	hash ^= fstyle->size * 31 + fstyle->weight;
+	hash ^= (fstyle->family << 24) ^ (fstyle->flags << 16);
+	bucket = hash % FONT_WIDTH_CACHE_SIZE;
+
+	for (entry = font_width_cache.bucket[bucket];
+	     entry != NULL;
+	     entry = entry->next) {
+		if (entry->length == length &&
+		    entry->size == fstyle->size &&
+		    entry->weight == fstyle->weight &&
+		    entry->family == fstyle->family &&
+		    entry->flags == fstyle->flags &&
+		    entry->font_func == font_func &&
+		    memcmp(entry->text, string, length) == 0) {
+			font_width_cache.hits++;
+			*width = entry->width;
+			return NSERROR_OK;
+		}
+	}
+
+	font_width_cache.misses++;
+	res = font_func->width(fstyle, string, length, width);
+	if (res != NSERROR_OK) {
+		return res;
+	}
+
+	if (font_width_cache.count >= FONT_WIDTH_CACHE_MAX_ENTRIES) {
+		font_width_cache_flush();
+	}
+
+	entry = malloc(sizeof(*entry) + length);
+	if (entry == NULL) {
+		/* measurement is still good, it just is not cached */
+		return NSERROR_OK;
+	}
+
+	entry->font_func = font_func;
+	entry->family = fstyle->family;
+	entry->size = fstyle->size;
+	entry->weight = fstyle->weight;
+	entry->flags = fstyle->flags;
+	entry->width = *width;
+	entry->length = length;
+	memcpy(entry->text, string, length);
+
+	entry->next = font_width_cache.bucket[bucket];
+	font_width_cache.bucket[bucket] = entry;
+	font_width_cache.count++;
+
+	return NSERROR_OK;
+}
+
+
+/* exported function documented in render/font.h */
+void font_width_cache_validate(void)
+{
+	uint32_t options = font_width_options_hash();
+
+	if (options != font_width_cache.options) {
+		if (font_width_cache.count != 0) {
+			NSLOG(netsurf, INFO,
+			      "Font options changed, discarding %u measurements",
+			      font_width_cache.count);
+		}
+		font_width_cache_flush();
+		font_width_cache.options = options;
+	}
+}
+
+
+/* exported function documented in render/font.h */
+void font_width_cache_stats(unsigned int *hits, unsigned int *misses)
+{
+	*hits = font_width_cache.hits;
+	*misses = font_width_cache.misses;
+}
+
+
+/* exported function documented in render/font.h */
+void font_width_cache_fini(void)
+{
+	NSLOG(netsurf, INFO, "Text measurement cache %u hits, %u misses",
+	      font_width_cache.hits, font_width_cache.misses);
+
+	font_width_cache_flush();
+}
@@ -27,7 +27,12 @@
 #ifndef _NETSURF_RENDER_FONT_H_
 #define _NETSURF_RENDER_FONT_H_
 
+#include <stddef.h>
+
+#include "utils/errors.h"
+
 struct plot_font_style;
+struct gui_layout_table;
 
 /**
  * Populate a font style using data from a computed CSS style
@@ -38,4 +43,44 @@ struct plot_font_style;
 void font_plot_style_from_css(const css_computed_style *css,
 			      struct plot_font_style *fstyle);
 
+/**
+ * Measure the width of a string, using previous measurements if possible.
+ *
+ * Measurements are cached by font style and text so repeated layout
+ * of the same text does not need to call the font engine.
+ *
+ * \param font_func  Font layout functions to measure with
+ * \param fstyle     Style of font to measure in
+ * \param string     UTF-8 string to measure
+ * \param length     Length of string, in bytes
+ * \param width      Updated to width of string[0..length)
+ * \return NSERROR_OK and width updated or appropriate error code on failure
+ */
+nserror font_width(const struct gui_layout_table *font_func,
+		   const struct plot_font_style *fstyle,
+		   const char *string,
+		   size_t length,
+		   int *width);
+
+/**
+ * Discard cached measurements if the font options have changed.
+ *
+ * Called before layout so measurements made with previous font
+ * settings are not reused.
+ */
+void font_width_cache_validate(void);
+
+/**
+ * Obtain the text measurement cache statistics.
+ *
+ * \param hits    Updated to number of measurements found in the cache
+ * \param misses  Updated to number of measurements made by the font engine
+ */
+void font_width_cache_stats(unsigned int *hits, unsigned int *misses);
+
+/**
+ * Discard all cached text measurements.
+ */
+void font_width_cache_fini(void);
+
 #endif
@@ -41,12 +41,15 @@
 #include "utils/nsoption.h"
 #include "utils/string.h"
 #include "utils/ascii.h"
+#include "utils/trace.h"
+#include "netsurf/inttypes.h"
 #include "netsurf/content.h"
 #include "netsurf/browser_window.h"
 #include "netsurf/utf8.h"
 #include "netsurf/layout.h"
 #include "netsurf/misc.h"
 #include "content/hlcache.h"
+#include "css/select.h"
 #include "desktop/selection.h"
 #include "desktop/scrollbar.h"
 #include "desktop/textarea.h"
@@ -55,6 +58,7 @@
 #include "desktop/gui_internal.h"
 
 #include "render/box.h"
+#include "render/font.h"
 #include "render/form_internal.h"
 #include "render/html_internal.h"
 #include "render/imagemap.h"
@@ -99,6 +103,34 @@ bool fire_dom_event(dom_string *type, dom_node *target,
 	return result;
 }
 
+/**
+ * Log the memory used by a box tree.
+ *
+ * Sizing the tree walks every allocation so nothing is done unless
+ * the report would actually be logged.
+ *
+ * \param c     HTML content owning the box tree
+ * \param when  description of when the report is made
+ */
+static void html_box_memory_report(html_content *c, const char *when)
+{
+	size_t capacity, used;
+	unsigned int blocks;
+
+	if ((NSLOG_LEVEL_INFO < NSLOG_COMPILED_MIN_LEVEL) ||
+	    (verbose_log == false) ||
+	    (c->bctx == NULL))
+		return;
+
+	talloc_pool_usage(c->bctx, &capacity, &used, &blocks);
+
+	NSLOG(netsurf, INFO,
+	      "box tree of %p %s: %"PRIsizet" bytes in %"PRIsizet" allocations, pool %"PRIsizet" of %"PRIsizet" bytes in %u blocks",
+	      c, when,
+	      talloc_total_size(c->bctx), talloc_total_blocks(c->bctx),
+	      used, capacity, blocks);
+}
+
 /**
  * Perform post-box-creation conversion of a document
  *
@@ -113,6 +145,9 @@ static void html_box_convert_done(html_content *c, bool success)
 
 	NSLOG(netsurf, INFO, "Done XML to box (%p)", c);
 
+	/* Conversion may have stopped part way through selection */
+	nscss_select_sibling_cache_invalidate();
+
 	/* Clean up and report error if unsuccessful or aborted */
 	if ((success == false) || (c->aborted)) {
 		html_object_free_objects(c);
@@ -128,6 +163,8 @@ static void html_box_convert_done(html_content *c, bool success)
 	}
 
 
+	html_box_memory_report(c, "after conversion");
+
 #if ALWAYS_DUMP_BOX
 	box_dump(stderr, c->layout->children, 0, true);
 #endif
@@ -636,6 +673,9 @@ dom_default_action_DOMNodeInserted_cb(struct dom_event *evt, void *pw)
 	dom_exception exc;
 	html_content *htmlc = pw;
 
+	/* Sibling positions used by selection may have changed */
+	nscss_select_sibling_cache_invalidate();
+
 	exc = dom_event_get_target(evt, &node);
 	if ((exc == DOM_NO_ERR) && (node != NULL)) {
 		exc = dom_node_get_node_type(node, &type);
@@ -711,6 +751,9 @@ dom_default_action_DOMSubtreeModified_cb(struct dom_event *evt, void *pw)
 	dom_exception exc;
 	html_content *htmlc = pw;
 
+	/* Sibling positions used by selection may have changed */
+	nscss_select_sibling_cache_invalidate();
+
 	exc = dom_event_get_target(evt, &node);
 	if ((exc == DOM_NO_ERR) && (node != NULL)) {
 		if (htmlc->title == (dom_node *)node) {
@@ -837,6 +880,8 @@ html_create_html_data(html_content *c, const http_parameter *params)
 	c->aborted = false;
 	c->refresh = false;
 	c->reflowing = false;
+	c->reflow_laid_out = 0;
+	c->reflow_reused = 0;
 	c->title = NULL;
 	c->bctx = NULL;
 	c->layout = NULL;
@@ -1091,9 +1136,11 @@ html_process_data(struct content *c, const char *data, unsigned int size)
 	dom_hubbub_error dom_ret;
 	nserror err = NSERROR_OK; /* assume its all going to be ok */
 
+	NSTRACE_BEGIN("html parse");
 	dom_ret = dom_hubbub_parser_parse_chunk(html->parser, 
 					      (const uint8_t *) data, 
 					      size);
+	NSTRACE_END("html parse");
 
 	err = libdom_hubbub_error_to_nserror(dom_ret);
 
@@ -1202,7 +1249,9 @@ html_begin_conversion(html_content *htmlc)
 	if (htmlc->parse_completed == false) {
 		NSLOG(netsurf, INFO, "Completing parse (%p)", htmlc);
 		/* complete parsing */
+		NSTRACE_BEGIN("html parse");
 		error = dom_hubbub_parser_completed(htmlc->parser);
+		NSTRACE_END("html parse");
 		if (error != DOM_HUBBUB_OK) {
 			NSLOG(netsurf, INFO, "Parsing failed");
 	
@@ -1393,7 +1442,10 @@ static void html_reformat(struct content *c, int width, int height)
 	uint64_t ms_before;
 	uint64_t ms_after;
 	uint64_t ms_interval;
+	unsigned int width_hits;
+	unsigned int width_misses;
 
+	NSTRACE_BEGIN("reformat");
 	nsu_getmonotonic_ms(&ms_before);
 
 	htmlc->reflowing = true;
@@ -1421,6 +1473,15 @@ static void html_reformat(struct content *c, int width, int height)
 
 	/* calculate next reflow time at three times what it took to reflow */
 	nsu_getmonotonic_ms(&ms_after);
+	NSTRACE_END("reformat");
+
+	font_width_cache_stats(&width_hits, &width_misses);
+	NSLOG(layout, INFO,
+	      "reflow of %p at width %d took %"PRIu64"ms: %u laid out, %u reused",
+	      htmlc, width, ms_after - ms_before,
+	      htmlc->reflow_laid_out, htmlc->reflow_reused);
+	NSLOG(layout, INFO, "text measurement cache %u hits, %u misses",
+	      width_hits, width_misses);
 
 	ms_interval = (ms_before - ms_after) * 3;
 	if (ms_interval < (nsoption_uint(min_reflow_period) * 10)) {
@@ -1517,10 +1578,19 @@ static void html_destroy_iframe(struct content_html_iframe *iframe)
 static void html_free_layout(html_content *htmlc)
 {
 	if (htmlc->bctx != NULL) {
+		uint64_t ms_before, ms_after;
+
+		html_box_memory_report(htmlc, "at teardown");
+
 		/* freeing talloc context should let the entire box
 		 * set be destroyed 
 		 */
+		nsu_getmonotonic_ms(&ms_before);
 		talloc_free(htmlc->bctx);
+		nsu_getmonotonic_ms(&ms_after);
+
+		NSLOG(netsurf, INFO, "box tree of %p freed in %"PRIu64"ms",
+		      htmlc, ms_after - ms_before);
 	}
 }
 
@@ -2388,6 +2458,8 @@ static content_type html_content_type(void)
 static void html_fini(void)
 {
 	html_css_fini();
+
+	font_width_cache_fini();
 }
 
 static const content_handler html_content_handler = {
@@ -1132,16 +1132,16 @@ void html_search(struct content *c, void *context,
 		if (html->search_string == NULL)
 			return;
 
-		if (html->search != NULL) {
-			search_destroy_context(html->search);
-			html->search = NULL;
+		/* Keep an existing context, so the new search can build
+		 * on its matches */
+		if (html->search == NULL) {
+			html->search = search_create_context(c, CONTENT_HTML,
+					context);
+
+			if (html->search == NULL)
+				return;
 		}
 
-		html->search = search_create_context(c, CONTENT_HTML, context);
-
-		if (html->search == NULL)
-			return;
-
 		search_step(html->search, flags, string);
 
 	} else {
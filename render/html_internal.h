@@ -103,6 +103,11 @@ typedef struct html_content {
 	/** Whether a layout (reflow) is in progress */
 	bool reflowing;
 
+	/** Number of layout roots laid out by the last reflow */
+	unsigned int reflow_laid_out;
+	/** Number of layout roots reused unchanged by the last reflow */
+	unsigned int reflow_reused;
+
 	/** Whether scripts are enabled for this content */
 	bool enable_scripting;
 
@@ -88,8 +88,6 @@ html_object_done(struct box *box,
 		 hlcache_handle *object,
 		 bool background)
 {
-	struct box *b;
-
 	if (background) {
 		box->background = object;
 		return;
@@ -98,9 +96,8 @@ html_object_done(struct box *box,
 	box->object = object;
 
 	if (!(box->flags & REPLACE_DIM)) {
-		/* invalidate parent min, max widths */
-		for (b = box; b; b = b->parent)
-			b->max_width = UNKNOWN_MAX_WIDTH;
+		/* invalidate parent min, max widths and layout */
+		box_invalidate_layout(box);
 
 		/* delete any clones of this box */
 		while (box->next && (box->next->flags & CLONE)) {
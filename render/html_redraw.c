@@ -1161,17 +1161,45 @@ static bool html_redraw_box_children(const html_content *html, struct box *box,
 {
 	struct box *c;
 
-	for (c = box->children; c; c = c->next) {
-
-		if (c->type != BOX_FLOAT_LEFT && c->type != BOX_FLOAT_RIGHT)
-			if (!html_redraw_box(html, c,
-					x_parent + box->x -
-					scrollbar_get_offset(box->scroll_x),
-					y_parent + box->y -
-					scrollbar_get_offset(box->scroll_y),
+	if (box->child_index != NULL) {
+		/* Only visit children which may overlap the clip */
+		int x = x_parent + box->x -
+				scrollbar_get_offset(box->scroll_x);
+		int y = y_parent + box->y -
+				scrollbar_get_offset(box->scroll_y);
+		unsigned int first, last, i;
+
+		/* Convert clip to unscaled coordinates relative to box,
+		 * allowing a pixel either side for rounding */
+		box_child_index_range(box,
+				(int) floorf(clip->y0 / scale) - y - 1,
+				(int) ceilf(clip->y1 / scale) - y + 1,
+				&first, &last);
+
+		for (i = first; i < last; i++) {
+			if (!html_redraw_box(html,
+					box->child_index->child[i], x, y,
 					clip, scale, current_background_color,
 					ctx))
 				return false;
+		}
+	} else {
+		for (c = box->children; c; c = c->next) {
+
+			if (c->type != BOX_FLOAT_LEFT &&
+					c->type != BOX_FLOAT_RIGHT)
+				if (!html_redraw_box(html, c,
+						x_parent + box->x -
+						scrollbar_get_offset(
+								box->scroll_x),
+						y_parent + box->y -
+						scrollbar_get_offset(
+								box->scroll_y),
+						clip, scale,
+						current_background_color,
+						ctx))
+					return false;
+		}
 	}
 	for (c = box->float_children; c; c = c->next_float)
 		if (!html_redraw_box(html, c,
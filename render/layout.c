@@ -47,6 +47,7 @@
 #include "utils/talloc.h"
 #include "utils/utils.h"
 #include "utils/nsoption.h"
+#include "utils/trace.h"
 #include "netsurf/inttypes.h"
 #include "netsurf/content.h"
 #include "netsurf/browser_window.h"
@@ -398,7 +399,7 @@ layout_minmax_line(struct box *first,
 
 			if (b->next) {
 				if (b->space == UNKNOWN_WIDTH) {
-					font_func->width(&fstyle, " ", 1,
+					font_width(font_func, &fstyle, " ", 1,
 							 &b->space);
 				}
 				max += b->space;
@@ -435,7 +436,7 @@ layout_minmax_line(struct box *first,
 							data.select.items; o;
 							o = o->next) {
 						int opt_width;
-						font_func->width(&fstyle,
+						font_width(font_func, &fstyle,
 								o->text,
 								strlen(o->text),
 								&opt_width);
@@ -449,7 +450,7 @@ layout_minmax_line(struct box *first,
 						b->width += SCROLLBAR_WIDTH;
 
 				} else {
-					font_func->width(&fstyle, b->text,
+					font_width(font_func, &fstyle, b->text,
 						b->length, &b->width);
 					b->flags |= MEASURED;
 				}
@@ -457,7 +458,7 @@ layout_minmax_line(struct box *first,
 			max += b->width;
 			if (b->next) {
 				if (b->space == UNKNOWN_WIDTH) {
-					font_func->width(&fstyle, " ", 1,
+					font_width(font_func, &fstyle, " ", 1,
 							 &b->space);
 				}
 				max += b->space;
@@ -484,8 +485,9 @@ layout_minmax_line(struct box *first,
 					for (j = i; j != b->length &&
 							b->text[j] != ' '; j++)
 						;
-					font_func->width(&fstyle, b->text + i,
-							 j - i, &width);
+					font_width(font_func, &fstyle,
+							b->text + i, j - i,
+							&width);
 					if (min < width)
 						min = width;
 					i = j + 1;
@@ -1757,6 +1759,77 @@ static void layout_move_children(struct box *box, int x, int y)
 }
 
 
+/**
+ * Check whether the last layout of a box can be used again.
+ *
+ * The previous layout remains valid if nothing within the box has
+ * changed since, it has no positioned boxes whose placement depends on
+ * the surrounding layout, and it is given the same space as before.
+ *
+ * \param  box	    box about to be laid out
+ * \param  width    width given to the layout
+ * \param  height   height given to the layout, or AUTO
+ * \return  true if the previous layout of the box is still valid
+ */
+static bool layout_cache_valid(struct box *box, int width, int height)
+{
+	return ((box->flags & (NEEDS_LAYOUT | HAS_POSITIONED)) == 0 &&
+			box->cached_layout.width == width &&
+			box->cached_layout.height == height);
+}
+
+
+/**
+ * Record the result of laying out a box for later reuse.
+ *
+ * \param  box	    box which has been laid out
+ * \param  width    width given to the layout
+ * \param  height   height given to the layout, or AUTO
+ */
+static void layout_cache_store(struct box *box, int width, int height)
+{
+	box->cached_layout.width = width;
+	box->cached_layout.height = height;
+	box->cached_layout.result_width = box->width;
+	box->cached_layout.result_height = box->height;
+	box->cached_layout.result_padding_bottom = box->padding[BOTTOM];
+	box->flags &= ~NEEDS_LAYOUT;
+}
+
+
+/**
+ * Update the flags which limit reuse of previous layouts.
+ *
+ * \param  box  box tree to update
+ * \return  true if box or any descendant is positioned
+ */
+static bool layout_update_cache_flags(struct box *box)
+{
+	struct box *c;
+	bool positioned = false;
+
+	box->flags &= ~(HAS_POSITIONED | HAS_FLOATS);
+
+	if (box->style != NULL &&
+			css_computed_position(box->style) !=
+					CSS_POSITION_STATIC) {
+		positioned = true;
+	}
+
+	for (c = box->children; c; c = c->next) {
+		if (layout_update_cache_flags(c))
+			positioned = true;
+		if (c->type == BOX_FLOAT_LEFT || c->type == BOX_FLOAT_RIGHT)
+			box->flags |= HAS_FLOATS;
+	}
+
+	if (positioned)
+		box->flags |= HAS_POSITIONED;
+
+	return positioned;
+}
+
+
 /**
  * Layout a table.
  *
@@ -1801,6 +1874,22 @@ static bool layout_table(struct box *table, int available_width,
 	assert(table->children && table->children->children);
 	assert(columns);
 
+	if (layout_cache_valid(table, available_width, AUTO)) {
+		/* contents unchanged; only the table's own margins need
+		 * finding again */
+		layout_find_dimensions(available_width, -1, table, style,
+				0, 0, 0, 0, 0, 0, table->margin,
+				table->padding, table->border);
+		if (table->margin[TOP] == AUTO)
+			table->margin[TOP] = 0;
+		if (table->margin[BOTTOM] == AUTO)
+			table->margin[BOTTOM] = 0;
+		table->width = table->cached_layout.result_width;
+		table->height = table->cached_layout.result_height;
+		content->reflow_reused++;
+		return true;
+	}
+
 	/* allocate working buffers */
 	col = malloc(columns * sizeof col[0]);
 	excess_y = malloc(columns * sizeof excess_y[0]);
@@ -2314,6 +2403,14 @@ static bool layout_table(struct box *table, int available_width,
 	table->width = table_width;
 	table->height = table_height;
 
+	/* tables with a percentage height depend on the height of
+	 * their containing block so cannot be reused */
+	content->reflow_laid_out++;
+	if (css_computed_height(style, &value, &unit) != CSS_HEIGHT_SET ||
+			unit != CSS_UNIT_PCT) {
+		layout_cache_store(table, available_width, AUTO);
+	}
+
 	return true;
 }
 
@@ -2484,6 +2581,9 @@ layout_block_context(struct box *block,
 	bool in_margin = false;
 	css_fixed gadget_size;
 	css_unit gadget_unit; /* Checkbox / radio buttons */
+	int given_width = block->width;
+	int given_height = block->height;
+	bool cacheable;
 
 	assert(block->type == BOX_BLOCK ||
 			block->type == BOX_INLINE_BLOCK ||
@@ -2491,6 +2591,25 @@ layout_block_context(struct box *block,
 	assert(block->width != UNKNOWN_WIDTH);
 	assert(block->width != AUTO);
 
+	/* Table cells have their children moved by vertical alignment
+	 * after layout, and the root depends on the viewport, so only
+	 * floats, inline blocks and overflow blocks are reused. */
+	cacheable = (block->type != BOX_TABLE_CELL &&
+			block->parent != NULL &&
+			block->object == NULL &&
+			block->gadget == NULL &&
+			!(block->flags & (REPLACE_DIM | IFRAME)));
+	if (cacheable && layout_cache_valid(block,
+			given_width, given_height)) {
+		block->height = block->cached_layout.result_height;
+		/* the caller recomputed the padding, without the space
+		 * for any horizontal scrollbar added after layout */
+		block->padding[BOTTOM] =
+				block->cached_layout.result_padding_bottom;
+		content->reflow_reused++;
+		return true;
+	}
+
 	block->float_children = NULL;
 	block->cached_place_below_level = 0;
 	block->clear_level = 0;
@@ -2945,6 +3064,10 @@ layout_block_context(struct box *block,
 				block->padding[BOTTOM], block->padding[LEFT]);
 	}
 
+	content->reflow_laid_out++;
+	if (cacheable)
+		layout_cache_store(block, given_width, given_height);
+
 	return true;
 }
 
@@ -3010,7 +3133,7 @@ layout_lists(struct box *box,
 				if (marker->width == UNKNOWN_WIDTH) {
 					font_plot_style_from_css(marker->style,
 							&fstyle);
-					font_func->width(&fstyle,
+					font_width(font_func, &fstyle,
 							marker->text,
 							marker->length,
 							&marker->width);
@@ -3740,6 +3863,13 @@ bool layout_document(html_content *content, int width, int height)
 	struct box *doc = content->layout;
 	const struct gui_layout_table *font_func = content->font_func;
 
+	NSTRACE_BEGIN("layout");
+
+	content->reflow_laid_out = 0;
+	content->reflow_reused = 0;
+
+	font_width_cache_validate();
+
 	layout_minmax_block(doc, font_func);
 
 	layout_block_find_dimensions(width, height, 0, 0, doc);
@@ -3779,6 +3909,12 @@ bool layout_document(html_content *content, int width, int height)
 
 	layout_calculate_descendant_bboxes(doc);
 
+	layout_update_cache_flags(doc);
+
+	box_index_children(doc);
+
+	NSTRACE_END("layout");
+
 	return ret;
 }
 
@@ -3851,7 +3987,7 @@ layout_text_box_split(html_content *content,
 		/* We're need to add a space, and we don't know how big
 		 * it's to be, OR we have a space of unknown width anyway;
 		 * Calculate space width */
-		font_func->width(fstyle, " ", 1, &space_width);
+		font_width(font_func, fstyle, " ", 1, &space_width);
 	}
 
 	if (split_box->space == UNKNOWN_WIDTH)
@@ -4281,7 +4417,8 @@ layout_line(struct box *first,
 		} else if (b->type == BOX_INLINE_END) {
 			b->width = 0;
 			if (b->space == UNKNOWN_WIDTH) {
-				font_func->width(&fstyle, " ", 1, &b->space);
+				font_width(font_func, &fstyle, " ", 1,
+						&b->space);
 				/** \todo handle errors */
 			}
 			space_after = b->space;
@@ -4320,7 +4457,7 @@ layout_line(struct box *first,
 							data.select.items; o;
 							o = o->next) {
 						int opt_width;
-						font_func->width(&fstyle,
+						font_width(font_func, &fstyle,
 								o->text,
 								strlen(o->text),
 								&opt_width);
@@ -4332,7 +4469,7 @@ layout_line(struct box *first,
 					if (nsoption_bool(core_select_menu))
 						b->width += SCROLLBAR_WIDTH;
 				} else {
-					font_func->width(&fstyle, b->text,
+					font_width(font_func, &fstyle, b->text,
 							b->length, &b->width);
 					b->flags |= MEASURED;
 				}
@@ -4345,14 +4482,15 @@ layout_line(struct box *first,
 			if (b->text && (x + b->width < x1 - x0) &&
 					!(b->flags & MEASURED) &&
 					b->next) {
-				font_func->width(&fstyle, b->text,
+				font_width(font_func, &fstyle, b->text,
 						 b->length, &b->width);
 				b->flags |= MEASURED;
 			}
 
 			x += b->width;
 			if (b->space == UNKNOWN_WIDTH) {
-				font_func->width(&fstyle, " ", 1, &b->space);
+				font_width(font_func, &fstyle, " ", 1,
+						&b->space);
 				/** \todo handle errors */
 			}
 			space_after = b->space;
@@ -4481,7 +4619,7 @@ layout_line(struct box *first,
 					font_plot_style_from_css(b->style,
 							&fstyle);
 					/** \todo handle errors */
-					font_func->width(&fstyle, " ", 1,
+					font_width(font_func, &fstyle, " ", 1,
 							 &b->space);
 				}
 				space_after = b->space;
@@ -4872,6 +5010,19 @@ bool layout_inline_container(struct box *inline_container, int width,
 
 	assert(inline_container->type == BOX_INLINE_CONTAINER);
 
+	/* Lines only depend on their position when there are floats
+	 * to flow around. */
+	if (cont->float_children == NULL &&
+			!(inline_container->flags & HAS_FLOATS) &&
+			layout_cache_valid(inline_container, width, AUTO)) {
+		inline_container->width =
+				inline_container->cached_layout.result_width;
+		inline_container->height =
+				inline_container->cached_layout.result_height;
+		content->reflow_reused++;
+		return true;
+	}
+
 	NSLOG(layout, DEBUG, 
 	      "inline_container %p, width %i, cont %p, cx %i, cy %i",
 	      inline_container,
@@ -4922,6 +5073,10 @@ bool layout_inline_container(struct box *inline_container, int width,
 	inline_container->width = maxwidth;
 	inline_container->height = y;
 
+	content->reflow_laid_out++;
+	if (cont->float_children == NULL)
+		layout_cache_store(inline_container, width, AUTO);
+
 	return true;
 }
 
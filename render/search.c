@@ -24,13 +24,19 @@
  */
 
 #include <ctype.h>
+#include <stdint.h>
 #include <string.h>
 #include <dom/dom.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "utils/config.h"
 #include "utils/log.h"
 #include "utils/messages.h"
 #include "utils/utils.h"
+#include "utils/ascii.h"
 #include "content/content.h"
 #include "content/hlcache.h"
 #include "desktop/selection.h"
@@ -149,6 +155,168 @@ static void free_matches(struct search_context *context)
 }
 
 
+/**
+ * Determine whether a pattern is free of wildcards
+ *
+ * \param  pattern  the pattern (unterminated)
+ * \param  p_len    length of pattern
+ * \return true iff the pattern contains neither '*' nor '#'
+ */
+static bool pattern_is_literal(const char *pattern, size_t p_len)
+{
+	return (memchr(pattern, '*', p_len) == NULL &&
+		memchr(pattern, '#', p_len) == NULL);
+}
+
+
+/**
+ * Compare two strings, optionally ignoring ASCII case
+ *
+ * \param  a          first string
+ * \param  b          second string
+ * \param  len        number of bytes to compare
+ * \param  case_sens  true iff case sensitive comparison required
+ * \return true iff the strings are equal
+ */
+static bool pattern_equal(const char *a, const char *b, size_t len,
+		bool case_sens)
+{
+	size_t i;
+
+	if (case_sens)
+		return (memcmp(a, b, len) == 0);
+
+	for (i = 0; i < len; i++) {
+		if (ascii_to_upper(a[i]) != ascii_to_upper(b[i]))
+			return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Find the first byte equal to a letter in either case
+ *
+ * Upper and lower case ASCII letters differ only in bit 5, so the
+ * bytes are compared with that bit set.  SSE2 compares sixteen bytes
+ * at a time where available, and elsewhere eight are compared at once
+ * in a machine word.
+ *
+ * \param  s      the string to be searched
+ * \param  len    length of the string
+ * \param  lower  the letter, in lower case
+ * \return pointer to first match, NULL if none
+ */
+static const char *find_caseless_byte(const char *s, size_t len, char lower)
+{
+	const char *es = s + len;
+
+#if defined(__SSE2__)
+	const __m128i fold = _mm_set1_epi8(0x20);
+	const __m128i want = _mm_set1_epi8(lower);
+
+	while (es - s >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *) s);
+		int mask;
+
+		block = _mm_or_si128(block, fold);
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, want));
+		if (mask != 0) {
+			while ((mask & 1) == 0) {
+				mask >>= 1;
+				s++;
+			}
+			return s;
+		}
+		s += 16;
+	}
+#else
+	const uint64_t ones = UINT64_C(0x0101010101010101);
+	const uint64_t highs = UINT64_C(0x8080808080808080);
+	const uint64_t fold = ones * 0x20;
+	const uint64_t want = ones * (uint8_t) lower;
+
+	while (es - s >= 8) {
+		uint64_t word;
+
+		memcpy(&word, s, sizeof(word));
+		word = (word | fold) ^ want;
+		if (((word - ones) & ~word & highs) != 0)
+			break;
+		s += 8;
+	}
+#endif
+
+	for (; s < es; s++) {
+		if ((*s | 0x20) == lower)
+			return s;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Find the first occurrence of a pattern without wildcards
+ *
+ * Candidate positions are found by the first byte of the pattern, and
+ * their last byte is checked before the rest of it is compared.
+ *
+ * \param  string     the string to be searched (unterminated)
+ * \param  s_len      length of the string to be searched
+ * \param  pattern    the pattern for which we are searching (unterminated)
+ * \param  p_len      length of pattern, which must not be zero
+ * \param  case_sens  true iff case sensitive match required
+ * \return pointer to first match, NULL if none
+ */
+static const char *find_literal(const char *string, size_t s_len,
+		const char *pattern, size_t p_len, bool case_sens)
+{
+	const char *s = string;
+	const char *last;
+	char first = pattern[0];
+	char end = pattern[p_len - 1];
+	bool caseless_first;
+
+	if (p_len > s_len)
+		return NULL;
+
+	/* last position a match may start at */
+	last = string + s_len - p_len;
+
+	caseless_first = (!case_sens && ascii_is_alpha(first));
+	if (caseless_first)
+		first = ascii_to_lower(first);
+
+	while (s <= last) {
+		if (caseless_first) {
+			s = find_caseless_byte(s, last - s + 1, first);
+		} else {
+			s = memchr(s, first, last - s + 1);
+		}
+		if (s == NULL)
+			return NULL;
+
+		if (case_sens) {
+			if (s[p_len - 1] == end &&
+			    memcmp(s + 1, pattern + 1, p_len - 1) == 0)
+				return s;
+		} else {
+			if (ascii_to_upper(s[p_len - 1]) ==
+					ascii_to_upper(end) &&
+			    pattern_equal(s + 1, pattern + 1, p_len - 1,
+					false))
+				return s;
+		}
+
+		s++;
+	}
+
+	return NULL;
+}
+
+
 /**
  * Find the first occurrence of 'match' in 'string' and return its index
  *
@@ -174,6 +342,13 @@ static const char *find_pattern(const char *string, int s_len,
 	bool first = true;
 	int top = 0;
 
+	if (p_len > 0 && pattern_is_literal(pattern, p_len)) {
+		ss = find_literal(string, s_len, pattern, p_len, case_sens);
+		if (ss != NULL)
+			*m_len = p_len;
+		return ss;
+	}
+
 	while (p < ep) {
 		bool matches;
 		if (p < pattern || *p == '*') {
@@ -421,6 +596,130 @@ static bool find_occurrences_text(const char *pattern, int p_len,
 }
 
 
+/**
+ * Remove an entry from the list of matches, deleting its selection
+ *
+ * \param context  The search context the entry belongs to.
+ * \param entry    The entry to remove.
+ */
+static void remove_entry(struct search_context *context,
+		struct list_entry *entry)
+{
+	if (entry->prev == NULL)
+		context->found->next = entry->next;
+	else
+		entry->prev->next = entry->next;
+
+	if (entry->next == NULL)
+		context->found->prev = entry->prev;
+	else
+		entry->next->prev = entry->prev;
+
+	if (entry->sel) {
+		selection_clear(entry->sel, true);
+		selection_destroy(entry->sel);
+	}
+	free(entry);
+}
+
+
+/**
+ * Refine the matches of the previous search to those of a longer string
+ *
+ * Where the previous string was a literal prefix of the new one, every
+ * match of the new string starts where a match of the previous one did,
+ * provided matches of the previous string could not overlap, and so had
+ * not been skipped.  The existing matches are then checked rather than
+ * the whole document searched again.
+ *
+ * \param string     the new string to search for
+ * \param p_len      length of the new string
+ * \param case_sens  whether to perform a case sensitive search
+ * \param context    The search context holding the previous matches.
+ * \return true if the matches were refined, false if a full search is
+ *         required
+ */
+static bool refine_matches(const char *string, int p_len, bool case_sens,
+		struct search_context *context)
+{
+	struct list_entry *a, *b;
+	struct list_entry *kept = NULL;
+	size_t prev_len;
+	size_t k;
+
+	if (context->string == NULL || context->prev_case_sens != case_sens)
+		return false;
+
+	prev_len = strlen(context->string);
+	if (prev_len == 0 || prev_len >= (size_t) p_len ||
+	    !pattern_is_literal(string, p_len) ||
+	    !pattern_equal(context->string, string, prev_len, case_sens))
+		return false;
+
+	/* matches of a string which has a border may overlap */
+	for (k = 1; k < prev_len; k++) {
+		if (pattern_equal(context->string,
+				context->string + prev_len - k, k, case_sens))
+			return false;
+	}
+
+	/* reflows may have split or relabelled the boxes the matches
+	 * were found in; search afresh unless every match still lies
+	 * within its box */
+	if (context->is_html == true) {
+		for (a = context->found->next; a; a = a->next) {
+			struct box *box = a->start_box;
+
+			if (box == NULL || box->text == NULL ||
+			    a->start_idx < box->byte_offset ||
+			    a->start_idx - box->byte_offset > box->length)
+				return false;
+		}
+	}
+
+	for (a = context->found->next; a; a = b) {
+		const char *text = NULL;
+		size_t avail = 0;
+
+		b = a->next;
+
+		if (context->is_html == true) {
+			struct box *box = a->start_box;
+			size_t offset = a->start_idx - box->byte_offset;
+
+			text = box->text + offset;
+			avail = box->length - offset;
+		} else {
+			size_t offset, length;
+			int line = textplain_find_line(context->c,
+					a->start_idx);
+
+			if (line >= 0)
+				text = textplain_get_line(context->c, line,
+						&offset, &length);
+			if (text != NULL) {
+				avail = offset + length - a->start_idx;
+				text += a->start_idx - offset;
+			}
+		}
+
+		if (text != NULL && avail >= (size_t) p_len &&
+		    (kept == NULL || kept->start_box != a->start_box ||
+		     a->start_idx >= kept->end_idx) &&
+		    pattern_equal(text, string, p_len, case_sens)) {
+			a->end_idx = a->start_idx + p_len;
+			if (a->sel)
+				selection_set_end(a->sel, a->end_idx);
+			kept = a;
+		} else {
+			remove_entry(context, a);
+		}
+	}
+
+	return true;
+}
+
+
 /**
  * Search for a string in the box tree
  *
@@ -458,12 +757,17 @@ static void search_text(const char *string, int string_len,
 	/* check if we need to start a new search or continue an old one */
 	if (context->newsearch) {
 		bool res;
+		bool refined;
+
+		refined = refine_matches(string, string_len, case_sensitive,
+				context);
 
 		if (context->string != NULL)
 			free(context->string);
 
 		context->current = NULL;
-		free_matches(context);
+		if (!refined)
+			free_matches(context);
 
 		context->string = malloc(string_len + 1);
 		if (context->string != NULL) {
@@ -473,7 +777,9 @@ static void search_text(const char *string, int string_len,
 
 		guit->search->hourglass(true, context->gui_p);
 
-		if (context->is_html == true) {
+		if (refined) {
+			res = true;
+		} else if (context->is_html == true) {
 			res = find_occurrences_html(string, string_len,
 					box, case_sensitive, context);
 		} else {
@@ -556,6 +862,10 @@ void search_step(struct search_context *context, search_flags_t flags,
 
 	guit->search->add_recent(string, context->gui_p);
 
+	/* a different string starts a new search */
+	if (context->string != NULL && strcmp(string, context->string) != 0)
+		context->newsearch = true;
+
 	string_len = strlen(string);
 	for (i = 0; i < string_len; i++)
 		if (string[i] != '#' && string[i] != '*')
@@ -564,6 +874,11 @@ void search_step(struct search_context *context, search_flags_t flags,
 		union content_msg_data msg_data;
 		free_matches(context);
 
+		/* there are no matches to refine */
+		free(context->string);
+		context->string = NULL;
+		context->newsearch = true;
+
 		guit->search->status(true, context->gui_p);
 		guit->search->back_state(false, context->gui_p);
 		guit->search->forward_state(false, context->gui_p);
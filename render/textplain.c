@@ -25,13 +25,16 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <strings.h>
 #include <math.h>
 
 #include <parserutils/input/inputstream.h>
 #include <parserutils/charset/utf8.h>
+#include <nsutils/time.h>
 
 #include "utils/corestrings.h"
 #include "utils/http.h"
@@ -39,11 +42,13 @@
 #include "utils/messages.h"
 #include "utils/utils.h"
 #include "utils/utf8.h"
+#include "netsurf/inttypes.h"
 #include "netsurf/content.h"
 #include "netsurf/keypress.h"
 #include "netsurf/browser_window.h"
 #include "netsurf/plotters.h"
 #include "netsurf/layout.h"
+#include "netsurf/misc.h"
 #include "content/content_protected.h"
 #include "content/hlcache.h"
 #include "css/utils.h"
@@ -57,9 +62,48 @@
 #include "render/html.h"
 #include "render/search.h"
 
-struct textplain_line {
-	size_t	start;
-	size_t	length;
+/** Number of lines sharing a base offset in a line index */
+#define TEXTPLAIN_LINE_GROUP 64
+
+/**
+ * Widest line, in characters, that text is broken to.
+ *
+ * This bounds the bytes in a line, so that offsets within a group of
+ * lines fit in the 30 bits available to them.
+ */
+#define TEXTPLAIN_MAX_COLUMNS 4096
+
+/** Group of consecutive lines in a line index */
+struct textplain_line_group {
+	size_t base;	/**< Offset of the first line of the group */
+	/** Offset of each line from base, shifted left by two, ored with
+	 * the number of line terminator bytes following it */
+	uint32_t start[TEXTPLAIN_LINE_GROUP];
+	/** Number of columns used by each line */
+	uint16_t columns[TEXTPLAIN_LINE_GROUP];
+};
+
+/**
+ * Index of the lines of text.
+ *
+ * The length of each line is the distance to the start of the next,
+ * less the terminator, so only start offsets need to be kept.  These
+ * are stored relative to a base offset shared by a group of lines,
+ * taking a little over six bytes per line.
+ */
+struct textplain_line_index {
+	struct textplain_line_group *group;
+	unsigned long group_alloc;	/**< Number of groups allocated */
+	unsigned long count;		/**< Number of lines */
+	size_t end;			/**< Offset of end of last line */
+};
+
+/** State of line breaking, which may be suspended at any character */
+struct textplain_break {
+	size_t pos;		/**< Offset of next character */
+	size_t line_start;	/**< Offset of start of current line */
+	size_t space;		/**< Offset after last space in line, or 0 */
+	size_t col;		/**< Columns used by current line */
 };
 
 typedef struct textplain_content {
@@ -70,8 +114,20 @@ typedef struct textplain_content {
 	char *utf8_data;
 	size_t utf8_data_size;
 	size_t utf8_data_allocated;
-	unsigned long physical_line_count;
-	struct textplain_line *physical_line;
+
+	struct textplain_line_index lines; /**< Lines at formatted width */
+	struct textplain_break brk;	/**< Line breaking state */
+	size_t columns;			/**< Width of lines, in characters */
+
+	/** Whether lines are being reflowed from source */
+	bool reflowing;
+	/** Lines at the previous width, while reflowing */
+	struct textplain_line_index source;
+	unsigned long source_line;	/**< Next line of source to reflow */
+	bool breaking;			/**< Whether brk is in a source run */
+	size_t break_limit;		/**< End of source run being broken */
+	bool break_last;		/**< Whether it is the last source run */
+
 	int formatted_width;
 	struct browser_window *bw;
 
@@ -90,6 +146,15 @@ typedef struct textplain_content {
 #define TAB_WIDTH 8  /* must be power of 2 currently */
 #define TEXT_SIZE 10 * FONT_SIZE_SCALE  /* Unscaled text size in pt */
 
+/** Bytes of a long line broken between checks of the time */
+#define TEXTPLAIN_BREAK_CHUNK 16384
+
+/** Lines reflowed between checks of the time */
+#define TEXTPLAIN_REFLOW_CLOCK_INTERVAL 256
+
+/** Time reflow may run for before yielding to the scheduler */
+#define TEXTPLAIN_REFLOW_SLICE_MS 10
+
 static plot_font_style_t textplain_style = {
 	.family = PLOT_FONT_FAMILY_MONOSPACE,
 	.size = TEXT_SIZE,
@@ -174,8 +239,11 @@ textplain_create_internal(textplain_content *c, lwc_string *encoding)
 	c->utf8_data = utf8_data;
 	c->utf8_data_size = 0;
 	c->utf8_data_allocated = CHUNK;
-	c->physical_line = 0;
-	c->physical_line_count = 0;
+	memset(&c->lines, 0, sizeof(c->lines));
+	memset(&c->brk, 0, sizeof(c->brk));
+	c->columns = TEXTPLAIN_MAX_COLUMNS;
+	c->reflowing = false;
+	memset(&c->source, 0, sizeof(c->source));
 	c->formatted_width = 0;
 	c->bw = NULL;
 
@@ -239,6 +307,247 @@ textplain_create(const content_handler *handler,
 }
 
 
+/**
+ * Find the start of a line
+ *
+ * \param index   line index
+ * \param lineno  line number, which must be in the index
+ * \return offset of the start of the line
+ */
+static size_t
+textplain_line_start(const struct textplain_line_index *index,
+		     unsigned long lineno)
+{
+	const struct textplain_line_group *group;
+
+	group = &index->group[lineno / TEXTPLAIN_LINE_GROUP];
+
+	return group->base +
+		(group->start[lineno % TEXTPLAIN_LINE_GROUP] >> 2);
+}
+
+
+/**
+ * Find the number of terminator bytes following a line
+ *
+ * \param index   line index
+ * \param lineno  line number, which must be in the index
+ * \return number of terminator bytes, at most 2
+ */
+static unsigned int
+textplain_line_term(const struct textplain_line_index *index,
+		    unsigned long lineno)
+{
+	const struct textplain_line_group *group;
+
+	group = &index->group[lineno / TEXTPLAIN_LINE_GROUP];
+
+	return group->start[lineno % TEXTPLAIN_LINE_GROUP] & 3;
+}
+
+
+/**
+ * Find the length of a line, excluding its terminator
+ *
+ * \param index   line index
+ * \param lineno  line number, which must be in the index
+ * \return length of the line in bytes
+ */
+static size_t
+textplain_line_length(const struct textplain_line_index *index,
+		      unsigned long lineno)
+{
+	size_t start = textplain_line_start(index, lineno);
+
+	if (lineno + 1 < index->count) {
+		return textplain_line_start(index, lineno + 1) - start -
+			textplain_line_term(index, lineno);
+	}
+
+	return index->end - start;
+}
+
+
+/**
+ * Add a line to the end of a line index
+ *
+ * \param index    line index
+ * \param start    offset of start of line
+ * \param length   length of line, excluding terminator
+ * \param term     number of terminator bytes following the line
+ * \param columns  columns used by the line
+ * \return NSERROR_OK on success else NSERROR_NOMEM
+ */
+static nserror
+textplain_line_append(struct textplain_line_index *index,
+		      size_t start,
+		      size_t length,
+		      unsigned int term,
+		      size_t columns)
+{
+	struct textplain_line_group *group;
+	unsigned long n = index->count;
+
+	if ((n % TEXTPLAIN_LINE_GROUP) == 0) {
+		if ((n / TEXTPLAIN_LINE_GROUP) == index->group_alloc) {
+			unsigned long alloc = index->group_alloc * 2;
+
+			if (alloc == 0)
+				alloc = 16;
+
+			group = realloc(index->group, alloc * sizeof(*group));
+			if (group == NULL)
+				return NSERROR_NOMEM;
+
+			index->group = group;
+			index->group_alloc = alloc;
+		}
+
+		index->group[n / TEXTPLAIN_LINE_GROUP].base = start;
+	}
+
+	group = &index->group[n / TEXTPLAIN_LINE_GROUP];
+
+	assert(start - group->base < (1 << 30));
+	assert(term <= 2);
+
+	group->start[n % TEXTPLAIN_LINE_GROUP] =
+		((start - group->base) << 2) | term;
+	group->columns[n % TEXTPLAIN_LINE_GROUP] =
+		(columns > UINT16_MAX) ? UINT16_MAX : columns;
+
+	index->count++;
+	index->end = start + length;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Free the lines of a line index
+ *
+ * \param index  line index to empty
+ */
+static void textplain_line_index_free(struct textplain_line_index *index)
+{
+	free(index->group);
+	memset(index, 0, sizeof(*index));
+}
+
+
+/**
+ * Break text into lines
+ *
+ * Text is broken into lines no wider than the content's current number
+ * of columns, preferring to break after a space.  Breaking stops when
+ * the limit is reached, or at a line terminator at the end of the data
+ * received so far, and may be resumed with the same state.
+ *
+ * \param text   content of type CONTENT_TEXTPLAIN
+ * \param index  line index to add lines to
+ * \param brk    line breaking state
+ * \param limit  offset to stop breaking at
+ * \param flush  add the line in progress to the index at the limit
+ * \return NSERROR_OK on success else NSERROR_NOMEM
+ */
+static nserror
+textplain_break(textplain_content *text,
+		struct textplain_line_index *index,
+		struct textplain_break *brk,
+		size_t limit,
+		bool flush)
+{
+	const uint8_t *data = (const uint8_t *) text->utf8_data;
+	size_t size = text->utf8_data_size;
+	nserror res;
+
+	while (brk->pos < limit) {
+		size_t i = brk->pos;
+		size_t csize = 1; /* number of bytes in character */
+		uint32_t chr = data[i];
+		size_t next_col;
+
+		if (chr >= 0x80) {
+			parserutils_error perror;
+
+			perror = parserutils_charset_utf8_to_ucs4(data + i,
+					size - i, &chr, &csize);
+			if (perror != PARSERUTILS_OK) {
+				chr = 0xfffd;
+				csize = 1;
+			}
+		}
+
+		if (chr == '\n' || chr == '\r') {
+			unsigned int term = 1;
+
+			if (i + 1 == size && text->inputstream != NULL) {
+				/* wait to see if this starts a CR/LF pair */
+				return NSERROR_OK;
+			}
+
+			/* include second char of CR/LF or LF/CR pair */
+			if (i + 1 < size &&
+			    data[i + 1] != data[i] &&
+			    (data[i + 1] == '\n' || data[i + 1] == '\r')) {
+				term = 2;
+			}
+
+			res = textplain_line_append(index, brk->line_start,
+					i - brk->line_start, term, brk->col);
+			if (res != NSERROR_OK)
+				return res;
+
+			brk->pos = brk->line_start = i + term;
+			brk->space = 0;
+			brk->col = 0;
+			continue;
+		}
+
+		next_col = brk->col + 1;
+
+		if (chr == '\t') {
+			next_col = (next_col + TAB_WIDTH - 1) & ~(TAB_WIDTH - 1);
+		}
+
+		if (next_col >= text->columns && brk->col > 0) {
+			/* break after last space in line, if any, or
+			 * before this character */
+			size_t end = (brk->space != 0) ? brk->space : i;
+
+			res = textplain_line_append(index, brk->line_start,
+					end - brk->line_start, 0, brk->col);
+			if (res != NSERROR_OK)
+				return res;
+
+			brk->pos = brk->line_start = end;
+			brk->space = 0;
+			brk->col = 0;
+			continue;
+		}
+
+		brk->col = next_col;
+		if (chr == ' ')
+			brk->space = i + 1;
+
+		brk->pos = i + csize;
+	}
+
+	if (flush) {
+		res = textplain_line_append(index, brk->line_start,
+				brk->pos - brk->line_start, 0, brk->col);
+		if (res != NSERROR_OK)
+			return res;
+
+		brk->line_start = brk->pos;
+		brk->space = 0;
+		brk->col = 0;
+	}
+
+	return NSERROR_OK;
+}
+
+
 /**
  * copy utf8 encoded data
  */
@@ -356,6 +665,11 @@ textplain_process_data(struct content *c, const char *data, unsigned int size)
 	if (textplain_drain_input(text, stream, PARSERUTILS_NEEDDATA) == false)
 		goto no_memory;
 
+	/* Break the new data into lines as it arrives */
+	if (textplain_break(text, &text->lines, &text->brk,
+			    text->utf8_data_size, false) != NSERROR_OK)
+		goto no_memory;
+
 	return true;
 
 no_memory:
@@ -384,6 +698,14 @@ static bool textplain_convert(struct content *c)
 	parserutils_inputstream_destroy(stream);
 	text->inputstream = NULL;
 
+	if (textplain_break(text, &text->lines, &text->brk,
+			    text->utf8_data_size, true) != NSERROR_OK)
+		return false;
+
+	NSLOG(netsurf, INFO, "content %p %lu lines, index %"PRIsizet" bytes",
+	      c, text->lines.count,
+	      text->lines.group_alloc * sizeof(struct textplain_line_group));
+
 	content_set_ready(c);
 	content_set_done(c);
 	content_set_status(c, messages_get("Done"));
@@ -406,21 +728,224 @@ static float textplain_line_height(void)
 }
 
 
+/**
+ * Set the height of a CONTENT_TEXTPLAIN from its lines
+ *
+ * While reflowing, the lines yet to be reflowed are counted once each.
+ *
+ * \param text  content of type CONTENT_TEXTPLAIN
+ */
+static void textplain_set_height(textplain_content *text)
+{
+	unsigned long line_count = text->lines.count;
+
+	if (text->reflowing) {
+		line_count += text->source.count - text->source_line;
+	}
+
+	text->base.height = line_count * textplain_line_height() +
+		MARGIN + MARGIN;
+}
+
+
+/**
+ * Reflow lines to the current width
+ *
+ * Lines of the source index which fit the current width are copied,
+ * and only the others are broken again.  Reflow stops when enough lines
+ * are available, when the deadline passes, or when it is complete.
+ *
+ * \param text      content of type CONTENT_TEXTPLAIN
+ * \param lines     number of lines required
+ * \param offset    offset in text which must be within the lines
+ * \param deadline  monotonic time to stop at, or 0 for none
+ * \return NSERROR_OK on success else NSERROR_NOMEM
+ */
+static nserror
+textplain_reflow(textplain_content *text,
+		 unsigned long lines,
+		 size_t offset,
+		 uint64_t deadline)
+{
+	struct textplain_line_index *source = &text->source;
+	unsigned int steps = 0;
+	nserror res;
+
+	while (text->reflowing) {
+		unsigned long first, last;
+
+		if (text->lines.count >= lines && text->lines.count > 0 &&
+		    text->lines.end +
+		    textplain_line_term(&text->lines,
+					text->lines.count - 1) > offset) {
+			break;
+		}
+
+		if (deadline != 0 && steps >= TEXTPLAIN_REFLOW_CLOCK_INTERVAL) {
+			uint64_t now_ms;
+
+			nsu_getmonotonic_ms(&now_ms);
+			if (now_ms >= deadline)
+				break;
+
+			steps = 0;
+		}
+
+		if (text->breaking) {
+			/* Continue breaking a source run */
+			size_t limit = text->break_limit;
+			bool flush = text->break_last;
+
+			if (text->brk.pos < limit &&
+			    limit - text->brk.pos > TEXTPLAIN_BREAK_CHUNK) {
+				limit = text->brk.pos + TEXTPLAIN_BREAK_CHUNK;
+				flush = false;
+			}
+
+			res = textplain_break(text, &text->lines, &text->brk,
+					      limit, flush);
+			if (res != NSERROR_OK)
+				return res;
+
+			/* A character may cross the chunk's limit, so the
+			 * run is only done once broken up to its own */
+			if (limit == text->break_limit)
+				text->breaking = false;
+
+			steps += TEXTPLAIN_REFLOW_CLOCK_INTERVAL / 4;
+			continue;
+		}
+
+		if (text->source_line >= source->count) {
+			/* Reflow complete */
+			textplain_line_index_free(source);
+			text->reflowing = false;
+			break;
+		}
+
+		/* Find the run of source lines up to a line terminator */
+		first = last = text->source_line;
+		while (last + 1 < source->count &&
+		       textplain_line_term(source, last) == 0) {
+			last++;
+		}
+
+		if (first == last &&
+		    source->group[first / TEXTPLAIN_LINE_GROUP].columns[
+				first % TEXTPLAIN_LINE_GROUP] < text->columns) {
+			/* Line fits; copy it */
+			res = textplain_line_append(&text->lines,
+					textplain_line_start(source, first),
+					textplain_line_length(source, first),
+					textplain_line_term(source, first),
+					source->group[first /
+						TEXTPLAIN_LINE_GROUP].columns[
+						first % TEXTPLAIN_LINE_GROUP]);
+			if (res != NSERROR_OK)
+				return res;
+
+			text->source_line++;
+			steps++;
+			continue;
+		}
+
+		/* Break the run again */
+		text->brk.pos = textplain_line_start(source, first);
+		text->brk.line_start = text->brk.pos;
+		text->brk.space = 0;
+		text->brk.col = 0;
+		if (last + 1 < source->count) {
+			text->break_limit = textplain_line_start(source,
+								 last + 1);
+			text->break_last = false;
+		} else {
+			text->break_limit = source->end;
+			text->break_last = true;
+		}
+		text->breaking = true;
+		text->source_line = last + 1;
+	}
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Scheduled callback to continue reflowing a CONTENT_TEXTPLAIN
+ *
+ * \param p  content of type CONTENT_TEXTPLAIN
+ */
+static void textplain_reflow_callback(void *p)
+{
+	textplain_content *text = p;
+	union content_msg_data msg_data;
+	uint64_t now_ms;
+	nserror res;
+
+	nsu_getmonotonic_ms(&now_ms);
+
+	res = textplain_reflow(text, ULONG_MAX, SIZE_MAX,
+			       now_ms + TEXTPLAIN_REFLOW_SLICE_MS);
+	if (res != NSERROR_OK) {
+		NSLOG(netsurf, INFO, "out of memory (line_count %lu)",
+		      text->lines.count);
+		return;
+	}
+
+	if (text->reflowing) {
+		guit->misc->schedule(0, textplain_reflow_callback, text);
+		return;
+	}
+
+	NSLOG(netsurf, INFO, "content %p reflowed to %lu lines",
+	      text, text->lines.count);
+
+	textplain_set_height(text);
+
+	/* The extent is now known */
+	msg_data.background = false;
+	content_broadcast(&text->base, CONTENT_MSG_REFORMAT, &msg_data);
+}
+
+
+/**
+ * Reflow enough lines to cover part of a CONTENT_TEXTPLAIN
+ *
+ * Used where lines are needed before the scheduled reflow reaches them.
+ *
+ * \param text    content of type CONTENT_TEXTPLAIN
+ * \param lines   number of lines required
+ * \param offset  offset in text which must be within the lines
+ */
+static void
+textplain_reflow_to(textplain_content *text, unsigned long lines, size_t offset)
+{
+	if (text->reflowing == false)
+		return;
+
+	if (textplain_reflow(text, lines, offset, 0) != NSERROR_OK) {
+		NSLOG(netsurf, INFO, "out of memory (line_count %lu)",
+		      text->lines.count);
+	}
+
+	/* If this completed the reflow, the scheduled callback will find
+	 * nothing left to do, and report the new extent */
+}
+
+
 /**
  * Reformat a CONTENT_TEXTPLAIN to a new width.
+ *
+ * Lines are reflowed from those at the previous width.  Enough to fill
+ * the window are reflowed immediately, and the remainder from the
+ * scheduler, a slice at a time.
  */
 static void textplain_reformat(struct content *c, int width, int height)
 {
 	textplain_content *text = (textplain_content *) c;
-	char *utf8_data = text->utf8_data;
-	size_t utf8_data_size = text->utf8_data_size;
-	unsigned long line_count = 0;
-	struct textplain_line *line = text->physical_line;
-	struct textplain_line *line1;
-	size_t i, space, col;
-	size_t columns = 80;
 	int character_width;
-	size_t line_start;
+	int columns;
+	float line_height = textplain_line_height();
 	nserror res;
 
 	NSLOG(netsurf, INFO, "content %p w:%d h:%d", c, width, height);
@@ -431,99 +956,53 @@ static void textplain_reformat(struct content *c, int width, int height)
 	res = guit->layout->width(&textplain_style,
 				  "ABCDEFGH", 8,
 				  &character_width);
-	if (res != NSERROR_OK) {
+	if ((res != NSERROR_OK) || (character_width <= 0)) {
 		return;
 	}
 
 	columns = (width - MARGIN - MARGIN) * 8 / character_width;
+	if (columns < 1)
+		columns = 1;
+	else if (columns > TEXTPLAIN_MAX_COLUMNS)
+		columns = TEXTPLAIN_MAX_COLUMNS;
+
 	textplain_tab_width = (TAB_WIDTH * character_width) / 8;
 
 	text->formatted_width = width;
+	c->width = width;
 
-	text->physical_line_count = 0;
-
-	if (!line) {
-		text->physical_line = line =
-			malloc(sizeof(struct textplain_line) * (1024 + 3));
-		if (!line)
-			goto no_memory;
+	if ((size_t) columns == text->columns && text->reflowing == false) {
+		/* Lines are already broken to this width */
+		textplain_set_height(text);
+		return;
 	}
 
-	line[line_count++].start = line_start = 0;
-	space = 0;
-	i = 0;
-	col = 0;
-	while (i < utf8_data_size) {
-		size_t csize; /* number of bytes in character */
-		uint32_t chr;
-		bool term;
-		size_t next_col;
-		parserutils_error perror;
-
-		perror = parserutils_charset_utf8_to_ucs4((const uint8_t *)utf8_data + i, utf8_data_size - i, &chr, &csize);
-		if (perror != PARSERUTILS_OK) {
-			chr = 0xfffd;
-		}
-
-		term = (chr == '\n' || chr == '\r');
-
-		next_col = col + 1;
-
-		if (chr == '\t') {
-			next_col = (next_col + TAB_WIDTH - 1) & ~(TAB_WIDTH - 1);
-		}
-
-		if (term || next_col >= columns) {
-			if (line_count % 1024 == 0) {
-				line1 = realloc(line,
-						sizeof(struct textplain_line) *
-						(line_count + 1024 + 3));
-				if (!line1)
-					goto no_memory;
-				text->physical_line = line = line1;
-			}
+	if (text->reflowing) {
+		/* Abandon the reflow in progress and start again */
+		textplain_line_index_free(&text->lines);
+	} else {
+		text->source = text->lines;
+		memset(&text->lines, 0, sizeof(text->lines));
+		text->reflowing = true;
+	}
 
-			if (term) {
-				line[line_count-1].length = i - line_start;
+	text->columns = columns;
+	text->source_line = 0;
+	text->breaking = false;
 
-				/* skip second char of CR/LF or LF/CR pair */
-				if (i + 1 < utf8_data_size &&
-				    utf8_data[i+1] != utf8_data[i] &&
-				    (utf8_data[i+1] == '\n' ||
-				     utf8_data[i+1] == '\r')) {
-					i++;
-				}
-			} else {
-				if (space) {
-					/* break at last space in line */
-					i = space;
-					line[line_count-1].length = (i + 1) - line_start;
-				} else
-					line[line_count-1].length = i - line_start;
-			}
-
-			line[line_count++].start = line_start = i + 1;
-			col = 0;
-			space = 0;
-		} else {
-			col++;
-			if (chr == ' ')
-				space = i;
-		}
-		i += csize;
+	res = textplain_reflow(text, height / line_height + 2, 0, 0);
+	if (res != NSERROR_OK) {
+		NSLOG(netsurf, INFO, "out of memory (line_count %lu)",
+		      text->lines.count);
 	}
-	line[line_count-1].length = i - line[line_count-1].start;
-	line[line_count].start = utf8_data_size;
-
-	text->physical_line_count = line_count;
-	c->width = width;
-	c->height = line_count * textplain_line_height() + MARGIN + MARGIN;
 
-	return;
+	if (text->reflowing) {
+		guit->misc->schedule(0, textplain_reflow_callback, text);
+	} else {
+		guit->misc->schedule(-1, textplain_reflow_callback, text);
+	}
 
-no_memory:
-	NSLOG(netsurf, INFO, "out of memory (line_count %lu)", line_count);
-	return;
+	textplain_set_height(text);
 }
 
 
@@ -541,9 +1020,10 @@ static void textplain_destroy(struct content *c)
 		parserutils_inputstream_destroy(text->inputstream);
 	}
 
-	if (text->physical_line != NULL) {
-		free(text->physical_line);
-	}
+	guit->misc->schedule(-1, textplain_reflow_callback, text);
+
+	textplain_line_index_free(&text->lines);
+	textplain_line_index_free(&text->source);
 
 	if (text->utf8_data != NULL) {
 		free(text->utf8_data);
@@ -788,16 +1268,15 @@ static void textplain_search(struct content *c, void *gui_data,
 		if (text->search_string == NULL)
 			return;
 
-		if (text->search != NULL) {
-			search_destroy_context(text->search);
-			text->search = NULL;
-		}
-
-		text->search = search_create_context(c, CONTENT_TEXTPLAIN,
-						     gui_data);
+		/* Keep an existing context, so the new search can build
+		 * on its matches */
+		if (text->search == NULL) {
+			text->search = search_create_context(c,
+					CONTENT_TEXTPLAIN, gui_data);
 
-		if (text->search == NULL)
-			return;
+			if (text->search == NULL)
+				return;
+		}
 
 		search_step(text->search, flags, string);
 
@@ -834,16 +1313,21 @@ textplain_redraw(struct content *c,
 	long lineno;
 	int x = data->x;
 	int y = data->y;
-	unsigned long line_count = text->physical_line_count;
+	unsigned long line_count;
 	float line_height = textplain_line_height();
 	float scaled_line_height = line_height * data->scale;
 	long line0 = (clip->y0 - y * data->scale) / scaled_line_height - 1;
 	long line1 = (clip->y1 - y * data->scale) / scaled_line_height + 1;
-	struct textplain_line *line = text->physical_line;
+	struct textplain_line_index *line = &text->lines;
 	size_t length;
 	plot_style_t *plot_style_highlight;
 	nserror res;
 
+	/* Reflow the visible lines, if the scheduler has yet to */
+	if (line1 > 0)
+		textplain_reflow_to(text, line1, 0);
+	line_count = line->count;
+
 	if (line0 < 0)
 		line0 = 0;
 	if (line1 < 0)
@@ -860,7 +1344,7 @@ textplain_redraw(struct content *c,
 		return false;
 	}
 
-	if (!line)
+	if (line_count == 0)
 		return true;
 
 	/* choose a suitable background colour for any highlighted text */
@@ -875,14 +1359,15 @@ textplain_redraw(struct content *c,
 	x = (x + MARGIN) * data->scale;
 	y = (y + MARGIN) * data->scale;
 	for (lineno = line0; lineno != line1; lineno++) {
-		const char *text_d = utf8_data + line[lineno].start;
+		size_t line_start = textplain_line_start(line, lineno);
+		const char *text_d = utf8_data + line_start;
 		int tab_width = textplain_tab_width * data->scale;
 		size_t offset = 0;
 		int tx = x;
 
 		if (!tab_width) tab_width = 1;
 
-		length = line[lineno].length;
+		length = textplain_line_length(line, lineno);
 		if (!length)
 			continue;
 
@@ -896,7 +1381,7 @@ textplain_redraw(struct content *c,
 				next_offset = utf8_next(text_d, length, next_offset);
 
 			if (!text_redraw(text_d + offset, next_offset - offset,
-					 line[lineno].start + offset, 0,
+					 line_start + offset, 0,
 					 &textplain_style,
 					 tx, y + (lineno * scaled_line_height),
 					 clip, line_height, data->scale, false,
@@ -925,7 +1410,7 @@ textplain_redraw(struct content *c,
 			 */
 
 			if (bw) {
-				unsigned tab_ofst = line[lineno].start + next_offset;
+				unsigned tab_ofst = line_start + next_offset;
 				struct selection *sel = &text->sel;
 				bool highlighted = false;
 
@@ -1117,7 +1602,10 @@ unsigned long textplain_line_count(struct content *c)
 
 	assert(c != NULL);
 
-	return text->physical_line_count;
+	/* Callers iterate over every line */
+	textplain_reflow_to(text, ULONG_MAX, SIZE_MAX);
+
+	return text->lines.count;
 }
 
 
@@ -1137,7 +1625,7 @@ size_t textplain_offset_from_coords(struct content *c, int x, int y, int dir)
 {
 	textplain_content *textc = (textplain_content *) c;
 	float line_height = textplain_line_height();
-	struct textplain_line *line;
+	size_t line_start;
 	const char *text;
 	unsigned nlines;
 	size_t length;
@@ -1148,7 +1636,10 @@ size_t textplain_offset_from_coords(struct content *c, int x, int y, int dir)
 	y = (int)((float)(y - MARGIN) / line_height);
 	x -= MARGIN;
 
-	nlines = textc->physical_line_count;
+	if (y > 0)
+		textplain_reflow_to(textc, y + 1, 0);
+
+	nlines = textc->lines.count;
 	if (!nlines)
 		return 0;
 
@@ -1156,9 +1647,9 @@ size_t textplain_offset_from_coords(struct content *c, int x, int y, int dir)
 	else if ((unsigned)y >= nlines)
 		y = nlines - 1;
 
-	line = &textc->physical_line[y];
-	text = textc->utf8_data + line->start;
-	length = line->length;
+	line_start = textplain_line_start(&textc->lines, y);
+	text = textc->utf8_data + line_start;
+	length = textplain_line_length(&textc->lines, y);
 	idx = 0;
 
 	while (x > 0) {
@@ -1203,7 +1694,7 @@ size_t textplain_offset_from_coords(struct content *c, int x, int y, int dir)
 		idx++;
 	}
 
-	return line->start + idx;
+	return line_start + idx;
 }
 
 
@@ -1217,7 +1708,7 @@ textplain_coords_from_range(struct content *c,
 	textplain_content *text = (textplain_content *) c;
 	float line_height = textplain_line_height();
 	char *utf8_data;
-	struct textplain_line *line;
+	struct textplain_line_index *line;
 	unsigned lineno = 0;
 	unsigned nlines;
 
@@ -1225,16 +1716,17 @@ textplain_coords_from_range(struct content *c,
 	assert(start <= end);
 	assert(end <= text->utf8_data_size);
 
-	utf8_data = text->utf8_data;
-	nlines = text->physical_line_count;
-	line = text->physical_line;
-
 	/* find start */
 	lineno = textplain_find_line(c, start);
 
+	utf8_data = text->utf8_data;
+	nlines = text->lines.count;
+	line = &text->lines;
+
 	r->y0 = (int)(MARGIN + lineno * line_height);
 
-	if (lineno + 1 <= nlines || line[lineno + 1].start >= end) {
+	if (lineno + 1 <= nlines ||
+	    textplain_line_start(line, lineno + 1) >= end) {
 		/* \todo - it may actually be more efficient just to
 		 *   run forwards most of the time
 		 */
@@ -1246,15 +1738,17 @@ textplain_coords_from_range(struct content *c,
 		r->x1 = text->formatted_width;
 	} else {
 		/* single line */
-		const char *text = utf8_data + line[lineno].start;
+		size_t line_start = textplain_line_start(line, lineno);
+		size_t length = textplain_line_length(line, lineno);
+		const char *text = utf8_data + line_start;
 
 		r->x0 = textplain_coord_from_offset(text,
-						    start - line[lineno].start,
-						    line[lineno].length);
+						    start - line_start,
+						    length);
 
 		r->x1 = textplain_coord_from_offset(text,
-						    end - line[lineno].start,
-						    line[lineno].length);
+						    end - line_start,
+						    length);
 	}
 
 	r->y1 = (int)(MARGIN + (lineno + 1) * line_height);
@@ -1269,17 +1763,17 @@ textplain_get_line(struct content *c,
 		   size_t *plen)
 {
 	textplain_content *text = (textplain_content *) c;
-	struct textplain_line *line;
 
 	assert(c != NULL);
 
-	if (lineno >= text->physical_line_count)
+	textplain_reflow_to(text, lineno + 1, 0);
+
+	if (lineno >= text->lines.count)
 		return NULL;
-	line = &text->physical_line[lineno];
 
-	*poffset = line->start;
-	*plen = line->length;
-	return text->utf8_data + line->start;
+	*poffset = textplain_line_start(&text->lines, lineno);
+	*plen = textplain_line_length(&text->lines, lineno);
+	return text->utf8_data + *poffset;
 }
 
 
@@ -1287,28 +1781,34 @@ textplain_get_line(struct content *c,
 int textplain_find_line(struct content *c, unsigned offset)
 {
 	textplain_content *text = (textplain_content *) c;
-	struct textplain_line *line;
-	int nlines;
-	int lineno = 0;
+	unsigned long lo = 0;
+	unsigned long hi;
 
 	assert(c != NULL);
 
-	line = text->physical_line;
-	nlines = text->physical_line_count;
-
 	if (offset > text->utf8_data_size) {
 		return -1;
 	}
 
-/* \todo - implement binary search here */
-	while (lineno < nlines && line[lineno].start < offset) {
-		lineno++;
+	textplain_reflow_to(text, 0, offset);
+
+	if (text->lines.count == 0) {
+		return 0;
 	}
-	if (line[lineno].start > offset) {
-		lineno--;
+
+	/* find the last line starting at or before offset */
+	hi = text->lines.count - 1;
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo + 1) / 2;
+
+		if (textplain_line_start(&text->lines, mid) <= offset) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
 	}
 
-	return lineno;
+	return lo;
 }
 
 
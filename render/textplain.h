@@ -45,6 +45,8 @@ nserror textplain_init(void);
 /**
  * Retrieve number of lines in content
  *
+ * Completes any reflow still in progress, so that every line exists.
+ *
  * \param[in] c Content to retrieve line count from
  * \return Number of lines
  */
@@ -0,0 +1,387 @@
+/*
+ * Copyright 2017 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Test fetcher polling.
+ *
+ * A test fetcher reporting a long timer is registered and the time the
+ * fetch core schedules its next poll for is checked with and without
+ * the frontend waiting on the fetch fdset.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <check.h>
+#include <libwapcaplet/libwapcaplet.h>
+
+#include "utils/errors.h"
+#include "utils/utils.h"
+#include "utils/log.h"
+#include "utils/nsurl.h"
+#include "utils/nsoption.h"
+#include "utils/corestrings.h"
+#include "netsurf/misc.h"
+#include "desktop/gui_table.h"
+#include "content/fetch.h"
+#include "content/fetchers.h"
+#include "content/fetchers/about.h"
+#include "content/fetchers/data.h"
+#include "content/fetchers/file.h"
+#include "content/fetchers/resource.h"
+#include "content/urldb.h"
+#include "javascript/fetcher.h"
+
+/** Poll interval the fetch core uses when it cannot wait on the fdset */
+#define SCHEDULE_TIME 10
+
+/**
+ * Timer the test fetcher reports, much longer than the poll interval
+ * but shorter than the longest time the fetch core waits on the fdset.
+ */
+#define TEST_TIMEOUT 500
+
+/******************************************************************************
+ * Stubs                                                                      *
+ ******************************************************************************/
+
+/* utils/log.h */
+nserror nslog_set_filter_by_options(void)
+{
+	return NSERROR_OK;
+}
+
+/* content/fetchers/about.h */
+nserror fetch_about_register(void)
+{
+	return NSERROR_OK;
+}
+
+/* content/fetchers/data.h */
+nserror fetch_data_register(void)
+{
+	return NSERROR_OK;
+}
+
+/* content/fetchers/file.h */
+nserror fetch_file_register(void)
+{
+	return NSERROR_OK;
+}
+
+/* content/fetchers/resource.h */
+nserror fetch_resource_register(void)
+{
+	return NSERROR_OK;
+}
+
+/* javascript/fetcher.h */
+nserror fetch_javascript_register(void)
+{
+	return NSERROR_OK;
+}
+
+/* content/urldb.h */
+bool urldb_set_cookie(const char *header, struct nsurl *url,
+		      struct nsurl *referer)
+{
+	return true;
+}
+
+/** Time the next fetcher poll was scheduled for or -1 if none */
+static int poll_time;
+
+/** The scheduled fetcher poll */
+static void (*poll_callback)(void *p);
+
+static nserror test_schedule(int t, void (*callback)(void *p), void *p)
+{
+	if (t < 0) {
+		poll_time = -1;
+		poll_callback = NULL;
+	} else {
+		poll_time = t;
+		poll_callback = callback;
+	}
+	return NSERROR_OK;
+}
+
+static struct gui_misc_table test_misc_table = {
+	.schedule = test_schedule,
+};
+
+static struct netsurf_table test_table = {
+	.misc = &test_misc_table,
+};
+
+struct netsurf_table *guit = &test_table;
+
+/******************************************************************************
+ * test: fetcher                                                              *
+ ******************************************************************************/
+
+/** Number of times the test fetcher was polled */
+static unsigned int test_poll_count;
+
+/** Timer the test fetcher reports */
+static int test_timeout_ms;
+
+static bool test_initialise(lwc_string *scheme)
+{
+	return true;
+}
+
+static bool test_acceptable(const nsurl *url)
+{
+	return true;
+}
+
+static void *test_setup(struct fetch *parent, nsurl *url, bool only_2xx,
+		bool downgrade_tls, const char *post_urlenc,
+		const struct fetch_multipart_data *post_multipart,
+		const char **headers)
+{
+	/* the fetch is the context */
+	return parent;
+}
+
+static bool test_start(void *ctx)
+{
+	return true;
+}
+
+static void test_abort(void *ctx)
+{
+	struct fetch *parent = ctx;
+
+	fetch_remove_from_queues(parent);
+	fetch_free(parent);
+}
+
+static void test_free(void *ctx)
+{
+}
+
+static void test_poll(lwc_string *scheme)
+{
+	test_poll_count++;
+}
+
+static int test_fdset(lwc_string *scheme, fd_set *read_set,
+		      fd_set *write_set, fd_set *error_set)
+{
+	/* pretend to have a socket on descriptor 0 */
+	return 0;
+}
+
+static int test_timeout(lwc_string *scheme)
+{
+	return test_timeout_ms;
+}
+
+static void test_finalise(lwc_string *scheme)
+{
+}
+
+static const struct fetcher_operation_table test_fetcher_ops = {
+	.initialise = test_initialise,
+	.acceptable = test_acceptable,
+	.setup = test_setup,
+	.start = test_start,
+	.abort = test_abort,
+	.free = test_free,
+	.poll = test_poll,
+	.fdset = test_fdset,
+	.timeout = test_timeout,
+	.finalise = test_finalise,
+};
+
+static void fetch_msg_callback(const fetch_msg *msg, void *p)
+{
+}
+
+/** The fetch under test */
+static struct fetch *test_fetch;
+
+/**
+ * Run the scheduled fetcher poll
+ */
+static void run_poll(void)
+{
+	void (*callback)(void *p) = poll_callback;
+
+	ck_assert(callback != NULL);
+	callback(NULL);
+}
+
+/**
+ * Call fetch_fdset as a frontend waiting on the fetch sockets would
+ */
+static void wait_fdset(void)
+{
+	fd_set read_fd_set, write_fd_set, exc_fd_set;
+	int maxfd;
+
+	FD_ZERO(&read_fd_set);
+	FD_ZERO(&write_fd_set);
+	FD_ZERO(&exc_fd_set);
+
+	ck_assert_int_eq(fetch_fdset(&read_fd_set,
+				     &write_fd_set,
+				     &exc_fd_set,
+				     &maxfd), NSERROR_OK);
+	ck_assert_int_eq(maxfd, 0);
+}
+
+static void fetch_setup(void)
+{
+	lwc_string *scheme;
+	nsurl *url;
+
+	ck_assert_int_eq(nsoption_init(NULL, NULL, NULL), NSERROR_OK);
+	ck_assert_int_eq(corestrings_init(), NSERROR_OK);
+
+	ck_assert(lwc_intern_string("test", SLEN("test"), &scheme) ==
+		  lwc_error_ok);
+	ck_assert_int_eq(fetcher_add(scheme, &test_fetcher_ops), NSERROR_OK);
+
+	poll_time = -1;
+	poll_callback = NULL;
+	test_poll_count = 0;
+	test_timeout_ms = TEST_TIMEOUT;
+
+	ck_assert_int_eq(nsurl_create("test://www.example.org/", &url),
+			 NSERROR_OK);
+	ck_assert_int_eq(fetch_start(url, NULL, fetch_msg_callback, NULL,
+				     false, NULL, NULL, false, false, NULL,
+				     FETCH_PRIORITY_DOCUMENT, &test_fetch),
+			 NSERROR_OK);
+	nsurl_unref(url);
+}
+
+static void fetch_teardown(void)
+{
+	fetch_abort(test_fetch);
+	fetcher_quit();
+	corestrings_fini();
+	nsoption_finalise(NULL, NULL);
+}
+
+/******************************************************************************
+ * Tests                                                                      *
+ ******************************************************************************/
+
+START_TEST(fetch_poll_start_test)
+{
+	/* starting a fetch polls soon */
+	ck_assert_int_eq(poll_time, SCHEDULE_TIME);
+
+	run_poll();
+	ck_assert_uint_eq(test_poll_count, 1);
+}
+END_TEST
+
+START_TEST(fetch_poll_nofdset_test)
+{
+	/* frontends which never wait on the fdset must keep polling
+	 * frequently whatever the fetcher timer is.
+	 */
+	run_poll();
+	ck_assert_int_eq(poll_time, SCHEDULE_TIME);
+
+	run_poll();
+	ck_assert_int_eq(poll_time, SCHEDULE_TIME);
+	ck_assert_uint_eq(test_poll_count, 2);
+}
+END_TEST
+
+START_TEST(fetch_poll_nofdset_notimer_test)
+{
+	test_timeout_ms = -1;
+
+	run_poll();
+	ck_assert_int_eq(poll_time, SCHEDULE_TIME);
+}
+END_TEST
+
+START_TEST(fetch_poll_fdset_test)
+{
+	/* waiting on the fdset the poll follows the fetcher timer */
+	wait_fdset();
+	ck_assert_int_eq(poll_time, TEST_TIMEOUT);
+
+	run_poll();
+	ck_assert_int_eq(poll_time, TEST_TIMEOUT);
+
+	/* the frontend stopped waiting on the fdset */
+	run_poll();
+	ck_assert_int_eq(poll_time, SCHEDULE_TIME);
+}
+END_TEST
+
+START_TEST(fetch_poll_fdset_notimer_test)
+{
+	test_timeout_ms = -1;
+
+	/* without a timer only the fdset wakes the frontend */
+	wait_fdset();
+	ck_assert_int_gt(poll_time, TEST_TIMEOUT);
+}
+END_TEST
+
+/* suite generation */
+static Suite *fetch_suite(void)
+{
+	Suite *s;
+	TCase *tc_poll;
+
+	s = suite_create("fetch");
+
+	/* time until fetchers are next polled */
+	tc_poll = tcase_create("Poll");
+	tcase_add_checked_fixture(tc_poll,
+				  fetch_setup,
+				  fetch_teardown);
+	tcase_add_test(tc_poll, fetch_poll_start_test);
+	tcase_add_test(tc_poll, fetch_poll_nofdset_test);
+	tcase_add_test(tc_poll, fetch_poll_nofdset_notimer_test);
+	tcase_add_test(tc_poll, fetch_poll_fdset_test);
+	tcase_add_test(tc_poll, fetch_poll_fdset_notimer_test);
+	suite_add_tcase(s, tc_poll);
+
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = fetch_suite();
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_ENV);
+
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -16,345 +16,603 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/**
+ * \file
+ * Test low level cache.
+ *
+ * The fetch layer is replaced by a stub which records each fetch the
+ * cache starts so the test can serve responses to it directly.
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <check.h>
 
-#include "content/fetch.h"
-#include "content/llcache.h"
-#include "utils/ring.h"
+#include "utils/errors.h"
 #include "utils/nsurl.h"
-#include "utils/url.h"
 #include "utils/corestrings.h"
-#include "utils/utils.h"
+#include "netsurf/misc.h"
+#include "netsurf/url_db.h"
+#include "desktop/gui_table.h"
+#include "desktop/scheduler.h"
+#include "content/fetch.h"
+#include "content/backing_store.h"
+#include "content/llcache.h"
+
+#define NELEMS(x)  (sizeof(x) / sizeof((x)[0]))
+
+/** Number of lookups timed at each cache population */
+#define BENCH_LOOKUPS 1000
+
+/** Largest cache population benchmarked */
+#define BENCH_MAX_OBJECTS 65536
+
+/** Size of each object body used by the eviction tests */
+#define EVICT_BODY_SIZE (64 * 1024)
 
 /******************************************************************************
- * Things that we'd reasonably expect to have to implement                    *
+ * Stub fetch layer                                                           *
  ******************************************************************************/
 
-bool verbose_log;
+/** A fetch started by the cache */
+struct fetch {
+	fetch_callback callback; /**< Cache callback */
+	void *p; /**< Cache callback context */
+	nsurl *url; /**< URL being fetched */
+	enum fetch_priority priority; /**< Dispatch priority class */
+	struct fetch *next; /**< Next outstanding fetch */
+};
+
+/** Fetches started and not yet served or aborted */
+static struct fetch *fetch_list;
+
+/** Number of fetches started */
+static unsigned int fetch_started;
 
-/* utils/utils.h */
-char *filename_from_path(char *path)
+/* content/fetch.h */
+nserror fetch_start(nsurl *url, nsurl *referer, fetch_callback callback,
+		    void *p, bool only_2xx, const char *post_urlenc,
+		    const struct fetch_multipart_data *post_multipart,
+		    bool verifiable, bool downgrade_tls,
+		    const char *headers[], enum fetch_priority priority,
+		    struct fetch **fetch_out)
 {
-	char *leafname;
+	struct fetch *fetch;
 
-	leafname = strrchr(path, '/');
-	if (!leafname)
-		leafname = path;
-	else
-		leafname += 1;
+	fetch = calloc(1, sizeof(*fetch));
+	if (fetch == NULL) {
+		return NSERROR_NOMEM;
+	}
 
-	return strdup(leafname);
+	fetch->callback = callback;
+	fetch->p = p;
+	fetch->url = nsurl_ref(url);
+	fetch->priority = priority;
+	fetch->next = fetch_list;
+	fetch_list = fetch;
+
+	fetch_started++;
+
+	*fetch_out = fetch;
+
+	return NSERROR_OK;
 }
 
-/* utils/schedule.h */
-void schedule(int t, schedule_callback_fn cb, void *pw)
+/**
+ * Remove a fetch from the outstanding list and free it
+ */
+static void test_fetch_free(struct fetch *fetch)
 {
+	struct fetch **prev;
+
+	for (prev = &fetch_list; *prev != NULL; prev = &(*prev)->next) {
+		if (*prev == fetch) {
+			*prev = fetch->next;
+			break;
+		}
+	}
+
+	nsurl_unref(fetch->url);
+	free(fetch);
 }
 
-/* utils/schedule.h */
-void schedule_remove(schedule_callback_fn cb, void *pw)
+/* content/fetch.h */
+void fetch_abort(struct fetch *f)
 {
+	test_fetch_free(f);
 }
 
 /* content/fetch.h */
-const char *fetch_filetype(const char *unix_path)
+bool fetch_can_fetch(const nsurl *url)
 {
-	return NULL;
+	return true;
 }
 
 /* content/fetch.h */
-char *fetch_mimetype(const char *ro_path)
+long fetch_http_code(struct fetch *fetch)
 {
-	return NULL;
+	return 200;
 }
 
-/* utils/url.h */
-char *path_to_url(const char *path)
+/* content/fetch.h */
+void fetch_multipart_data_destroy(struct fetch_multipart_data *list)
 {
-	int urllen = strlen(path) + FILE_SCHEME_PREFIX_LEN + 1;
-	char *url = malloc(urllen);
+}
 
-	if (url == NULL) {
-		return NULL;
-	}
+/* content/fetch.h */
+struct fetch_multipart_data *
+fetch_multipart_data_clone(const struct fetch_multipart_data *list)
+{
+	return NULL;
+}
 
-	if (*path == '/') {
-		path++; /* file: paths are already absolute */
-	} 
+/* netsurf/url_db.h */
+const char *urldb_get_auth_details(struct nsurl *url, const char *realm)
+{
+	return NULL;
+}
 
-	snprintf(url, urllen, "%s%s", FILE_SCHEME_PREFIX, path);
+static struct gui_misc_table test_misc_table = {
+	.schedule = scheduler_schedule,
+};
 
-	return url;
-}
+static struct netsurf_table test_table = {
+	.misc = &test_misc_table,
+};
 
-/* utils/url.h */
-char *url_to_path(const char *url)
-{
-	char *url_path;
-	char *path = NULL;
+struct netsurf_table *guit = &test_table;
 
-	if (url_unescape(url, 0, NULL, &url_path) == NSERROR_OK) {
-		/* return the absolute path including leading / */
-		path = strdup(url_path + (FILE_SCHEME_PREFIX_LEN - 1));
-		free(url_path);
+/**
+ * Serve a complete cacheable response to the most recently started fetch
+ *
+ * \param len The length of body to send.
+ */
+static void serve_fetch(size_t len)
+{
+	static const char *headers[] = {
+		"HTTP/1.1 200 OK",
+		"Content-Type: image/png",
+		"Cache-Control: max-age=3600",
+	};
+	struct fetch *fetch = fetch_list;
+	fetch_msg msg;
+	uint8_t *body;
+	size_t idx;
+
+	ck_assert(fetch != NULL);
+
+	msg.type = FETCH_HEADER;
+	for (idx = 0; idx < NELEMS(headers); idx++) {
+		msg.data.header_or_data.buf = (const uint8_t *)headers[idx];
+		msg.data.header_or_data.len = strlen(headers[idx]);
+		fetch->callback(&msg, fetch->p);
 	}
 
-	return path;
+	body = calloc(1, len);
+	ck_assert(body != NULL);
+
+	msg.type = FETCH_DATA;
+	msg.data.header_or_data.buf = body;
+	msg.data.header_or_data.len = len;
+	fetch->callback(&msg, fetch->p);
+
+	free(body);
+
+	/* the cache forgets the fetch when it finishes */
+	msg.type = FETCH_FINISHED;
+	fetch->callback(&msg, fetch->p);
+
+	test_fetch_free(fetch);
 }
 
 /******************************************************************************
- * Things that are absolutely not reasonable, and should disappear            *
+ * Helpers                                                                    *
  ******************************************************************************/
 
-#include "desktop/cookie_manager.h"
-
-/* desktop/cookie_manager.h -- used by urldb 
- *
- * URLdb should have a cookies update event + handler registration
- */
-bool cookie_manager_add(const struct cookie_data *data)
+static nserror event_handler(llcache_handle *handle,
+		const llcache_event *event, void *pw)
 {
-	return true;
+	unsigned int *done = pw;
+
+	if ((done != NULL) && (event->type == LLCACHE_EVENT_DONE)) {
+		(*done)++;
+	}
+
+	return NSERROR_OK;
 }
 
-/* desktop/cookie_manager.h -- used by urldb 
+/**
+ * Retrieve a numbered url from the cache.
  *
- * URLdb should have a cookies removal handler registration
+ * \param n The url number
+ * \param pw The event handler context
+ * \param handle_out Updated with the retrieved handle
+ * \return NSERROR_OK on success, appropriate error otherwise
  */
-void cookie_manager_remove(const struct cookie_data *data)
+static nserror retrieve(unsigned int n, void *pw, llcache_handle **handle_out)
 {
+	char buf[64];
+	nsurl *url;
+	nserror error;
+
+	snprintf(buf, sizeof(buf), "http://test.example.org/%u.png", n);
+
+	error = nsurl_create(buf, &url);
+	if (error != NSERROR_OK) {
+		return error;
+	}
+
+	error = llcache_handle_retrieve(url, 0, NULL, NULL,
+			event_handler, pw, handle_out);
+
+	nsurl_unref(url);
+
+	return error;
 }
 
-/* image/bitmap.h -- used by urldb 
+/**
+ * Fetch a numbered url into the cache and release it.
  *
- * URLdb shouldn't care about bitmaps. 
- * This is because the legacy RO thumbnail stuff was hacked in and must die.
+ * \param n The url number
+ * \param len The length of the object body.
  */
-void bitmap_destroy(void *bitmap)
+static void populate(unsigned int n, size_t len)
 {
+	llcache_handle *handle;
+	unsigned int started = fetch_started;
+
+	ck_assert_int_eq(retrieve(n, NULL, &handle), NSERROR_OK);
+	if (fetch_started != started) {
+		serve_fetch(len);
+	}
+	ck_assert_int_eq(llcache_handle_release(handle), NSERROR_OK);
 }
-/* image/image.h -- used by urldb 
+
+/**
+ * Check if retrieving a numbered url is satisfied from the cache.
  *
- * URLdb shouldn't care about bitmaps. 
- * This is because the legacy RO thumbnail stuff was hacked in and must die.
+ * \param n The url number
+ * \return true if the url was cached else false.
  */
-bool image_bitmap_plot(struct bitmap *bitmap, struct content_redraw_data *data, 
-		const struct rect *clip, const struct redraw_context *ctx)
+static bool is_cached(unsigned int n)
 {
-	return true;
+	llcache_handle *handle;
+	unsigned int started = fetch_started;
+
+	ck_assert_int_eq(retrieve(n, NULL, &handle), NSERROR_OK);
+	ck_assert_int_eq(llcache_handle_release(handle), NSERROR_OK);
+
+	return fetch_started == started;
 }
 
-/* content/fetchers/fetch_file.h -- used by fetcher core
+/**
+ * Initialise the cache under test
  *
- * Simpler to stub this than haul in all the file fetcher's dependencies
+ * \param limit The cache RAM limit.
  */
-void fetch_file_register(void)
+static void cache_initialise(size_t limit)
 {
-}
-
-
-/******************************************************************************
- * test: protocol handler                                                     *
- ******************************************************************************/
-
-typedef struct test_context {
-	struct fetch *parent;
+	struct llcache_parameters params = {
+		.limit = limit,
+		.minimum_lifetime = 120,
+		.minimum_bandwidth = 128 * 1024,
+		.maximum_bandwidth = 512 * 1024,
+		.time_quantum = 10,
+		.fetch_attempts = 2,
+	};
 
-	bool aborted;
-	bool locked;
+	ck_assert_int_eq(corestrings_init(), NSERROR_OK);
+	ck_assert_int_eq(llcache_initialise(&params), NSERROR_OK);
 
-	struct test_context *r_prev;
-	struct test_context *r_next;
-} test_context;
+	fetch_started = 0;
+}
 
-static test_context *ring;
+static void llcache_setup(void)
+{
+	test_table.llcache = null_llcache_table;
+	cache_initialise(1024 * 1024);
+}
 
-bool test_initialise(lwc_string *scheme)
+/* room for two eviction test objects but not three */
+static void llcache_evict_setup(void)
 {
-	/* Nothing to do */
-	return true;
+	test_table.llcache = null_llcache_table;
+	cache_initialise((5 * EVICT_BODY_SIZE) / 2);
 }
 
-bool test_can_fetch(const nsurl *url)
+static void llcache_bench_setup(void)
 {
-	/* Nothing to do */
-	return true;
+	test_table.llcache = null_llcache_table;
+	cache_initialise(1024 * 1024 * 1024);
 }
 
-void test_finalise(lwc_string *scheme)
+static void llcache_teardown(void)
 {
-	/* Nothing to do */
+	llcache_finalise();
+
+	/* the cache assumes the fetchers are already gone */
+	while (fetch_list != NULL) {
+		test_fetch_free(fetch_list);
+	}
+
+	scheduler_finalise();
+	corestrings_fini();
 }
 
-void *test_setup_fetch(struct fetch *parent, nsurl *url, bool only_2xx,
-		bool downgrade_tls, const char *post_urlenc,
-		const struct fetch_multipart_data *post_multipart,
-		const char **headers)
+/******************************************************************************
+ * Tests                                                                      *
+ ******************************************************************************/
+
+START_TEST(llcache_retrieve_test)
 {
-	test_context *ctx = calloc(1, sizeof(test_context));
+	llcache_handle *handle;
+	unsigned int done = 0;
+	size_t size = 0;
 
-	if (ctx == NULL)
-		return NULL;
+	ck_assert_int_eq(retrieve(0, &done, &handle), NSERROR_OK);
+	ck_assert_uint_eq(fetch_started, 1);
 
-	ctx->parent = parent;
+	serve_fetch(1024);
 
-	RING_INSERT(ring, ctx);
+	/* users are informed of events from the scheduler */
+	scheduler_run();
+	ck_assert_uint_eq(done, 1);
+	ck_assert(llcache_handle_get_source_data(handle, &size) != NULL);
+	ck_assert_uint_eq(size, 1024);
 
-	return ctx;
+	ck_assert_int_eq(llcache_handle_release(handle), NSERROR_OK);
 }
+END_TEST
 
-bool test_start_fetch(void *handle)
+START_TEST(llcache_share_test)
 {
-	/* Nothing to do */
-	return true;
+	llcache_handle *handle;
+	llcache_handle *handle2;
+	unsigned int done = 0;
+
+	/* a second retrieve shares the in progress fetch */
+	ck_assert_int_eq(retrieve(0, &done, &handle), NSERROR_OK);
+	ck_assert_int_eq(retrieve(0, &done, &handle2), NSERROR_OK);
+	ck_assert_uint_eq(fetch_started, 1);
+	ck_assert(llcache_handle_references_same_object(handle, handle2));
+
+	serve_fetch(1024);
+	scheduler_run();
+	ck_assert_uint_eq(done, 2);
+
+	ck_assert_int_eq(llcache_handle_release(handle2), NSERROR_OK);
+	ck_assert_int_eq(llcache_handle_release(handle), NSERROR_OK);
 }
+END_TEST
 
-void test_abort_fetch(void *handle)
+START_TEST(llcache_priority_test)
 {
-	test_context *ctx = handle;
-
-	ctx->aborted = true;
+	static const struct {
+		uint32_t flags;
+		enum fetch_priority priority;
+	} tst[] = {
+		{ 0, FETCH_PRIORITY_DOCUMENT },
+		{ LLCACHE_RETRIEVE_PRIORITY(FETCH_PRIORITY_DOCUMENT),
+		  FETCH_PRIORITY_DOCUMENT },
+		{ LLCACHE_RETRIEVE_PRIORITY(FETCH_PRIORITY_STYLE),
+		  FETCH_PRIORITY_STYLE },
+		{ LLCACHE_RETRIEVE_PRIORITY(FETCH_PRIORITY_IMAGE),
+		  FETCH_PRIORITY_IMAGE },
+		{ LLCACHE_RETRIEVE_PRIORITY(FETCH_PRIORITY_PREFETCH),
+		  FETCH_PRIORITY_PREFETCH },
+	};
+	llcache_handle *handle;
+	nsurl *url;
+	char buf[64];
+	unsigned int idx;
+
+	for (idx = 0; idx < NELEMS(tst); idx++) {
+		snprintf(buf, sizeof(buf), "http://test.example.org/%u", idx);
+		ck_assert_int_eq(nsurl_create(buf, &url), NSERROR_OK);
+		ck_assert_int_eq(llcache_handle_retrieve(url, tst[idx].flags,
+							 NULL, NULL,
+							 event_handler, NULL,
+							 &handle),
+				 NSERROR_OK);
+		nsurl_unref(url);
+
+		ck_assert(fetch_list != NULL);
+		ck_assert_int_eq(fetch_list->priority, tst[idx].priority);
+
+		ck_assert_int_eq(llcache_handle_release(handle), NSERROR_OK);
+	}
 }
+END_TEST
 
-void test_free_fetch(void *handle)
+START_TEST(llcache_hit_test)
 {
-	test_context *ctx = handle;
+	struct llcache_stats stats;
+	unsigned int idx;
 
-	RING_REMOVE(ring, ctx);
+	for (idx = 0; idx < 64; idx++) {
+		populate(idx, 256);
+	}
+	ck_assert_uint_eq(fetch_started, 64);
 
-	free(ctx);
+	/* every object is fresh so no further fetches are made */
+	for (idx = 0; idx < 64; idx++) {
+		ck_assert(is_cached(idx));
+	}
+
+	ck_assert_int_eq(llcache_get_stats(&stats), NSERROR_OK);
+	ck_assert_uint_eq(stats.cached_count, 64);
+	ck_assert_uint_eq(stats.miss_count, 64);
+	ck_assert_uint_eq(stats.hit_count, 64);
 }
+END_TEST
 
-void test_process(test_context *ctx)
+START_TEST(llcache_purge_test)
 {
-	/** \todo Implement */
+	struct llcache_stats stats;
+	llcache_handle *handle;
+
+	populate(0, 256);
+	populate(1, 256);
+
+	/* objects with users survive a purge */
+	ck_assert_int_eq(retrieve(1, NULL, &handle), NSERROR_OK);
+	llcache_clean(true);
+
+	ck_assert_int_eq(llcache_get_stats(&stats), NSERROR_OK);
+	ck_assert_uint_eq(stats.cached_count, 1);
+
+	ck_assert_int_eq(llcache_handle_release(handle), NSERROR_OK);
 }
+END_TEST
 
-void test_poll(lwc_string *scheme)
+START_TEST(llcache_evict_lru_test)
 {
-	test_context *ctx, *next;
+	struct llcache_stats stats;
 
-	if (ring == NULL)
-		return;
+	populate(0, EVICT_BODY_SIZE);
+	populate(1, EVICT_BODY_SIZE);
+	populate(2, EVICT_BODY_SIZE);
 
-	ctx = ring;
-	do {
-		next = ctx->r_next;
+	/* using the oldest object makes the second the least recently used */
+	ck_assert(is_cached(0));
 
-		if (ctx->locked)
-			continue;
+	llcache_clean(false);
 
-		if (ctx->aborted == false) {
-			test_process(ctx);
-		}
+	ck_assert_int_eq(llcache_get_stats(&stats), NSERROR_OK);
+	ck_assert_uint_eq(stats.cached_count, 2);
+	ck_assert(stats.size <= stats.limit);
 
-		fetch_remove_from_queues(ctx->parent);
-		fetch_free(ctx->parent);
-	} while ((ctx = next) != ring && ring != NULL);
+	ck_assert(is_cached(0));
+	ck_assert(is_cached(2));
+	ck_assert(!is_cached(1));
 }
+END_TEST
 
-/******************************************************************************
- * The actual test code                                                       *
- ******************************************************************************/
-
-nserror query_handler(const llcache_query *query, void *pw,
-		llcache_query_response cb, void *cbpw)
+START_TEST(llcache_evict_in_use_test)
 {
-	/* I'm too lazy to actually implement this. It should queue the query, 
-	 * then deliver the response from main(). */
+	struct llcache_stats stats;
+	llcache_handle *handle;
 
-	return NSERROR_OK;
-}
+	/* the least recently used object is still in use */
+	ck_assert_int_eq(retrieve(0, NULL, &handle), NSERROR_OK);
+	serve_fetch(EVICT_BODY_SIZE);
+	populate(1, EVICT_BODY_SIZE);
+	populate(2, EVICT_BODY_SIZE);
 
-nserror event_handler(llcache_handle *handle, 
-		const llcache_event *event, void *pw)
-{
-	static char *event_names[] = {
-		"HAD_HEADERS", "HAD_DATA", "DONE", "ERROR", "PROGRESS"
-	};
-	bool *done = pw;
+	llcache_clean(false);
 
-	if (event->type != LLCACHE_EVENT_PROGRESS)
-		fprintf(stdout, "%p : %s\n", handle, event_names[event->type]);
+	ck_assert_int_eq(llcache_get_stats(&stats), NSERROR_OK);
+	ck_assert_uint_eq(stats.cached_count, 2);
 
-	/* Inform main() that the fetch completed */
-	if (event->type == LLCACHE_EVENT_DONE)
-		*done = true;
+	ck_assert_int_eq(llcache_handle_release(handle), NSERROR_OK);
 
-	return NSERROR_OK;
+	ck_assert(is_cached(0));
+	ck_assert(is_cached(2));
+	ck_assert(!is_cached(1));
 }
+END_TEST
 
-int main(int argc, char **argv)
+START_TEST(llcache_bench_test)
 {
-	nserror error;
-	llcache_handle *handle;
-	llcache_handle *handle2;
-	lwc_string *scheme;
-	nsurl *url;
-	bool done = false;
-
-	/* Initialise subsystems */
-	fetch_init();
+	unsigned int population = 0;
+	unsigned int target;
+	unsigned int loop;
+	unsigned int started;
+	struct timespec start, end;
+	double elapsed;
+
+	printf("llcache: %10s %12s\n", "objects", "us/retrieve");
+
+	for (target = 1024; target <= BENCH_MAX_OBJECTS; target *= 2) {
+		/* grow the cache to the target population */
+		while (population < target) {
+			populate(population, 16);
+			population++;
+		}
 
-	if (lwc_intern_string("test", SLEN("test"), &scheme) != lwc_error_ok) {
-		fprintf(stderr, "Failed to intern \"test\"\n");
-		return 1;
-	}
+		started = fetch_started;
 
-	fetch_add_fetcher(scheme, test_initialise, test_can_fetch,
-			test_setup_fetch, test_start_fetch, test_abort_fetch,
-			test_free_fetch, test_poll, test_finalise);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (loop = 0; loop < BENCH_LOOKUPS; loop++) {
+			llcache_handle *handle;
 
-	/* Initialise low-level cache */
-	error = llcache_initialise(query_handler, NULL, 1024 * 1024);
-	if (error != NSERROR_OK) {
-		fprintf(stderr, "llcache_initialise: %d\n", error);
-		return 1;
-	}
+			ck_assert_int_eq(retrieve(loop % population,
+						  NULL, &handle),
+					 NSERROR_OK);
+			llcache_handle_release(handle);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
 
-	if (nsurl_create("http://www.netsurf-browser.org", &url) != NSERROR_OK) {
-		fprintf(stderr, "Failed creating url\n");
-		return 1;
-	}
+		/* every lookup must have been a hit */
+		ck_assert_uint_eq(fetch_started, started);
 
-	/* Retrieve an URL from the low-level cache (may trigger fetch) */
-	error = llcache_handle_retrieve(url, 
-			LLCACHE_RETRIEVE_VERIFIABLE, NULL, NULL,
-			event_handler, &done, &handle);
-	if (error != NSERROR_OK) {
-		fprintf(stderr, "llcache_handle_retrieve: %d\n", error);
-		return 1;
-	}
+		elapsed = ((end.tv_sec - start.tv_sec) * 1000000.0) +
+			((end.tv_nsec - start.tv_nsec) / 1000.0);
 
-	/* Poll relevant components */
-	while (done == false) {
-		llcache_poll();
+		printf("llcache: %10u %12.3f\n",
+		       population, elapsed / BENCH_LOOKUPS);
 	}
+}
+END_TEST
 
-	done = false;
-	error = llcache_handle_retrieve(url,
-			LLCACHE_RETRIEVE_VERIFIABLE, NULL, NULL,
-			event_handler, &done, &handle2);
-	if (error != NSERROR_OK) {
-		fprintf(stderr, "llcache_handle_retrieve: %d\n", error);
-		return 1;
-	}
+/* suite generation */
+static Suite *llcache_suite(void)
+{
+	Suite *s;
+	TCase *tc_retrieve;
+	TCase *tc_evict;
+	TCase *tc_benchmark;
+
+	s = suite_create("llcache");
+
+	/* retrieving, sharing and cleaning objects */
+	tc_retrieve = tcase_create("Retrieve");
+	tcase_add_checked_fixture(tc_retrieve,
+				  llcache_setup,
+				  llcache_teardown);
+	tcase_add_test(tc_retrieve, llcache_retrieve_test);
+	tcase_add_test(tc_retrieve, llcache_share_test);
+	tcase_add_test(tc_retrieve, llcache_priority_test);
+	tcase_add_test(tc_retrieve, llcache_hit_test);
+	tcase_add_test(tc_retrieve, llcache_purge_test);
+	suite_add_tcase(s, tc_retrieve);
+
+	/* least recently used objects are evicted first */
+	tc_evict = tcase_create("Evict");
+	tcase_add_checked_fixture(tc_evict,
+				  llcache_evict_setup,
+				  llcache_teardown);
+	tcase_add_test(tc_evict, llcache_evict_lru_test);
+	tcase_add_test(tc_evict, llcache_evict_in_use_test);
+	suite_add_tcase(s, tc_evict);
+
+	/* retrieve latency against population, reported but not asserted */
+	tc_benchmark = tcase_create("Benchmark");
+	tcase_add_checked_fixture(tc_benchmark,
+				  llcache_bench_setup,
+				  llcache_teardown);
+	tcase_set_timeout(tc_benchmark, 60);
+	tcase_add_test(tc_benchmark, llcache_bench_test);
+	suite_add_tcase(s, tc_benchmark);
+
+	return s;
+}
 
-	while (done == false) {
-		llcache_poll();
-	}
+int main(int argc, char **argv)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
 
-	fprintf(stdout, "%p, %p -> %d\n", handle, handle2,
-			llcache_handle_references_same_object(handle, handle2));
+	s = llcache_suite();
 
-	/* Cleanup */
-	llcache_handle_release(handle2);
-	llcache_handle_release(handle);
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_ENV);
 
-	fetch_quit();
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
 
-	return 0;
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
-
@@ -29,6 +29,7 @@
 #include <check.h>
 
 #include <libwapcaplet/libwapcaplet.h>
+#include <nsutils/time.h>
 
 #include "utils/corestrings.h"
 #include "utils/nsurl.h"
@@ -526,6 +527,75 @@ START_TEST(nsurl_join_complex_test)
 END_TEST
 
 
+/**
+ * links from real pages, for join benchmarking
+ */
+static const char *join_bench_base =
+	"https://www.example.org/news/2017/03/article.html?id=42";
+static const char *join_bench_links[] = {
+	"#content", "#top", "#comments", "#main-nav", "#",
+	"?page=2", "?page=3&sort=date", "?id=43", "?lang=en#top",
+	"style.css", "print.css?v=20170301", "photo-1.jpg",
+	"photo-2.jpg", "thumbs/photo-1_150x150.jpg", "related.html",
+	"article.html?id=42&share=twitter", "feed.xml",
+	"/", "/favicon.ico", "/static/css/main.min.css",
+	"/static/js/jquery-3.1.1.min.js", "/static/js/app.js?v=3",
+	"/images/logo.svg", "/about/", "/contact/", "/news/",
+	"/news/2017/02/", "/search?q=netsurf", "/tag/browsers/",
+	"/wp-content/uploads/2017/03/header-1024x300.png",
+	"../02/older-article.html", "./index.html", "../../",
+	"//cdn.example.net/lib/font.woff2",
+	"https://twitter.com/intent/tweet?url=https%3A%2F%2Fwww.example.org",
+	"mailto:editor@example.org", "javascript:void(0)",
+	"/search?q=caf%C3%A9", "images/my photo.jpg",
+};
+
+/** number of passes over the link corpus */
+#define JOIN_BENCH_PASSES 2000
+
+/**
+ * url join benchmark
+ */
+START_TEST(nsurl_join_bench_test)
+{
+	nserror err;
+	nsurl *base_url;
+	nsurl *joined;
+	uint64_t start_ms;
+	uint64_t end_ms;
+	unsigned int pass;
+	unsigned int link;
+
+	err = nsurl_create(join_bench_base, &base_url);
+	ck_assert(err == NSERROR_OK);
+
+	nsu_getmonotonic_ms(&start_ms);
+	for (pass = 0; pass < JOIN_BENCH_PASSES; pass++) {
+		for (link = 0; link < NELEMS(join_bench_links); link++) {
+			err = nsurl_join(base_url, join_bench_links[link],
+					&joined);
+			ck_assert(err == NSERROR_OK);
+			nsurl_unref(joined);
+		}
+	}
+	nsu_getmonotonic_ms(&end_ms);
+
+	if (end_ms == start_ms)
+		end_ms++;
+
+	printf("nsurl_join: %u joins in %ums (%u joins/s)\n",
+			(unsigned int)(JOIN_BENCH_PASSES *
+					NELEMS(join_bench_links)),
+			(unsigned int)(end_ms - start_ms),
+			(unsigned int)(JOIN_BENCH_PASSES *
+					NELEMS(join_bench_links) * 1000 /
+					(end_ms - start_ms)));
+
+	nsurl_unref(base_url);
+}
+END_TEST
+
+
 /**
  * query replacement tests
  */
@@ -847,6 +917,45 @@ START_TEST(nsurl_ref_test)
 END_TEST
 
 
+/**
+ * identical urls share an object
+ */
+START_TEST(nsurl_intern_test)
+{
+	nserror err;
+	nsurl *res1;
+	nsurl *res2;
+	nsurl *res3;
+
+	err = nsurl_create(base_str, &res1);
+	ck_assert(err == NSERROR_OK);
+
+	/* equivalent input normalises to the same url */
+	err = nsurl_create("HTTP://A/b/c/d;p?q", &res2);
+	ck_assert(err == NSERROR_OK);
+
+	ck_assert(res1 == res2);
+	ck_assert(nsurl_compare(res1, res2, NSURL_WITH_FRAGMENT));
+
+	/* differing only by fragment */
+	err = nsurl_join(res1, "#f", &res3);
+	ck_assert(err == NSERROR_OK);
+
+	ck_assert(res1 != res3);
+	ck_assert(nsurl_compare(res1, res3, NSURL_COMPLETE));
+	ck_assert(!nsurl_compare(res1, res3, NSURL_WITH_FRAGMENT));
+
+	nsurl_unref(res3);
+	nsurl_unref(res2);
+
+	/* still valid after the other reference is dropped */
+	ck_assert_str_eq(nsurl_access(res1), base_str);
+
+	nsurl_unref(res1);
+}
+END_TEST
+
+
 /**
  * check creation asserts on NULL parameter
  */
@@ -1420,6 +1529,7 @@ static Suite *nsurl_suite(void)
 			    nsurl_create_test,
 			    0, NELEMS(create_tests));
 	tcase_add_test(tc_create, nsurl_ref_test);
+	tcase_add_test(tc_create, nsurl_intern_test);
 	suite_add_tcase(s, tc_create);
 
 	/* url access and length */
@@ -1490,6 +1600,7 @@ static Suite *nsurl_suite(void)
 	tcase_add_loop_test(tc_join,
 			    nsurl_join_complex_test,
 			    0, NELEMS(join_complex_tests));
+	tcase_add_test(tc_join, nsurl_join_bench_test);
 
 	suite_add_tcase(s, tc_join);
 
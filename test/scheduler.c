@@ -0,0 +1,330 @@
+/*
+ * Copyright 2017 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Test common callback scheduler.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <check.h>
+#include <nsutils/time.h>
+
+#include "utils/errors.h"
+#include "desktop/scheduler.h"
+
+#define NELEMS(x)  (sizeof(x) / sizeof((x)[0]))
+
+/** number of callbacks used by the benchmark */
+#define BENCH_COUNT 100000
+
+/** record of callbacks made */
+static struct {
+	unsigned int count;
+	intptr_t order[64];
+} made;
+
+static void record_callback(void *p)
+{
+	if (made.count < NELEMS(made.order)) {
+		made.order[made.count] = (intptr_t)p;
+	}
+	made.count++;
+}
+
+static void reschedule_callback(void *p)
+{
+	record_callback(p);
+	scheduler_schedule(0, reschedule_callback, p);
+}
+
+static void cancel_callback(void *p)
+{
+	record_callback(p);
+	scheduler_schedule(-1, record_callback, (void *)((intptr_t)p + 1));
+}
+
+static void count_callback(void *p)
+{
+	made.count++;
+}
+
+static void scheduler_setup(void)
+{
+	made.count = 0;
+}
+
+static void scheduler_teardown(void)
+{
+	scheduler_finalise();
+}
+
+
+START_TEST(scheduler_empty_test)
+{
+	ck_assert_int_eq(scheduler_run(), -1);
+	ck_assert_int_eq(scheduler_schedule(-1, record_callback, NULL),
+			 NSERROR_OK);
+	ck_assert_int_eq(scheduler_run(), -1);
+	ck_assert_int_eq(made.count, 0);
+}
+END_TEST
+
+START_TEST(scheduler_order_test)
+{
+	intptr_t idx;
+
+	/* callbacks due at the same time are made in the order scheduled */
+	for (idx = 0; idx < 8; idx++) {
+		ck_assert_int_eq(scheduler_schedule(0, record_callback,
+						    (void *)(7 - idx)),
+				 NSERROR_OK);
+	}
+	ck_assert_int_eq(scheduler_schedule(100000, record_callback,
+					    (void *)100),
+			 NSERROR_OK);
+
+	ck_assert_int_gt(scheduler_run(), 0);
+	ck_assert_int_eq(made.count, 8);
+	for (idx = 0; idx < 8; idx++) {
+		ck_assert_int_eq(made.order[idx], 7 - idx);
+	}
+}
+END_TEST
+
+START_TEST(scheduler_replace_test)
+{
+	ck_assert_int_eq(scheduler_schedule(0, record_callback, (void *)1),
+			 NSERROR_OK);
+	ck_assert_int_eq(scheduler_schedule(0, record_callback, (void *)2),
+			 NSERROR_OK);
+
+	/* replacing moves the callback after those already scheduled */
+	ck_assert_int_eq(scheduler_schedule(0, record_callback, (void *)1),
+			 NSERROR_OK);
+
+	ck_assert_int_eq(scheduler_run(), -1);
+	ck_assert_int_eq(made.count, 2);
+	ck_assert_int_eq(made.order[0], 2);
+	ck_assert_int_eq(made.order[1], 1);
+
+	/* replacing a due callback with a later one defers it */
+	ck_assert_int_eq(scheduler_schedule(0, record_callback, (void *)3),
+			 NSERROR_OK);
+	ck_assert_int_eq(scheduler_schedule(100000, record_callback,
+					    (void *)3),
+			 NSERROR_OK);
+	ck_assert_int_gt(scheduler_run(), 0);
+	ck_assert_int_eq(made.count, 2);
+}
+END_TEST
+
+START_TEST(scheduler_cancel_test)
+{
+	intptr_t idx;
+
+	for (idx = 0; idx < 8; idx++) {
+		ck_assert_int_eq(scheduler_schedule(0, record_callback,
+						    (void *)idx),
+				 NSERROR_OK);
+	}
+	ck_assert_int_eq(scheduler_schedule(-1, record_callback, (void *)3),
+			 NSERROR_OK);
+	ck_assert_int_eq(scheduler_schedule(-1, record_callback, (void *)0),
+			 NSERROR_OK);
+	ck_assert_int_eq(scheduler_schedule(-1, record_callback, (void *)7),
+			 NSERROR_OK);
+	/* different callback with the same parameter is not removed */
+	ck_assert_int_eq(scheduler_schedule(-1, count_callback, (void *)5),
+			 NSERROR_OK);
+
+	ck_assert_int_eq(scheduler_run(), -1);
+	ck_assert_int_eq(made.count, 5);
+	ck_assert_int_eq(made.order[0], 1);
+	ck_assert_int_eq(made.order[1], 2);
+	ck_assert_int_eq(made.order[2], 4);
+	ck_assert_int_eq(made.order[3], 5);
+	ck_assert_int_eq(made.order[4], 6);
+}
+END_TEST
+
+START_TEST(scheduler_callback_reschedule_test)
+{
+	ck_assert_int_eq(scheduler_schedule(0, reschedule_callback,
+					    (void *)1),
+			 NSERROR_OK);
+
+	/* a callback rescheduling itself is not made again in this run */
+	ck_assert_int_eq(scheduler_run(), 0);
+	ck_assert_int_eq(made.count, 1);
+	ck_assert_int_eq(scheduler_run(), 0);
+	ck_assert_int_eq(made.count, 2);
+
+	ck_assert_int_eq(scheduler_schedule(-1, reschedule_callback,
+					    (void *)1),
+			 NSERROR_OK);
+	ck_assert_int_eq(scheduler_run(), -1);
+}
+END_TEST
+
+START_TEST(scheduler_callback_cancel_test)
+{
+	ck_assert_int_eq(scheduler_schedule(0, cancel_callback, (void *)1),
+			 NSERROR_OK);
+	ck_assert_int_eq(scheduler_schedule(0, record_callback, (void *)2),
+			 NSERROR_OK);
+	ck_assert_int_eq(scheduler_schedule(0, record_callback, (void *)3),
+			 NSERROR_OK);
+
+	/* a callback may remove another which is due */
+	ck_assert_int_eq(scheduler_run(), -1);
+	ck_assert_int_eq(made.count, 2);
+	ck_assert_int_eq(made.order[0], 1);
+	ck_assert_int_eq(made.order[1], 3);
+}
+END_TEST
+
+START_TEST(scheduler_many_test)
+{
+	intptr_t idx;
+
+	/* enough entries to grow the heap and hash several times */
+	for (idx = 0; idx < 4096; idx++) {
+		ck_assert_int_eq(scheduler_schedule((idx & 1) ? 100000 : 0,
+						    count_callback,
+						    (void *)idx),
+				 NSERROR_OK);
+	}
+	ck_assert_uint_eq(scheduler_count(), 4096);
+	for (idx = 0; idx < 4096; idx += 4) {
+		ck_assert_int_eq(scheduler_schedule(-1, count_callback,
+						    (void *)idx),
+				 NSERROR_OK);
+	}
+	ck_assert_uint_eq(scheduler_count(), 3072);
+
+	ck_assert_int_gt(scheduler_run(), 0);
+	ck_assert_int_eq(made.count, 1024);
+	ck_assert_uint_eq(scheduler_count(), 2048);
+}
+END_TEST
+
+START_TEST(scheduler_benchmark_test)
+{
+	uint64_t start_ms;
+	uint64_t schedule_ms;
+	uint64_t cancel_ms;
+	uint64_t run_ms;
+	intptr_t idx;
+
+	nsu_getmonotonic_ms(&start_ms);
+	for (idx = 0; idx < BENCH_COUNT; idx++) {
+		scheduler_schedule((int)(idx % 1000), count_callback,
+				   (void *)idx);
+	}
+	nsu_getmonotonic_ms(&schedule_ms);
+
+	/* cancel every other callback, as happens when fetches complete */
+	for (idx = 0; idx < BENCH_COUNT; idx += 2) {
+		scheduler_schedule(-1, count_callback, (void *)idx);
+	}
+	nsu_getmonotonic_ms(&cancel_ms);
+
+	while (scheduler_run() != -1) {
+		/* spin until every callback is made */
+	}
+	nsu_getmonotonic_ms(&run_ms);
+
+	ck_assert_int_eq(made.count, BENCH_COUNT / 2);
+
+	printf("scheduler: %d schedule %"PRIu64"ms, %d cancel %"PRIu64"ms, "
+	       "%d run %"PRIu64"ms\n",
+	       BENCH_COUNT, schedule_ms - start_ms,
+	       BENCH_COUNT / 2, cancel_ms - schedule_ms,
+	       BENCH_COUNT / 2, run_ms - cancel_ms);
+}
+END_TEST
+
+
+/* suite generation */
+static Suite *scheduler_suite(void)
+{
+	Suite *s;
+	TCase *tc_schedule;
+	TCase *tc_callback;
+	TCase *tc_benchmark;
+
+	s = suite_create("scheduler");
+
+	/* scheduling, replacing and removing callbacks */
+	tc_schedule = tcase_create("Schedule");
+
+	tcase_add_checked_fixture(tc_schedule,
+				  scheduler_setup,
+				  scheduler_teardown);
+
+	tcase_add_test(tc_schedule, scheduler_empty_test);
+	tcase_add_test(tc_schedule, scheduler_order_test);
+	tcase_add_test(tc_schedule, scheduler_replace_test);
+	tcase_add_test(tc_schedule, scheduler_cancel_test);
+	tcase_add_test(tc_schedule, scheduler_many_test);
+	suite_add_tcase(s, tc_schedule);
+
+	/* callbacks which modify the schedule */
+	tc_callback = tcase_create("Callback");
+
+	tcase_add_checked_fixture(tc_callback,
+				  scheduler_setup,
+				  scheduler_teardown);
+
+	tcase_add_test(tc_callback, scheduler_callback_reschedule_test);
+	tcase_add_test(tc_callback, scheduler_callback_cancel_test);
+	suite_add_tcase(s, tc_callback);
+
+	/* timing, reported but not asserted */
+	tc_benchmark = tcase_create("Benchmark");
+
+	tcase_add_checked_fixture(tc_benchmark,
+				  scheduler_setup,
+				  scheduler_teardown);
+
+	tcase_set_timeout(tc_benchmark, 30);
+	tcase_add_test(tc_benchmark, scheduler_benchmark_test);
+	suite_add_tcase(s, tc_benchmark);
+
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = scheduler_suite();
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_ENV);
+
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
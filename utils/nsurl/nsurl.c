@@ -64,6 +64,194 @@
 
 
 
+/******************************************************************************
+ * NetSurf URL intern table                                                   *
+ ******************************************************************************/
+
+#ifdef NSURL_INTERN
+
+/** Minimum number of intern table buckets; must be a power of two */
+#define NSURL_INTERN_MIN_BUCKETS 256
+
+/** Table of interned NetSurf URLs, chained by intern_next */
+static struct {
+	nsurl **bucket;		/**< Hash buckets */
+	uint32_t size;		/**< Number of buckets */
+	uint32_t count;		/**< Number of interned URLs */
+} nsurl__interned;
+
+
+/**
+ * Get the intern table bucket index for a NetSurf URL
+ *
+ * The nsurl hash doesn't cover the fragment, so mix that in too.
+ *
+ * \param url	NetSurf URL to get bucket for
+ * \param size	Number of buckets
+ * \return bucket index
+ */
+static inline uint32_t nsurl__intern_bucket(const nsurl *url, uint32_t size)
+{
+	uint32_t hash = url->hash;
+
+	if (url->components.fragment != NULL)
+		hash ^= lwc_string_hash_value(url->components.fragment);
+
+	return ((hash * 0x9e3779b1u) >> 8) & (size - 1);
+}
+
+
+/**
+ * Check whether two NetSurf URLs are identical
+ *
+ * Components are interned lwc strings, so are compared by address.
+ */
+static inline bool nsurl__identical(const nsurl *url1, const nsurl *url2)
+{
+	const struct nsurl_components *c1 = &url1->components;
+	const struct nsurl_components *c2 = &url2->components;
+
+	return url1->hash == url2->hash &&
+			url1->length == url2->length &&
+			c1->scheme_type == c2->scheme_type &&
+			c1->scheme == c2->scheme &&
+			c1->username == c2->username &&
+			c1->password == c2->password &&
+			c1->host == c2->host &&
+			c1->port == c2->port &&
+			c1->path == c2->path &&
+			c1->query == c2->query &&
+			c1->fragment == c2->fragment &&
+			memcmp(url1->string, url2->string, url1->length) == 0;
+}
+
+
+/**
+ * Resize the intern table
+ *
+ * \param size	New number of buckets
+ * \return true on success, false on memory exhaustion
+ */
+static bool nsurl__intern_resize(uint32_t size)
+{
+	nsurl **bucket;
+	uint32_t i;
+
+	bucket = calloc(size, sizeof(*bucket));
+	if (bucket == NULL)
+		return false;
+
+	for (i = 0; i < nsurl__interned.size; i++) {
+		nsurl *url = nsurl__interned.bucket[i];
+
+		while (url != NULL) {
+			nsurl *next = url->intern_next;
+			uint32_t b = nsurl__intern_bucket(url, size);
+
+			url->intern_next = bucket[b];
+			bucket[b] = url;
+			url = next;
+		}
+	}
+
+	free(nsurl__interned.bucket);
+	nsurl__interned.bucket = bucket;
+	nsurl__interned.size = size;
+
+	return true;
+}
+
+
+/* exported interface, documented in nsurl/private.h */
+void nsurl__intern(nsurl **url)
+{
+	nsurl *new_url = *url;
+	nsurl *existing;
+	uint32_t b;
+
+	new_url->interned = false;
+	new_url->intern_next = NULL;
+
+	if (nsurl__interned.size != 0) {
+		b = nsurl__intern_bucket(new_url, nsurl__interned.size);
+
+		for (existing = nsurl__interned.bucket[b]; existing != NULL;
+				existing = existing->intern_next) {
+			if (nsurl__identical(existing, new_url)) {
+				/* Use the existing object */
+				nsurl__components_destroy(&new_url->components);
+				free(new_url);
+
+				existing->count++;
+				*url = existing;
+				return;
+			}
+		}
+	}
+
+	if (nsurl__interned.count >= nsurl__interned.size) {
+		/* Keep average chain length to at most one.  If the table
+		 * can't grow the URL is simply not interned. */
+		if (nsurl__intern_resize(nsurl__interned.size == 0 ?
+				NSURL_INTERN_MIN_BUCKETS :
+				nsurl__interned.size * 2) == false)
+			return;
+	}
+
+	b = nsurl__intern_bucket(new_url, nsurl__interned.size);
+	new_url->intern_next = nsurl__interned.bucket[b];
+	nsurl__interned.bucket[b] = new_url;
+	new_url->interned = true;
+	nsurl__interned.count++;
+}
+
+
+/**
+ * Remove a NetSurf URL from the intern table
+ *
+ * The table is freed once it is empty.
+ *
+ * \param url	NetSurf URL to remove
+ */
+static void nsurl__unintern(nsurl *url)
+{
+	nsurl **link;
+
+	if (url->interned == false)
+		return;
+
+	link = &nsurl__interned.bucket[
+			nsurl__intern_bucket(url, nsurl__interned.size)];
+	while (*link != url) {
+		assert(*link != NULL);
+		link = &(*link)->intern_next;
+	}
+	*link = url->intern_next;
+
+	if (--nsurl__interned.count == 0) {
+		free(nsurl__interned.bucket);
+		nsurl__interned.bucket = NULL;
+		nsurl__interned.size = 0;
+	}
+}
+
+#else
+
+/* exported interface, documented in nsurl/private.h */
+void nsurl__intern(nsurl **url)
+{
+	(*url)->interned = false;
+	(*url)->intern_next = NULL;
+}
+
+static inline void nsurl__unintern(nsurl *url)
+{
+}
+
+#endif
+
+
+
 /******************************************************************************
  * NetSurf URL Public API                                                     *
  ******************************************************************************/
@@ -92,6 +280,9 @@ void nsurl_unref(nsurl *url)
 	nsurl__dump(url);
 #endif
 
+	/* Remove from the intern table */
+	nsurl__unintern(url);
+
 	/* Release lwc strings */
 	nsurl__components_destroy(&url->components);
 
@@ -108,6 +299,22 @@ bool nsurl_compare(const nsurl *url1, const nsurl *url2, nsurl_component parts)
 	assert(url1 != NULL);
 	assert(url2 != NULL);
 
+	if (url1 == url2)
+		return true;
+
+	if (url1->interned && url2->interned) {
+		/* Distinct interned URLs always differ somewhere */
+		if (parts == NSURL_WITH_FRAGMENT)
+			return false;
+
+		/* The hash covers everything but the fragment */
+		if (parts == NSURL_COMPLETE &&
+				(url1->hash != url2->hash ||
+				(url1->components.fragment == NULL &&
+				url2->components.fragment == NULL)))
+			return false;
+	}
+
 	/* Compare URL components */
 
 	/* Path, host and query first, since they're most likely to differ */
@@ -489,6 +696,9 @@ nserror nsurl_defragment(const nsurl *url, nsurl **no_frag)
 	/* Give the URL a reference */
 	(*no_frag)->count = 1;
 
+	/* Share an identical URL if there is one */
+	nsurl__intern(no_frag);
+
 	return NSERROR_OK;
 }
 
@@ -557,6 +767,9 @@ nserror nsurl_refragment(const nsurl *url, lwc_string *frag, nsurl **new_url)
 	/* Give the URL a reference */
 	(*new_url)->count = 1;
 
+	/* Share an identical URL if there is one */
+	nsurl__intern(new_url);
+
 	return NSERROR_OK;
 }
 
@@ -644,6 +857,9 @@ nserror nsurl_replace_query(const nsurl *url, const char *query,
 	/* Give the URL a reference */
 	(*new_url)->count = 1;
 
+	/* Share an identical URL if there is one */
+	nsurl__intern(new_url);
+
 	return NSERROR_OK;
 }
 
@@ -847,6 +1063,9 @@ nserror nsurl_parent(const nsurl *url, nsurl **new_url)
 	/* Give the URL a reference */
 	(*new_url)->count = 1;
 
+	/* Share an identical URL if there is one */
+	nsurl__intern(new_url);
+
 	return NSERROR_OK;
 }
 
@@ -1224,6 +1224,233 @@ void nsurl__calc_hash(nsurl *url)
 }
 
 
+/** Size of stack buffer used to merge paths in simple joins */
+#define NSURL_JOIN_SIMPLE_PATH_MAX 512
+
+
+/**
+ * Check whether a path contains any "." or ".." segments
+ *
+ * \param path	path to check
+ * \param len	length of path
+ * \return true if there are dot segments, else false
+ */
+static bool nsurl__has_dot_segment(const char *path, size_t len)
+{
+	const char *end = path + len;
+	const char *seg = path;
+
+	while (seg <= end) {
+		const char *seg_end = memchr(seg, '/', end - seg);
+		size_t seg_len;
+
+		if (seg_end == NULL)
+			seg_end = end;
+
+		seg_len = seg_end - seg;
+		if (seg_len != 0 && seg_len <= 2 && seg[0] == '.' &&
+				(seg_len == 1 || seg[1] == '.'))
+			return true;
+
+		seg = seg_end + 1;
+	}
+
+	return false;
+}
+
+
+/**
+ * Join a simple relative reference to a base URL
+ *
+ * Handles the common references found in documents: fragment or query
+ * only references, and absolute or same directory relative paths.  The
+ * reference must contain only characters which need no normalisation
+ * and its path must have no dot segments.  The result shares the base
+ * URL's scheme and authority components, and the leading part of its
+ * string, so nothing is reparsed or reserialised.
+ *
+ * \param base		NetSurf URL to join to
+ * \param rel		Relative reference
+ * \param joined	Updated to the joined URL on success
+ * \return NSERROR_OK on success, NSERROR_NOT_IMPLEMENTED if the reference
+ *         needs a full join, or other error on failure
+ */
+static nserror nsurl__join_simple(const nsurl *base, const char *rel,
+		nsurl **joined)
+{
+	const struct nsurl_components *b = &base->components;
+	struct nsurl_components c;
+	char path_buf[NSURL_JOIN_SIMPLE_PATH_MAX];
+	const char *path = rel;
+	const char *query = NULL;
+	const char *fragment = NULL;
+	const char *pos;
+	bool slash = false;
+	size_t path_l;
+	size_t query_l;
+	size_t fragment_l;
+	size_t prefix_l;
+	size_t length;
+	char *str;
+
+	/* The full parser takes "//" after any leading run of scheme
+	 * characters as the start of an authority, even without a scheme */
+	pos = rel;
+	if (ascii_is_alpha(*pos)) {
+		while (ascii_is_alphanumerical(*pos) || *pos == '+' ||
+				*pos == '-' || *pos == '.')
+			pos++;
+	}
+	if (pos[0] == '/' && pos[1] == '/')
+		return NSERROR_NOT_IMPLEMENTED;
+
+	/* Find the sections, and check they need no normalisation */
+	for (pos = rel; *pos != '\0'; pos++) {
+		if (*pos == '%' || nsurl__is_no_escape(*pos) == false)
+			return NSERROR_NOT_IMPLEMENTED;
+
+		if (fragment != NULL) {
+			continue;
+		} else if (*pos == '#') {
+			fragment = pos;
+		} else if (query != NULL) {
+			continue;
+		} else if (*pos == '?') {
+			query = pos;
+		} else if (*pos == '/') {
+			slash = true;
+		} else if (*pos == ':' && slash == false) {
+			/* Might have a scheme */
+			return NSERROR_NOT_IMPLEMENTED;
+		}
+	}
+
+	fragment_l = (fragment != NULL) ? (size_t)(pos - fragment - 1) : 0;
+	if (fragment == NULL)
+		fragment = pos;
+	query_l = (query != NULL) ? (size_t)(fragment - query) : 0;
+	if (query == NULL)
+		query = fragment;
+	path_l = query - path;
+
+	if (path_l != 0) {
+		/* The string prefix can only be shared if both paths are
+		 * absolute */
+		if (b->path == NULL || lwc_string_data(b->path)[0] != '/')
+			return NSERROR_NOT_IMPLEMENTED;
+
+		if (path[0] != '/') {
+			/* Merge with all but the last segment of base path */
+			const char *base_path = lwc_string_data(b->path);
+			size_t base_l = lwc_string_length(b->path);
+
+			while (base_path[base_l - 1] != '/')
+				base_l--;
+
+			if (base_l + path_l > sizeof(path_buf))
+				return NSERROR_NOT_IMPLEMENTED;
+
+			memcpy(path_buf, base_path, base_l);
+			memcpy(path_buf + base_l, path, path_l);
+			path = path_buf;
+			path_l += base_l;
+		}
+
+		if (nsurl__has_dot_segment(path, path_l))
+			return NSERROR_NOT_IMPLEMENTED;
+	}
+
+	/* Scheme and authority come from the base */
+	c.scheme_type = b->scheme_type;
+	c.scheme = nsurl__component_copy(b->scheme);
+	c.username = nsurl__component_copy(b->username);
+	c.password = nsurl__component_copy(b->password);
+	c.host = nsurl__component_copy(b->host);
+	c.port = nsurl__component_copy(b->port);
+	c.path = NULL;
+	c.query = NULL;
+	c.fragment = NULL;
+
+	if (path_l == 0) {
+		c.path = nsurl__component_copy(b->path);
+	} else if (lwc_intern_string(path, path_l, &c.path) != lwc_error_ok) {
+		goto nomem;
+	}
+
+	if (path_l == 0 && query_l == 0) {
+		c.query = nsurl__component_copy(b->query);
+	} else if (query_l != 0 && lwc_intern_string(query, query_l,
+			&c.query) != lwc_error_ok) {
+		goto nomem;
+	}
+
+	if (fragment_l != 0 && lwc_intern_string(fragment + 1, fragment_l,
+			&c.fragment) != lwc_error_ok) {
+		goto nomem;
+	}
+
+	/* Length of the base URL string before its path */
+	prefix_l = base->length;
+	if (b->path != NULL)
+		prefix_l -= lwc_string_length(b->path);
+	if (b->query != NULL)
+		prefix_l -= lwc_string_length(b->query);
+	if (b->fragment != NULL)
+		prefix_l -= SLEN("#") + lwc_string_length(b->fragment);
+
+	length = prefix_l;
+	if (c.path != NULL)
+		length += lwc_string_length(c.path);
+	if (c.query != NULL)
+		length += lwc_string_length(c.query);
+	if (c.fragment != NULL)
+		length += SLEN("#") + lwc_string_length(c.fragment);
+
+	*joined = malloc(sizeof(nsurl) + length + 1); /* Add 1 for \0 */
+	if (*joined == NULL)
+		goto nomem;
+
+	/* Fill out the url string */
+	str = (*joined)->string;
+	memcpy(str, base->string, prefix_l);
+	str += prefix_l;
+	if (c.path != NULL) {
+		memcpy(str, lwc_string_data(c.path), lwc_string_length(c.path));
+		str += lwc_string_length(c.path);
+	}
+	if (c.query != NULL) {
+		memcpy(str, lwc_string_data(c.query),
+				lwc_string_length(c.query));
+		str += lwc_string_length(c.query);
+	}
+	if (c.fragment != NULL) {
+		*(str++) = '#';
+		memcpy(str, lwc_string_data(c.fragment),
+				lwc_string_length(c.fragment));
+		str += lwc_string_length(c.fragment);
+	}
+	*str = '\0';
+
+	(*joined)->components = c;
+	(*joined)->length = length;
+
+	/* Get the nsurl's hash */
+	nsurl__calc_hash(*joined);
+
+	/* Give the URL a reference */
+	(*joined)->count = 1;
+
+	/* Share an identical URL if there is one */
+	nsurl__intern(joined);
+
+	return NSERROR_OK;
+
+nomem:
+	nsurl__components_destroy(&c);
+	return NSERROR_NOMEM;
+}
+
+
 /******************************************************************************
  * NetSurf URL Public API                                                     *
  ******************************************************************************/
@@ -1297,6 +1524,9 @@ nserror nsurl_create(const char * const url_s, nsurl **url)
 	/* Give the URL a reference */
 	(*url)->count = 1;
 
+	/* Share an identical URL if there is one */
+	nsurl__intern(url);
+
 	return NSERROR_OK;
 }
 
@@ -1328,6 +1558,12 @@ nserror nsurl_join(const nsurl *base, const char *rel, nsurl **joined)
 	      rel);
 #endif
 
+	/* Most references in documents need no parsing */
+	error = nsurl__join_simple(base, rel, joined);
+	if (error != NSERROR_NOT_IMPLEMENTED) {
+		return error;
+	}
+
 	/* Peg out the URL sections */
 	nsurl__get_string_markers(rel, &m, true);
 
@@ -1537,6 +1773,9 @@ nserror nsurl_join(const nsurl *base, const char *rel, nsurl **joined)
 	/* Give the URL a reference */
 	(*joined)->count = 1;
 
+	/* Share an identical URL if there is one */
+	nsurl__intern(joined);
+
 	return NSERROR_OK;
 }
 
@@ -28,6 +28,9 @@
 /* Define to enable NSURL debugging */
 #undef NSURL_DEBUG
 
+/* Define to share a single object between identical NetSurf URLs */
+#define NSURL_INTERN
+
 
 /** A type for URL schemes */
 enum nsurl_scheme_type {
@@ -75,6 +78,9 @@ struct nsurl {
 	int count;	/* Number of references to NetSurf URL object */
 	uint32_t hash;	/* Hash value for nsurl identification */
 
+	bool interned;	/* Whether the object is in the intern table */
+	struct nsurl *intern_next;	/* Next object in intern table bucket */
+
 	size_t length;	/* Length of string */
 	char string[FLEX_ARRAY_LEN_DECL];	/* Full URL as a string */
 };
@@ -142,6 +148,22 @@ nserror nsurl__components_to_string(
 void nsurl__calc_hash(nsurl *url);
 
 
+/**
+ * Share a single object between identical NetSurf URLs
+ *
+ * Must be called on each newly created NetSurf URL object, once its hash
+ * has been calculated and it has been given its reference.  If an
+ * identical URL is already interned, the new object is destroyed and
+ * replaced with a new reference to the existing one.  Otherwise the new
+ * object is added to the intern table.
+ *
+ * Interned URLs with a different address are never identical, which
+ * allows nsurl_compare to avoid comparing components.
+ *
+ * \param url	Updated to the NetSurf URL object to use
+ */
+void nsurl__intern(nsurl **url);
+
 
 
 /**
@@ -73,6 +73,8 @@
 #define TALLOC_MAGIC 0xe814ec70
 #define TALLOC_FLAG_FREE 0x01
 #define TALLOC_FLAG_LOOP 0x02
+#define TALLOC_FLAG_POOL 0x04		/* This is a talloc pool */
+#define TALLOC_FLAG_POOLMEM 0x08	/* This is allocated in a pool */
 #define TALLOC_MAGIC_REFERENCE ((const char *)1)
 
 /* by default we abort when given a bad pointer (such as when talloc_free() is called 
@@ -122,11 +124,46 @@ struct talloc_chunk {
 	const char *name;
 	size_t size;
 	unsigned flags;
+
+	/*
+	 * "pool" has dual use:
+	 *
+	 * For the pool itself: "pool" points at the next free byte
+	 *
+	 * For a pool member: "pool" points at the pool block holding it
+	 */
+	void *pool;
 };
 
 /* 16 byte alignment seems to keep everyone happy */
 #define TC_HDR_SIZE ((sizeof(struct talloc_chunk)+15)&~15)
 #define TC_PTR_FROM_CHUNK(tc) ((void *)(TC_HDR_SIZE + (char*)tc))
+#define TC_ALIGN16(s) (((s)+15)&~15)
+
+/*
+  Pool bookkeeping lives at the start of each pool block.  A pool is
+  made of its first block plus further blocks hung off it as children
+  once the first is used up.  Each block counts the live chunks carved
+  from it, plus one for itself, and is only released when that count
+  reaches zero.  Further blocks also hold a count on the first block.
+*/
+struct talloc_pool_hdr {
+	unsigned int object_count;	/* live chunks, plus one for self */
+	int closed;			/* first block freed; no new members */
+	struct talloc_chunk *first;	/* first block of this pool */
+	struct talloc_chunk *current;	/* block to allocate from, or NULL */
+	unsigned int block_count;	/* blocks in this pool */
+	size_t block_size;		/* payload size of each block */
+	size_t used;			/* bytes handed out from all blocks */
+};
+
+#define TC_POOL_HDR(tc) ((struct talloc_pool_hdr *)TC_PTR_FROM_CHUNK(tc))
+#define TC_POOL_HDR_SIZE TC_ALIGN16(sizeof(struct talloc_pool_hdr))
+#define TC_POOL_FIRST_CHUNK(tc) \
+	((void *)(TC_HDR_SIZE + TC_POOL_HDR_SIZE + (char *)(tc)))
+#define TC_POOL_SPACE_LEFT(tc) \
+	((size_t)(((char *)TC_PTR_FROM_CHUNK(tc) + (tc)->size) - \
+			(char *)(tc)->pool))
 
 /* panic if we get a bad magic value */
 static inline struct talloc_chunk *talloc_chunk_from_ptr(const void *ptr)
@@ -203,12 +240,114 @@ const char *talloc_parent_name(const void *ptr)
 	return tc? tc->name : NULL;
 }
 
+static void *__talloc(const void *context, size_t size);
+
+/*
+  drop one object count from a pool block, releasing the block
+  once nothing in it is live
+*/
+static void talloc_pool_release(struct talloc_chunk *block)
+{
+	struct talloc_pool_hdr *hdr = TC_POOL_HDR(block);
+	struct talloc_chunk *first = hdr->first;
+
+	if (--hdr->object_count != 0) {
+		return;
+	}
+
+	if (first != block) {
+		struct talloc_pool_hdr *first_hdr = TC_POOL_HDR(first);
+		if (first_hdr->current == block) {
+			first_hdr->current = NULL;
+		}
+		first_hdr->block_count--;
+		talloc_pool_release(first);
+	}
+
+	free(block);
+}
+
+/*
+  carve a chunk out of the pool the parent belongs to, if any.
+  returns NULL if the parent is not in a pool or the pool cannot
+  satisfy the request, in which case the caller falls back to malloc
+*/
+static struct talloc_chunk *talloc_alloc_pool(struct talloc_chunk *parent,
+					      size_t size)
+{
+	struct talloc_chunk *block;
+	struct talloc_chunk *first;
+	struct talloc_pool_hdr *first_hdr;
+	struct talloc_chunk *result;
+	size_t chunk_size = TC_ALIGN16(TC_HDR_SIZE + size);
+
+	if (likely(parent->flags & TALLOC_FLAG_POOLMEM)) {
+		block = (struct talloc_chunk *)parent->pool;
+	} else if (parent->flags & TALLOC_FLAG_POOL) {
+		block = parent;
+	} else {
+		return NULL;
+	}
+
+	first = TC_POOL_HDR(block)->first;
+	first_hdr = TC_POOL_HDR(first);
+	if (unlikely(first_hdr->closed)) {
+		return NULL;
+	}
+
+	/* large allocations would waste the rest of a block; this
+	   also sends new blocks themselves to malloc */
+	if (unlikely(chunk_size > first_hdr->block_size / 4)) {
+		return NULL;
+	}
+
+	block = first_hdr->current;
+	if (unlikely(block == NULL || TC_POOL_SPACE_LEFT(block) < chunk_size)) {
+		struct talloc_pool_hdr *hdr;
+		void *ptr;
+
+		/* start another block, owned by the first */
+		ptr = __talloc(TC_PTR_FROM_CHUNK(first),
+				TC_POOL_HDR_SIZE + first_hdr->block_size);
+		if (unlikely(ptr == NULL)) {
+			return NULL;
+		}
+		block = talloc_chunk_from_ptr(ptr);
+		block->flags |= TALLOC_FLAG_POOL;
+		block->name = "talloc_pool_block";
+		block->pool = TC_POOL_FIRST_CHUNK(block);
+
+		hdr = TC_POOL_HDR(block);
+		hdr->object_count = 1;
+		hdr->closed = 0;
+		hdr->first = first;
+		hdr->current = NULL;
+		hdr->block_count = 0;
+		hdr->block_size = first_hdr->block_size;
+		hdr->used = 0;
+
+		first_hdr->object_count++;
+		first_hdr->block_count++;
+		first_hdr->current = block;
+	}
+
+	result = (struct talloc_chunk *)block->pool;
+	block->pool = (char *)block->pool + chunk_size;
+	TC_POOL_HDR(block)->object_count++;
+	first_hdr->used += chunk_size;
+
+	result->flags = TALLOC_MAGIC | TALLOC_FLAG_POOLMEM;
+	result->pool = block;
+
+	return result;
+}
+
 /* 
    Allocate a bit of memory as a child of an existing pointer
 */
 static inline void *__talloc(const void *context, size_t size)
 {
-	struct talloc_chunk *tc;
+	struct talloc_chunk *tc = NULL;
 
 	if (unlikely(context == NULL)) {
 		context = null_context;
@@ -218,11 +357,18 @@ static inline void *__talloc(const void *context, size_t size)
 		return NULL;
 	}
 
-	tc = (struct talloc_chunk *)malloc(TC_HDR_SIZE+size);
-	if (unlikely(tc == NULL)) return NULL;
+	if (context != NULL) {
+		tc = talloc_alloc_pool(talloc_chunk_from_ptr(context), size);
+	}
+
+	if (tc == NULL) {
+		tc = (struct talloc_chunk *)malloc(TC_HDR_SIZE+size);
+		if (unlikely(tc == NULL)) return NULL;
+		tc->flags = TALLOC_MAGIC;
+		tc->pool = NULL;
+	}
 
 	tc->size = size;
-	tc->flags = TALLOC_MAGIC;
 	tc->destructor = NULL;
 	tc->child = NULL;
 	tc->name = NULL;
@@ -248,6 +394,67 @@ static inline void *__talloc(const void *context, size_t size)
 	return TC_PTR_FROM_CHUNK(tc);
 }
 
+/*
+  create a talloc pool.  children of the pool, and their children in
+  turn, are carved out of blocks of the given size rather than each
+  being malloced, and are released together once the pool and all its
+  members have been freed
+*/
+void *talloc_pool(const void *context, size_t size)
+{
+	struct talloc_chunk *tc;
+	struct talloc_pool_hdr *hdr;
+	void *result;
+
+	result = __talloc(context, TC_POOL_HDR_SIZE + size);
+	if (unlikely(result == NULL)) {
+		return NULL;
+	}
+
+	tc = talloc_chunk_from_ptr(result);
+	if (unlikely(tc->flags & TALLOC_FLAG_POOLMEM)) {
+		/* nested pools would complicate release; refuse */
+		talloc_free(result);
+		return NULL;
+	}
+
+	tc->flags |= TALLOC_FLAG_POOL;
+	tc->pool = TC_POOL_FIRST_CHUNK(tc);
+
+	hdr = TC_POOL_HDR(tc);
+	hdr->object_count = 1;
+	hdr->closed = 0;
+	hdr->first = tc;
+	hdr->current = tc;
+	hdr->block_count = 1;
+	hdr->block_size = size;
+	hdr->used = 0;
+
+	return result;
+}
+
+/*
+  report how much of a pool is in use.  capacity and used are in bytes
+  and include talloc headers
+*/
+void talloc_pool_usage(const void *ptr, size_t *capacity, size_t *used,
+		       unsigned int *blocks)
+{
+	struct talloc_chunk *tc = talloc_chunk_from_ptr(ptr);
+	struct talloc_pool_hdr *hdr;
+
+	if (!(tc->flags & TALLOC_FLAG_POOL)) {
+		*capacity = *used = 0;
+		*blocks = 0;
+		return;
+	}
+
+	hdr = TC_POOL_HDR(TC_POOL_HDR(tc)->first);
+	*capacity = hdr->block_count * hdr->block_size;
+	*used = hdr->used;
+	*blocks = hdr->block_count;
+}
+
 /*
   setup a destructor to be called on free of a pointer
   the destructor should return 0 on success, or -1 on failure.
@@ -401,6 +608,12 @@ static inline int _talloc_free(void *ptr)
 
 	tc->flags |= TALLOC_FLAG_LOOP;
 
+	if (unlikely(tc->flags & TALLOC_FLAG_POOL) &&
+			TC_POOL_HDR(tc)->first == tc) {
+		/* members freed from here on must not be replaced */
+		TC_POOL_HDR(tc)->closed = 1;
+	}
+
 	while (tc->child) {
 		/* we need to work out who will own an abandoned child
 		   if it cannot be freed. In priority order, the first
@@ -423,7 +636,14 @@ static inline int _talloc_free(void *ptr)
 	}
 
 	tc->flags |= TALLOC_FLAG_FREE;
-	free(tc);
+
+	if (tc->flags & TALLOC_FLAG_POOLMEM) {
+		talloc_pool_release((struct talloc_chunk *)tc->pool);
+	} else if (tc->flags & TALLOC_FLAG_POOL) {
+		talloc_pool_release(tc);
+	} else {
+		free(tc);
+	}
 	return 0;
 }
 
@@ -790,23 +1010,38 @@ void *_talloc_realloc(const void *context, void *ptr, size_t size, const char *n
 
 	tc = talloc_chunk_from_ptr(ptr);
 
-	/* don't allow realloc on referenced pointers */
-	if (unlikely(tc->refs)) {
+	/* don't allow realloc on referenced pointers or pools */
+	if (unlikely(tc->refs || (tc->flags & TALLOC_FLAG_POOL))) {
 		return NULL;
 	}
 
 	/* by resetting magic we catch users of the old memory */
 	tc->flags |= TALLOC_FLAG_FREE;
 
+	if (tc->flags & TALLOC_FLAG_POOLMEM) {
+		struct talloc_chunk *block = (struct talloc_chunk *)tc->pool;
+
+		/* pool chunks can't grow in place; move out to malloc */
+		new_ptr = malloc(size + TC_HDR_SIZE);
+		if (new_ptr) {
+			memcpy(new_ptr, tc, TC_HDR_SIZE +
+					(size < tc->size ? size : tc->size));
+			((struct talloc_chunk *)new_ptr)->flags &=
+					~TALLOC_FLAG_POOLMEM;
+			((struct talloc_chunk *)new_ptr)->pool = NULL;
+			talloc_pool_release(block);
+		}
+	} else {
 #if ALWAYS_REALLOC
-	new_ptr = malloc(size + TC_HDR_SIZE);
-	if (new_ptr) {
-		memcpy(new_ptr, tc, tc->size + TC_HDR_SIZE);
-		free(tc);
-	}
+		new_ptr = malloc(size + TC_HDR_SIZE);
+		if (new_ptr) {
+			memcpy(new_ptr, tc, tc->size + TC_HDR_SIZE);
+			free(tc);
+		}
 #else
-	new_ptr = realloc(tc, size + TC_HDR_SIZE);
+		new_ptr = realloc(tc, size + TC_HDR_SIZE);
 #endif
+	}
 	if (unlikely(!new_ptr)) {	
 		tc->flags &= ~TALLOC_FLAG_FREE; 
 		return NULL; 
@@ -869,7 +1104,8 @@ size_t talloc_total_size(const void *ptr)
 
 	tc->flags |= TALLOC_FLAG_LOOP;
 
-	total = tc->size;
+	/* pool blocks are reported through talloc_pool_usage() */
+	total = (tc->flags & TALLOC_FLAG_POOL) ? 0 : tc->size;
 	for (c=tc->child;c;c=c->next) {
 		total += talloc_total_size(TC_PTR_FROM_CHUNK(c));
 	}
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2017 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Performance tracing implementation.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "netsurf/inttypes.h"
+#include "utils/sys_time.h"
+#include "utils/trace.h"
+
+#ifdef WITH_TRACE
+
+/** Number of events kept; must be a power of two */
+#define NSTRACE_RING_SIZE (1 << 16)
+
+/** A recorded trace event */
+struct nstrace_entry {
+	uint64_t ts; /**< time of event in microseconds */
+	int64_t value; /**< counter value, async id or duration */
+	const char *name; /**< event name */
+	enum nstrace_type type; /**< event type */
+};
+
+/** Ring of recorded events */
+static struct nstrace_entry nstrace_ring[NSTRACE_RING_SIZE];
+
+/** Total number of events recorded since the ring was cleared */
+static uint64_t nstrace_count;
+
+
+/* exported interface documented in utils/trace.h */
+void nstrace_event(enum nstrace_type type, const char *name,
+		uint64_t ts, int64_t value)
+{
+	struct nstrace_entry *entry;
+
+	entry = &nstrace_ring[nstrace_count & (NSTRACE_RING_SIZE - 1)];
+	entry->ts = ts;
+	entry->value = value;
+	entry->name = name;
+	entry->type = type;
+
+	nstrace_count++;
+}
+
+
+/* exported interface documented in utils/trace.h */
+int nstrace_snevent(char *str, size_t size, unsigned int idx)
+{
+	const struct nstrace_entry *entry;
+	const char *sep = (idx == 0) ? "" : ",\n";
+	uint64_t first;
+
+	first = (nstrace_count > NSTRACE_RING_SIZE) ?
+		nstrace_count - NSTRACE_RING_SIZE : 0;
+	if (idx >= nstrace_count - first) {
+		return -1;
+	}
+
+	entry = &nstrace_ring[(first + idx) & (NSTRACE_RING_SIZE - 1)];
+
+	switch (entry->type) {
+	case NSTRACE_TYPE_BEGIN:
+	case NSTRACE_TYPE_END:
+		return snprintf(str, size,
+				"%s{\"name\":\"%s\",\"cat\":\"netsurf\","
+				"\"ph\":\"%c\",\"pid\":1,\"tid\":1,"
+				"\"ts\":%"PRIu64"}",
+				sep, entry->name,
+				(entry->type == NSTRACE_TYPE_BEGIN) ? 'B' : 'E',
+				entry->ts);
+
+	case NSTRACE_TYPE_COMPLETE:
+		return snprintf(str, size,
+				"%s{\"name\":\"%s\",\"cat\":\"netsurf\","
+				"\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+				"\"ts\":%"PRIu64",\"dur\":%"PRId64"}",
+				sep, entry->name, entry->ts, entry->value);
+
+	case NSTRACE_TYPE_COUNTER:
+		return snprintf(str, size,
+				"%s{\"name\":\"%s\",\"cat\":\"netsurf\","
+				"\"ph\":\"C\",\"pid\":1,\"tid\":1,"
+				"\"ts\":%"PRIu64",\"args\":{\"value\":%"PRId64"}}",
+				sep, entry->name, entry->ts, entry->value);
+
+	case NSTRACE_TYPE_ASYNC_BEGIN:
+	case NSTRACE_TYPE_ASYNC_END:
+		return snprintf(str, size,
+				"%s{\"name\":\"%s\",\"cat\":\"netsurf\","
+				"\"ph\":\"%c\",\"pid\":1,\"tid\":1,"
+				"\"ts\":%"PRIu64",\"id\":\"0x%"PRIx64"\"}",
+				sep, entry->name,
+				(entry->type == NSTRACE_TYPE_ASYNC_BEGIN) ?
+				'b' : 'e',
+				entry->ts, (uint64_t)entry->value);
+	}
+
+	return -1;
+}
+
+
+/* exported interface documented in utils/trace.h */
+void nstrace_clear(void)
+{
+	nstrace_count = 0;
+}
+
+#else
+
+/* exported interface documented in utils/trace.h */
+void nstrace_event(enum nstrace_type type, const char *name,
+		uint64_t ts, int64_t value)
+{
+}
+
+
+/* exported interface documented in utils/trace.h */
+int nstrace_snevent(char *str, size_t size, unsigned int idx)
+{
+	return -1;
+}
+
+
+/* exported interface documented in utils/trace.h */
+void nstrace_clear(void)
+{
+}
+
+#endif
+
+
+/* exported interface documented in utils/trace.h */
+uint64_t nstrace_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+#endif
+	struct timeval tv;
+
+#ifdef CLOCK_MONOTONIC
+	/* unaffected by the wall clock being stepped */
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+	}
+#endif
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+
+/* exported interface documented in utils/trace.h */
+nserror nstrace_dump(FILE *fp)
+{
+	char buffer[256];
+	unsigned int idx;
+	int len;
+
+	fputs(NSTRACE_JSON_HEADER, fp);
+
+	for (idx = 0;
+	     (len = nstrace_snevent(buffer, sizeof(buffer), idx)) >= 0;
+	     idx++) {
+		if ((size_t)len >= sizeof(buffer)) {
+			/* skip any event too long for the buffer */
+			continue;
+		}
+		fputs(buffer, fp);
+	}
+
+	fputs(NSTRACE_JSON_FOOTER, fp);
+
+	if (ferror(fp)) {
+		return NSERROR_SAVE_FAILED;
+	}
+
+	return NSERROR_OK;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2017 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Performance tracing interface.
+ *
+ * Trace events are recorded in a fixed size ring buffer, the oldest
+ * events being overwritten once it is full, and may be output in the
+ * Chrome trace event JSON format for viewing in a timeline.
+ *
+ * Tracing is only compiled in when WITH_TRACE is defined (by building
+ * with NETSURF_USE_TRACE), otherwise the event macros expand to nothing
+ * and the output contains no events.
+ *
+ * Events must be recorded from the browser thread.  Event names must be
+ * string literals as only the pointer is stored.
+ */
+
+#ifndef NETSURF_UTILS_TRACE_H
+#define NETSURF_UTILS_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "utils/errors.h"
+
+/** Start of the trace event JSON output */
+#define NSTRACE_JSON_HEADER "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+
+/** End of the trace event JSON output */
+#define NSTRACE_JSON_FOOTER "\n]}\n"
+
+/** Trace event types */
+enum nstrace_type {
+	NSTRACE_TYPE_BEGIN, /**< start of a nested duration */
+	NSTRACE_TYPE_END, /**< end of a nested duration */
+	NSTRACE_TYPE_COMPLETE, /**< duration with explicit times */
+	NSTRACE_TYPE_COUNTER, /**< counter value */
+	NSTRACE_TYPE_ASYNC_BEGIN, /**< start of an overlapping duration */
+	NSTRACE_TYPE_ASYNC_END /**< end of an overlapping duration */
+};
+
+/**
+ * Get the current trace time.
+ *
+ * This may be called from any thread.
+ *
+ * \return The current time in microseconds.
+ */
+uint64_t nstrace_now(void);
+
+/**
+ * Record a trace event.
+ *
+ * Use the NSTRACE_ macros rather than calling this directly.
+ *
+ * \param type The type of event.
+ * \param name The event name, which must be a string literal.
+ * \param ts The time of the event in microseconds.
+ * \param value The counter value, async identifier or complete duration.
+ */
+void nstrace_event(enum nstrace_type type, const char *name,
+		uint64_t ts, int64_t value);
+
+/**
+ * Format a recorded trace event as Chrome trace event JSON.
+ *
+ * Events are indexed from the oldest.  Each event other than the first
+ * is preceded by a separator so the events may be concatenated between
+ * NSTRACE_JSON_HEADER and NSTRACE_JSON_FOOTER.
+ *
+ * \param str The buffer to format into.
+ * \param size The size of the buffer.
+ * \param idx The index of the event.
+ * \return The number of characters the event needs, excluding the
+ *         terminator, as for snprintf, or -1 if there is no such event.
+ */
+int nstrace_snevent(char *str, size_t size, unsigned int idx);
+
+/**
+ * Write the recorded trace events as Chrome trace event JSON.
+ *
+ * \param fp The file to write to.
+ * \return NSERROR_OK on success or NSERROR_SAVE_FAILED on write error.
+ */
+nserror nstrace_dump(FILE *fp);
+
+/**
+ * Discard all recorded trace events.
+ */
+void nstrace_clear(void);
+
+#ifdef WITH_TRACE
+
+/** Begin a duration which ends before any enclosing one */
+#define NSTRACE_BEGIN(name) \
+	nstrace_event(NSTRACE_TYPE_BEGIN, (name), nstrace_now(), 0)
+
+/** End the innermost duration begun with NSTRACE_BEGIN */
+#define NSTRACE_END(name) \
+	nstrace_event(NSTRACE_TYPE_END, (name), nstrace_now(), 0)
+
+/** Record a duration measured with nstrace_now(), perhaps on another thread */
+#define NSTRACE_COMPLETE(name, start, end) \
+	nstrace_event(NSTRACE_TYPE_COMPLETE, (name), (start), \
+		      (int64_t)((end) - (start)))
+
+/** Record the value of a counter */
+#define NSTRACE_COUNTER(name, value) \
+	nstrace_event(NSTRACE_TYPE_COUNTER, (name), nstrace_now(), \
+		      (int64_t)(value))
+
+/** Begin a duration which may overlap others, identified by a pointer */
+#define NSTRACE_ASYNC_BEGIN(name, ptr) \
+	nstrace_event(NSTRACE_TYPE_ASYNC_BEGIN, (name), nstrace_now(), \
+		      (int64_t)(uintptr_t)(ptr))
+
+/** End a duration begun with NSTRACE_ASYNC_BEGIN */
+#define NSTRACE_ASYNC_END(name, ptr) \
+	nstrace_event(NSTRACE_TYPE_ASYNC_END, (name), nstrace_now(), \
+		      (int64_t)(uintptr_t)(ptr))
+
+#else
+
+#define NSTRACE_BEGIN(name) do { } while (0)
+#define NSTRACE_END(name) do { } while (0)
+#define NSTRACE_COMPLETE(name, start, end) do { } while (0)
+#define NSTRACE_COUNTER(name, value) do { } while (0)
+#define NSTRACE_ASYNC_BEGIN(name, ptr) do { } while (0)
+#define NSTRACE_ASYNC_END(name, ptr) do { } while (0)
+
+#endif
+
+#endif